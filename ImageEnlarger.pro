@@ -48,7 +48,14 @@ SOURCES += src/main.cpp \
     src/EnlargerThread.cpp \
     src/TemplateInst.cpp \
     src/ImageEnlargerCode/FractTab.cpp \
+    src/ImageEnlargerCode/SelectKernel.cpp \
+    src/ImageEnlargerCode/BlockGeometry.cpp \
+    src/ImageEnlargerCode/ScratchArena.cpp \
+    src/ImageEnlargerCode/KernelTab.cpp \
+    src/ImageEnlargerCode/SetupCache.cpp \
     src/CalcQueue.cpp \
+    src/BandWriter.cpp \
+    src/ImageSource.cpp \
     src/ArgumentParser.cpp \
     src/ConsoleManager.cpp \
     src/ED_LoadSave.cpp \
@@ -69,7 +76,15 @@ HEADERS += src/selectField.h \
     src/EnlargerThread.h \
     src/ImageEnlargerCode/EnlargerTemplateDefs.h \
     src/ImageEnlargerCode/FractTab.h \
+    src/ImageEnlargerCode/SelectKernel.h \
+    src/ImageEnlargerCode/PlanarArray.h \
+    src/ImageEnlargerCode/BlockGeometry.h \
+    src/ImageEnlargerCode/ScratchArena.h \
+    src/ImageEnlargerCode/KernelTab.h \
+    src/ImageEnlargerCode/SetupCache.h \
     src/CalcQueue.h \
+    src/BandWriter.h \
+    src/ImageSource.h \
     src/ImageEnlargerCode/EnlargeParam.h \
     src/ArgumentParser.h \
     src/ImageEnlargerCode/EnlargerTemplate.h \
@@ -81,4 +96,8 @@ HEADERS += src/selectField.h \
 FORMS += src/enlargerdialog.ui \
     src/preferences.ui
 RESOURCES += ressources.qrc
+
+# zlib for the streaming png-output (BandWriter.cpp); Qt's own copy on windows
+unix: LIBS += -lz
+win32: INCLUDEPATH += $$[QT_INSTALL_HEADERS]/QtZlib
 CONFIG += console
@@ -31,6 +31,7 @@ using namespace std;
 
 ArgumentParser::ArgumentParser(void) {
    optionsFound = 0;
+   quiet = false;
 }
 
 ArgumentParser::~ArgumentParser(void) {
@@ -67,7 +68,8 @@ bool ArgumentParser::Parse(int argc, char *argv[]) {
             }
          }
 		 if(!optionIsValid) {   // option not in optionList -> error
-            cout<<"Error: Unknown option '"<<currentArg.toStdString()<<"'.\n"<<flush;
+            if(!quiet)
+               cout<<"Error: Unknown option '"<<currentArg.toStdString()<<"'.\n"<<flush;
             return false;
          }
       }
@@ -131,14 +133,18 @@ bool IntegerOption::Parse(const QString & optArg, const QString & nextArg, bool
          bool ok;
 		 value = nextArg.toInt(&ok);
 		 if(!ok) {
-            cout<<"Option '"<<optArg.toStdString()<<"': wrong parameter '"<<nextArg.toStdString()<<"'. \n";
-            cout<<"   Integer number expected.\n"<<flush;
+            if(!Quiet()) {
+               cout<<"Option '"<<optArg.toStdString()<<"': wrong parameter '"<<nextArg.toStdString()<<"'. \n";
+               cout<<"   Integer number expected.\n"<<flush;
+            }
             error = true;
             return true;
          }
 		 if(hasRange && (value<minVal || value>maxVal)) {
-            cout<<"Option '"<<optArg.toStdString()<<"': parameter "<<nextArg.toStdString()<<" out of range. \n";
-            cout<<"   Should be between "<<minVal<<" and "<<maxVal<<" .\n"<<flush;
+            if(!Quiet()) {
+               cout<<"Option '"<<optArg.toStdString()<<"': parameter "<<nextArg.toStdString()<<" out of range. \n";
+               cout<<"   Should be between "<<minVal<<" and "<<maxVal<<" .\n"<<flush;
+            }
             error = true;
             return true;
          }
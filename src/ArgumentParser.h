@@ -33,6 +33,7 @@ class ArgumentParser {
    QList< BasicOption* > optionList;
    QStringList otherArgs;
    int optionsFound;
+   bool quiet;       // no error messages
 
 public:
    ArgumentParser(void);
@@ -41,6 +42,8 @@ public:
    bool Parse(int argc, char *argv[]);  // return false -> error
    QStringList NonOptionArguments(void) { return otherArgs; }
    bool OptionsFound(void) { return optionsFound; }
+   void SetQuiet(bool q) { quiet = q; }
+   bool Quiet(void) { return quiet; }
 
 private:
 
@@ -67,6 +70,7 @@ protected:
    virtual bool HasParameter(void) { return false; }
    QStringList OptStrings(void) { return optStrings; }
    void SetFound(bool f) { optFound = f; }
+   bool Quiet(void) { return myParser != 0 && myParser->Quiet(); }   // no error messages
 
 };
 
@@ -0,0 +1,542 @@
+/* ----------------------------------------------------------------
+
+SmillaEnlarger  -  resize, especially magnify bitmaps in high quality
+    BandWriter.cpp: writing the result band by band
+
+Copyright (C) 2009 Mischa Lusteck
+Copyright (C) 2017 Alejandro Sirgo
+
+This program is free software;
+you can redistribute it and/or modify it under the terms of the
+GNU General Public License as published by the Free Software Foundation;
+either version 3 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+---------------------------------------------------------------------- */
+
+#include <QFileInfo>
+#include <QDir>
+#include <cstring>
+#include <vector>
+#include <zlib.h>
+#include "BandWriter.h"
+#include "ImageEnlargerCode/PointClass.h"
+#include "ImageEnlargerCode/ArraysTemplate.h"
+
+using namespace std;
+
+static bool streamOutputOn = false;
+
+void SetStreamOutput(bool on) { streamOutputOn = on; }
+bool StreamOutput(void) { return streamOutputOn; }
+
+BandWriter::BandWriter(const QString & fileName, int w, int h, bool withAlpha, int numChannels)
+   : file(fileName), width(w), height(h), alpha(withAlpha), channels(numChannels),
+     rowsWritten(0), writeError(false) {
+   rowBuf = new uchar[ size_t(width)*channels ];
+}
+
+BandWriter::~BandWriter(void) {
+   file.close();
+   delete[] rowBuf;
+}
+
+bool BandWriter::Put(const void *data, qint64 len) {
+   if(writeError)
+      return false;
+   if(file.write(reinterpret_cast<const char *>(data), len) != len)
+      writeError = true;
+   return !writeError;
+}
+
+void BandWriter::ConvertRow(const QRgb *row) {
+   uchar *p = rowBuf;
+   if(channels == 4) {
+	  for(int x=0; x<width; x++, p+=4) {
+         p[0] = qRed(row[x]);  p[1] = qGreen(row[x]);
+         p[2] = qBlue(row[x]); p[3] = qAlpha(row[x]);
+      }
+   }
+   else {
+	  for(int x=0; x<width; x++, p+=3) {
+         p[0] = qRed(row[x]); p[1] = qGreen(row[x]); p[2] = qBlue(row[x]);
+      }
+   }
+}
+
+bool BandWriter::Open(void) {
+   if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+      return false;
+   return WriteHeader() && !writeError;
+}
+
+bool BandWriter::WriteRows(const uchar *bits, int bytesPerLine, int numRows) {
+   for(int y=0; y<numRows; y++, rowsWritten++) {
+	  if(rowsWritten >= height || !WriteRow(reinterpret_cast<const QRgb *>(bits + qint64(y)*bytesPerLine)))
+         return false;
+   }
+   return !writeError;
+}
+
+bool BandWriter::WriteRows(QRgb c, int numRows) {
+   vector<QRgb> row(width, c);
+   for(int y=0; y<numRows; y++, rowsWritten++) {
+	  if(rowsWritten >= height || !WriteRow(row.data()))
+         return false;
+   }
+   return !writeError;
+}
+
+bool BandWriter::Close(void) {
+   bool ok = rowsWritten == height && WriteEnd() && !writeError;
+   if(!file.flush())
+      ok = false;
+   file.close();
+   return ok;
+}
+
+void BandWriter::Remove(void) {
+   file.close();
+   file.remove();
+}
+
+//--------------------------------------------------------------------
+// netpbm: ppm (RGB, alpha is dropped), pam (RGB or RGB_ALPHA)
+
+class PnmWriter : public BandWriter {
+   bool pam;
+public:
+   PnmWriter(const QString & fileName, int w, int h, bool withAlpha, bool isPam)
+      : BandWriter(fileName, w, h, withAlpha, (isPam && withAlpha) ? 4 : 3), pam(isPam) {}
+
+   bool WriteHeader(void) {
+      QByteArray head;
+	  if(pam)
+		 head = "P7\nWIDTH " + QByteArray::number(width) + "\nHEIGHT " + QByteArray::number(height)
+			  + "\nDEPTH " + QByteArray::number(channels) + "\nMAXVAL 255\nTUPLTYPE "
+			  + (channels == 4 ? "RGB_ALPHA" : "RGB") + "\nENDHDR\n";
+      else
+		 head = "P6\n" + QByteArray::number(width) + " " + QByteArray::number(height) + "\n255\n";
+	  return Put(head.constData(), head.size());
+   }
+   bool WriteRow(const QRgb *row) {
+      ConvertRow(row);
+	  return Put(rowBuf, qint64(width)*channels);
+   }
+};
+
+// raw: the RGB or RGBA bytes, no header
+class RawWriter : public BandWriter {
+public:
+   RawWriter(const QString & fileName, int w, int h, bool withAlpha)
+      : BandWriter(fileName, w, h, withAlpha, withAlpha ? 4 : 3) {}
+
+   bool WriteHeader(void) { return true; }
+   bool WriteRow(const QRgb *row) {
+      ConvertRow(row);
+	  return Put(rowBuf, qint64(width)*channels);
+   }
+};
+
+//--------------------------------------------------------------------
+// png: 8bit RGB/RGBA, each row with filter 'Sub', deflated into a chain of IDAT-chunks
+
+const int pngChunkLen = 1<<16;
+
+class PngWriter : public BandWriter {
+   z_stream zs;
+   bool     zsOpen;
+   int      level;
+   uchar   *filtered;   // filter byte + row
+   uchar   *zBuf;       // deflated data of the next IDAT
+
+   static void PutBE32(uchar *p, unsigned long v) {
+      p[0] = uchar(v>>24); p[1] = uchar(v>>16); p[2] = uchar(v>>8); p[3] = uchar(v);
+   }
+   bool PutChunk(const char *type, const uchar *data, unsigned long len) {
+      uchar h[8], c[4];
+      PutBE32(h, len);
+	  memcpy(h+4, type, 4);
+      uLong crc = crc32(0L, Z_NULL, 0);
+	  crc = crc32(crc, h+4, 4);
+	  if(len > 0)
+		 crc = crc32(crc, data, len);
+      PutBE32(c, crc);
+	  return Put(h, 8) && (len == 0 || Put(data, len)) && Put(c, 4);
+   }
+   // deflate & write the full IDATs, with Z_FINISH up to the end
+   bool Deflate(const uchar *data, long len, int flush) {
+      zs.next_in  = const_cast<Bytef *>(data);
+      zs.avail_in = uInt(len);
+      for(;;) {
+         int r = deflate(&zs, flush);
+		 if(r == Z_STREAM_ERROR)
+            return false;
+		 if(zs.avail_out == 0) {
+			if(!PutChunk("IDAT", zBuf, pngChunkLen))
+               return false;
+            zs.next_out  = zBuf;
+            zs.avail_out = pngChunkLen;
+            continue;
+         }
+		 if(flush == Z_FINISH ? r == Z_STREAM_END : zs.avail_in == 0)
+            return true;
+      }
+   }
+
+public:
+   PngWriter(const QString & fileName, int w, int h, bool withAlpha, int quality)
+      : BandWriter(fileName, w, h, withAlpha, withAlpha ? 4 : 3), zsOpen(false) {
+	  level = Z_DEFAULT_COMPRESSION;
+	  if(quality >= 0)                            // as Qt's png-writer
+		 level = (100 - (quality > 100 ? 100 : quality))*9/91;
+	  filtered = new uchar[ size_t(width)*channels + 1 ];
+	  zBuf     = new uchar[ pngChunkLen ];
+   }
+   ~PngWriter(void) {
+	  if(zsOpen)
+         deflateEnd(&zs);
+      delete[] filtered;
+      delete[] zBuf;
+   }
+
+   bool WriteHeader(void) {
+      static const uchar signature[8] = { 0x89, 'P', 'N', 'G', 0x0d, 0x0a, 0x1a, 0x0a };
+      uchar ihdr[13];
+      PutBE32(ihdr, width);
+      PutBE32(ihdr+4, height);
+      ihdr[8]  = 8;                     // bit depth
+      ihdr[9]  = channels == 4 ? 6 : 2; // RGBA : RGB
+      ihdr[10] = ihdr[11] = ihdr[12] = 0;
+
+	  memset(&zs, 0, sizeof(zs));
+	  if(deflateInit(&zs, level) != Z_OK)
+         return false;
+      zsOpen = true;
+      zs.next_out  = zBuf;
+      zs.avail_out = pngChunkLen;
+	  return Put(signature, 8) && PutChunk("IHDR", ihdr, 13);
+   }
+   bool WriteRow(const QRgb *row) {
+      long len = long(width)*channels;
+      ConvertRow(row);
+      filtered[0] = 1;     // Sub: difference to the left pixel
+	  for(long a=0; a<channels && a<len; a++)
+         filtered[a+1] = rowBuf[a];
+	  for(long a=channels; a<len; a++)
+		 filtered[a+1] = uchar(rowBuf[a] - rowBuf[a-channels]);
+	  return Deflate(filtered, len+1, Z_NO_FLUSH);
+   }
+   bool WriteEnd(void) {
+	  if(!Deflate(0, 0, Z_FINISH))
+         return false;
+	  if(zs.avail_out < uInt(pngChunkLen) && !PutChunk("IDAT", zBuf, pngChunkLen - zs.avail_out))
+         return false;
+	  return PutChunk("IEND", 0, 0);
+   }
+};
+
+//--------------------------------------------------------------------
+// tiff: uncompressed 8bit RGB/RGBA (unassociated alpha) in strips, little endian;
+// the data are uncompressed, so the strip offsets are known before, the IFD comes first.
+// BigTIFF if the file doesn't fit in 32bit offsets
+
+const long tiffStripBytes = 1<<16;
+
+enum { tiffShort = 3, tiffLong = 4, tiffRational = 5, tiffLong8 = 16 };
+
+struct TiffEntry {
+   int tag, type;
+   vector<quint64> values;   // rational: numerator, denominator
+   TiffEntry(int t, int ty) : tag(t), type(ty) {}
+   TiffEntry(int t, int ty, quint64 v) : tag(t), type(ty), values(1, v) {}
+   long Count(void) const { return type == tiffRational ? long(values.size())/2 : long(values.size()); }
+   long Bytes(void) const {
+	  int s = (type == tiffShort) ? 2 : (type == tiffLong8 || type == tiffRational) ? 8 : 4;
+	  return Count()*s;
+   }
+};
+
+class TiffWriter : public BandWriter {
+   bool big;
+   vector<uchar> buf;
+
+   void Put16(quint64 v) { buf.push_back(uchar(v)); buf.push_back(uchar(v>>8)); }
+   void Put32(quint64 v) { Put16(v & 0xffff); Put16(v>>16); }
+   void Put64(quint64 v) { Put32(v & 0xffffffff); Put32(v>>32); }
+   void PutOffset(quint64 v) { if(big) Put64(v); else Put32(v); }
+   void PutValues(const TiffEntry & e) {
+	  for(size_t a=0; a<e.values.size(); a++) {
+		 if(e.type == tiffShort)       Put16(e.values[a]);
+		 else if(e.type == tiffLong8)  Put64(e.values[a]);
+         else                          Put32(e.values[a]);
+      }
+   }
+
+public:
+   TiffWriter(const QString & fileName, int w, int h, bool withAlpha)
+      : BandWriter(fileName, w, h, withAlpha, withAlpha ? 4 : 3), big(false) {}
+
+   bool WriteHeader(void) {
+	  quint64 rowBytes = quint64(width)*channels;
+	  long rowsPerStrip = tiffStripBytes / long(rowBytes);
+	  if(rowsPerStrip < 1)        rowsPerStrip = 1;
+	  if(rowsPerStrip > height)   rowsPerStrip = height;
+	  long numStrips = (height + rowsPerStrip - 1) / rowsPerStrip;
+	  quint64 dataBytes = rowBytes*quint64(height);
+	  big = dataBytes + 16*quint64(numStrips) + 1024 > 0xffffffffULL;
+
+      vector<TiffEntry> entries;
+	  entries.push_back(TiffEntry(256, tiffLong, width));
+	  entries.push_back(TiffEntry(257, tiffLong, height));
+	  entries.push_back(TiffEntry(258, tiffShort));
+	  entries.back().values.assign(channels, 8);
+	  entries.push_back(TiffEntry(259, tiffShort, 1));                // no compression
+	  entries.push_back(TiffEntry(262, tiffShort, 2));                // RGB
+	  entries.push_back(TiffEntry(273, big ? tiffLong8 : tiffLong));  // strip offsets, below
+	  size_t stripOffsetsIdx = entries.size() - 1;
+	  entries.push_back(TiffEntry(277, tiffShort, channels));
+	  entries.push_back(TiffEntry(278, tiffLong, rowsPerStrip));
+	  entries.push_back(TiffEntry(279, tiffLong));                    // strip bytes
+	  for(long s=0; s<numStrips; s++) {
+		 long rows = (s < numStrips-1) ? rowsPerStrip : height - s*rowsPerStrip;
+		 entries.back().values.push_back(quint64(rows)*rowBytes);
+      }
+	  entries.push_back(TiffEntry(282, tiffRational));                // 72 dpi
+	  entries.back().values.push_back(72); entries.back().values.push_back(1);
+	  entries.push_back(TiffEntry(283, tiffRational));
+	  entries.back().values.push_back(72); entries.back().values.push_back(1);
+	  entries.push_back(TiffEntry(284, tiffShort, 1));                // interleaved
+	  entries.push_back(TiffEntry(296, tiffShort, 2));                // inch
+	  if(alpha)
+		 entries.push_back(TiffEntry(338, tiffShort, 2));             // unassociated alpha
+
+	  // header, IFD, the values not fitting into the entries, data
+	  long inlineBytes = big ? 8 : 4;
+	  quint64 ifdPos  = big ? 16 : 8;
+	  quint64 ifdLen  = big ? 8 + 20*entries.size() + 8 : 2 + 12*entries.size() + 4;
+	  quint64 extPos  = ifdPos + ifdLen;
+	  quint64 dataPos = extPos;
+	  for(size_t a=0; a<entries.size(); a++) {
+		 long b = (a == stripOffsetsIdx) ? numStrips*(big ? 8 : 4) : entries[a].Bytes();
+		 if(b > inlineBytes)
+			dataPos += (b + 1) & ~1L;
+      }
+	  for(long s=0; s<numStrips; s++)
+		 entries[stripOffsetsIdx].values.push_back(dataPos + quint64(s)*quint64(rowsPerStrip)*rowBytes);
+
+      buf.clear();
+	  Put16('I' | ('I'<<8));
+	  if(big) {
+         Put16(43); Put16(8); Put16(0); Put64(ifdPos);
+		 Put64(entries.size());
+      }
+      else {
+         Put16(42); Put32(ifdPos);
+		 Put16(entries.size());
+      }
+	  quint64 ext = extPos;
+	  for(size_t a=0; a<entries.size(); a++) {
+         const TiffEntry & e = entries[a];
+		 Put16(e.tag); Put16(e.type);
+		 if(big) Put64(e.Count()); else Put32(e.Count());
+		 if(e.Bytes() > inlineBytes) {
+            PutOffset(ext);
+			ext += (e.Bytes() + 1) & ~1L;
+         }
+         else {
+            size_t end = buf.size() + inlineBytes;
+            PutValues(e);
+			while(buf.size() < end)
+               buf.push_back(0);
+         }
+      }
+      PutOffset(0);   // no next IFD
+	  for(size_t a=0; a<entries.size(); a++) {
+		 if(entries[a].Bytes() > inlineBytes) {
+			PutValues(entries[a]);
+			if(entries[a].Bytes() & 1)
+               buf.push_back(0);
+         }
+      }
+	  bool ok = buf.size() == dataPos && Put(buf.data(), buf.size());
+	  vector<uchar>().swap(buf);
+      return ok;
+   }
+   bool WriteRow(const QRgb *row) {
+      ConvertRow(row);
+	  return Put(rowBuf, qint64(width)*channels);
+   }
+};
+
+//--------------------------------------------------------------------
+// deep zoom pyramid (dzi): name.dzi describes it, the tiles are name_files/<level>/<col>_<row>.<type>
+// Level maxLevel has the full size, each level below half the size (rounded up), level 0 is 1x1.
+// Each level collects one row of tiles (a strip). A full strip is written as tiles, and
+// tile by tile shrunk (ShrinkHalf) into the strip of the level below: one pass, no whole image.
+
+const int pyramidTileSize = 256;    // even: the tiles of a level shrink to the half tiles below
+
+class PyramidWriter : public BandWriter {
+   struct Level {
+      int width, height;
+      int stripY;       // row of the level at the top of the strip
+      int rows;         // rows in the strip
+      QImage strip;     // pyramidTileSize rows
+   };
+   QString tileDir;
+   const char *tileType;
+   int quality;
+   vector<Level> levels;
+
+   bool PutRow(int level, const QRgb *row);
+   bool FlushStrip(int level);
+
+public:
+   PyramidWriter(const QString & fileName, int w, int h, bool withAlpha, int q)
+      : BandWriter(fileName, w, h, withAlpha, 4), quality(q) {
+      QFileInfo fi(fileName);
+	  tileDir  = fi.absolutePath() + "/" + fi.completeBaseName() + "_files";
+	  tileType = alpha ? "png" : "jpg";
+   }
+
+   bool WriteHeader(void) {
+	  int maxLevel = 0;
+	  while((1<<maxLevel) < width || (1<<maxLevel) < height)
+         maxLevel++;
+	  levels.resize(maxLevel + 1);
+	  int w = width, h = height;
+	  for(int l=maxLevel; l>=0; l--) {
+		 Level & lev = levels[l];
+		 lev.width = w; lev.height = h;
+		 lev.stripY = lev.rows = 0;
+		 lev.strip = QImage(w, pyramidTileSize < h ? pyramidTileSize : h, QImage::Format_ARGB32);
+		 if(lev.strip.isNull() || !QDir().mkpath(tileDir + "/" + QString::number(l)))
+            return false;
+		 w = (w + 1)>>1;
+		 h = (h + 1)>>1;
+      }
+	  QByteArray head = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+		 "<Image xmlns=\"http://schemas.microsoft.com/deepzoom/2008\" TileSize=\""
+		 + QByteArray::number(pyramidTileSize) + "\" Overlap=\"0\" Format=\"" + tileType + "\">\n"
+		 "  <Size Width=\"" + QByteArray::number(width) + "\" Height=\"" + QByteArray::number(height) + "\"/>\n"
+		 "</Image>\n";
+	  return Put(head.constData(), head.size());
+   }
+   bool WriteRow(const QRgb *row) { return PutRow(int(levels.size()) - 1, row); }
+   bool WriteEnd(void) {
+	  for(size_t l=0; l<levels.size(); l++) {
+		 if(levels[l].stripY != levels[l].height)
+            return false;
+      }
+      return true;
+   }
+   void Remove(void) {
+      BandWriter::Remove();
+	  QDir(tileDir).removeRecursively();
+   }
+};
+
+bool PyramidWriter::PutRow(int level, const QRgb *row) {
+   Level & lev = levels[level];
+   memcpy(lev.strip.scanLine(lev.rows), row, size_t(lev.width)*sizeof(QRgb));
+   lev.rows++;
+   if(lev.rows == pyramidTileSize || lev.stripY + lev.rows == lev.height)
+      return FlushStrip(level);
+   return true;
+}
+
+static void ColorToPoint4(QRgb c, Point4 & p) {
+   p = Point4(qRed(c), qGreen(c), qBlue(c), qAlpha(c));
+}
+
+static QRgb Point4ToColor(const Point4 & p) {
+   return qRgba(int(p.x + 0.5), int(p.y + 0.5), int(p.z + 0.5), int(p.w + 0.5));
+}
+
+bool PyramidWriter::FlushStrip(int level) {
+   Level & lev = levels[level];
+   int tileRow = lev.stripY / pyramidTileSize;
+   QImage half;
+   if(level > 0) {
+	  half = QImage((lev.width + 1)>>1, (lev.rows + 1)>>1, QImage::Format_ARGB32);
+	  if(half.isNull())
+         return false;
+   }
+
+   for(int x0=0, col=0; x0<lev.width; x0+=pyramidTileSize, col++) {
+	  int tw = lev.width - x0 < pyramidTileSize ? lev.width - x0 : pyramidTileSize;
+	  QImage tile = lev.strip.copy(x0, 0, tw, lev.rows);
+	  if(!alpha)
+		 tile = tile.convertToFormat(QImage::Format_RGB32);
+	  QString name = tileDir + "/" + QString::number(level) + "/"
+					 + QString::number(col) + "_" + QString::number(tileRow) + "." + tileType;
+	  if(!tile.save(name, 0, quality))
+         return false;
+	  if(level == 0)
+         continue;
+
+	  // even size (the odd edge repeated), so ShrinkHalf averages 4 pixels everywhere
+	  int ew = (tw + 1) & ~1, eh = (lev.rows + 1) & ~1;
+	  BasicArray<Point4> arr(ew, eh);
+	  for(int y=0; y<eh; y++) {
+		 const QRgb *line = reinterpret_cast<const QRgb *>(lev.strip.constScanLine(y < lev.rows ? y : y-1)) + x0;
+		 for(int x=0; x<ew; x++) {
+            Point4 p;
+			ColorToPoint4(line[x < tw ? x : x-1], p);
+            arr.Set(x, y, p);
+         }
+      }
+	  BasicArray<Point4> *halfArr = arr.ShrinkHalf();
+	  for(int y=0; y<halfArr->SizeY(); y++) {
+		 QRgb *line = reinterpret_cast<QRgb *>(half.scanLine(y)) + (x0>>1);
+		 for(int x=0; x<halfArr->SizeX(); x++)
+			line[x] = Point4ToColor(halfArr->Get(x, y));
+      }
+	  delete halfArr;
+   }
+
+   lev.stripY += lev.rows;
+   lev.rows = 0;
+   for(int y=0; y<half.height(); y++) {
+	  if(!PutRow(level - 1, reinterpret_cast<const QRgb *>(half.constScanLine(y))))
+         return false;
+   }
+   return true;
+}
+
+//--------------------------------------------------------------------
+
+bool BandWriter::CanStream(const QString & fileName) {
+   QString type = QFileInfo(fileName).suffix().toLower();
+   return type == "png" || type == "tif" || type == "tiff" || type == "ppm" || type == "pam" || type == "raw"
+	   || type == "dzi";
+}
+
+bool BandWriter::NeedsStream(const QString & fileName) {
+   QString type = QFileInfo(fileName).suffix().toLower();
+   return type == "pam" || type == "raw" || type == "dzi";
+}
+
+BandWriter *BandWriter::Create(const QString & fileName, int w, int h, bool withAlpha, int quality) {
+   QString type = QFileInfo(fileName).suffix().toLower();
+   if(type == "png")
+	  return new PngWriter(fileName, w, h, withAlpha, quality);
+   if(type == "tif" || type == "tiff")
+	  return new TiffWriter(fileName, w, h, withAlpha);
+   if(type == "ppm" || type == "pam")
+	  return new PnmWriter(fileName, w, h, withAlpha, type == "pam");
+   if(type == "raw")
+	  return new RawWriter(fileName, w, h, withAlpha);
+   if(type == "dzi")
+	  return new PyramidWriter(fileName, w, h, withAlpha, quality);
+   return 0;
+}
@@ -0,0 +1,78 @@
+/* ----------------------------------------------------------------
+
+SmillaEnlarger  -  resize, especially magnify bitmaps in high quality
+    BandWriter.h: writing the result band by band
+
+Copyright (C) 2009 Mischa Lusteck
+Copyright (C) 2017 Alejandro Sirgo
+
+This program is free software;
+you can redistribute it and/or modify it under the terms of the
+GNU General Public License as published by the Free Software Foundation;
+either version 3 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+---------------------------------------------------------------------- */
+
+#ifndef BANDWRITER_H
+#define BANDWRITER_H
+
+#include <QString>
+#include <QFile>
+#include <QImage>
+
+// streaming output: the result isn't held in memory as a whole,
+// each finished band of blocks is written & discarded (see ThEnlarger::Enlarge)
+void SetStreamOutput(bool on);
+bool StreamOutput(void);
+
+// Writes an image row by row, top to bottom, for results too big for memory.
+// The rows are 32bit QRgb scanlines (RGB32, or ARGB32 if alpha).
+// Types: png (zlib), tif/tiff (uncompressed strips, BigTIFF beyond 4GB), ppm, pam, raw (RGB/RGBA bytes),
+// dzi (deep zoom tile pyramid, the tiles in a directory beside the .dzi)
+class BandWriter {
+protected:
+   QFile file;
+   int width, height;
+   bool alpha;
+   int channels;        // bytes per pixel in the file
+   uchar *rowBuf;       // one converted row
+   int rowsWritten;
+   bool writeError;
+
+   bool Put(const void *data, qint64 len);
+   void ConvertRow(const QRgb *row);   // -> rowBuf
+
+   virtual bool WriteHeader(void) = 0;
+   virtual bool WriteRow(const QRgb *row) = 0;
+   virtual bool WriteEnd(void) { return true; }
+
+public:
+   BandWriter(const QString & fileName, int w, int h, bool withAlpha, int numChannels);
+   virtual ~BandWriter(void);
+
+   // a writer for the type of fileName, 0 if this type can't be streamed
+   // quality: as for QImage::save (png: compression level)
+   static BandWriter *Create(const QString & fileName, int w, int h, bool withAlpha, int quality);
+   static bool CanStream(const QString & fileName);
+   static bool NeedsStream(const QString & fileName);   // QImage can't save this type
+
+   bool Open(void);    // create the file & write the header
+   bool WriteRows(const uchar *bits, int bytesPerLine, int numRows);
+   bool WriteRows(QRgb c, int numRows);        // rows of one color (margins)
+   bool Close(void);   // write the end, false if anything failed or rows are missing
+   virtual void Remove(void);  // close & delete an unfinished file
+   bool Failed(void) const { return writeError; }
+   int Width(void)  const { return width;  }
+   int Height(void) const { return height; }
+};
+
+#endif // BANDWRITER_H
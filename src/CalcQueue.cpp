@@ -25,13 +25,18 @@ along with this program; if not, see <http://www.gnu.org/licenses/>.
 #include <iostream>
 #include <QFile>
 #include <QDir>
+#include <QDirIterator>
 #include <QStringList>
 #include <QImage>
+#include <QThread>
+#include <QThreadPool>
 #include <QTimer>
 #include <QAbstractListModel>
 #include "EnlargerThread.h"
+#include "ImageSource.h"
 #include "formatterclass.h"
 #include "CalcQueue.h"
+#include <unistd.h>
 using namespace std;
 
 void JobListModel::setJobList(const QStringList & list) {
@@ -67,6 +72,8 @@ Qt::ItemFlags JobListModel::flags(const QModelIndex & index) const {
 
 bool JobListModel::setData(const QModelIndex & index, const QVariant & value, int role) {
    if (index.isValid()  && role == Qt::EditRole) {
+	  if(jobList.at(index.row()) == value.toString())    // unchanged: no repaint
+         return true;
 	  jobList.replace(index.row(), value.toString());
 	  emit dataChanged(index, index);
       return true;
@@ -85,9 +92,7 @@ bool JobListModel::insertRows(int position, int rows, const QModelIndex & parent
 
 bool JobListModel::removeRows(int position, int rows, const QModelIndex & parent) {
    beginRemoveRows(QModelIndex(), position, position+rows-1);
-   for (int row = 0; row < rows; ++row) {
-	  jobList.removeAt(position);
-   }
+   jobList.erase(jobList.begin() + position, jobList.begin() + position + rows);
    endRemoveRows();
    return true;
 }
@@ -98,6 +103,9 @@ SingleCalcJob::SingleCalcJob(FormatterClass *formatter) {
    myThread = 0;
    progress = 0;
    srcImg   = 0;    // no image attached - use srcPath
+   estimated = false;
+   workers   = 1;
+   peakBytes = 0.0;
    myFormatter = formatter->Clone();  // create own clone, delete it at end
 }
 
@@ -105,6 +113,9 @@ SingleCalcJob::SingleCalcJob(FormatterClass *formatter, bool useClipping) {
    myThread = 0;
    progress = 0;
    srcImg   = 0;    // no image attached - use srcPath
+   estimated = false;
+   workers   = 1;
+   peakBytes = 0.0;
    myFormatter = formatter->Clone();  // create own clone, delete it at end
    if(!useClipping) {
       myFormatter->NoClipping();
@@ -125,6 +136,34 @@ void SingleCalcJob::AttachImage(const QImage & srcI) {
    if(srcImg != 0)
       delete srcImg;
    srcImg = new QImage(srcI);
+   estimated = false;
+}
+
+// the format from the size of the src, without decoding it:
+// the workers (at most the cores of the queue) and the peak memory of the enlargement
+void SingleCalcJob::Estimate(void) {
+   if(estimated)
+      return;
+   estimated = true;
+   workers   = 1;
+   peakBytes = 0.0;
+
+   int w = 0, h = 0;
+   bool hasAlpha = true;     // a file: from the format in its header (ReadSize)
+   if(srcImg != 0) {
+	  w = srcImg->width();
+	  h = srcImg->height();
+	  hasAlpha = srcImg->hasAlphaChannel();
+   }
+   else if(!ImageSource::ReadSize(srcPath, w, h, hasAlpha))
+      return;                // can't be opened: fails at the start
+
+   EnlargeFormat format;
+   myFormatter->CalculateFormat(w, h, format);
+   workers = UsefulWorkers(format, hasAlpha);
+   if(IsInQueue() && workers > Queue()->CoreBudget())
+	  workers = Queue()->CoreBudget();
+   peakBytes = EstimatePeakBytes(format, hasAlpha, dstPath, workers);
 }
 
 void SingleCalcJob::SetActivity(CalcJobActivity  act) {
@@ -135,7 +174,7 @@ void SingleCalcJob::SetActivity(CalcJobActivity  act) {
          return;
       }
 	  if(Activity() == null && act != null ) {
-         StartEnlarge();
+         StartEnlarge(act);
       }
       else
          return;
@@ -147,6 +186,7 @@ void SingleCalcJob::SetActivity(CalcJobActivity  act) {
       return;
    }
 
+   myThread->SetPoolPriority(int(act));   // its blocks in the shared pool
    if(act == null) {
 	  myThread->setPriority(QThread::IdlePriority);
    }
@@ -202,12 +242,15 @@ QString SingleCalcJob::InfoString(void) {
    return infoStr;
 }
 
-// create thread, give parameters, start enlarging
-void SingleCalcJob::StartEnlarge(void) {
-    QImage srcImage;
+// create thread, give parameters, start enlarging.
+// A src file is only measured here, the thread decodes it (not the GUI)
+void SingleCalcJob::StartEnlarge(CalcJobActivity act) {
+   int w, h;
+   bool hasAlpha;
 
 	if(srcImg != 0) {
-       srcImage = *srcImg;
+	   w = srcImg->width();
+	   h = srcImg->height();
     }
     else {
 	   if(!QFile::exists( srcPath))  {
@@ -216,36 +259,38 @@ void SingleCalcJob::StartEnlarge(void) {
 		  SetError(srcNotFound);
           return;
        }
-	   if(!srcImage.load(srcPath)) {
+	   if(!ImageSource::ReadSize(srcPath, w, h, hasAlpha)) {
 		  emit ErrorMessage("<b>ERROR</b> calculating '"+dstName+"'. Could not open image '" + srcPath + "'.");
           cout<<"CalcJob: Could not open image"<<srcPath.toStdString()<<" .\n"<<flush;
 		  SetStatus(failed);
 		  SetError(srcOpenFailed);
           return;
        }
-	   if(srcImage.hasAlphaChannel())
-		  srcImage = srcImage.convertToFormat(QImage::Format_ARGB32);
-       else
-		  srcImage = srcImage.convertToFormat(QImage::Format_RGB32);
    }
 
    if(myThread == 0) {
       myThread = new EnlargerThread();
 	  connect(myThread, SIGNAL(imageSaved(int,int)),      this, SLOT(slot_imageSaved(int,int)));
 	  connect(myThread, SIGNAL(imageNotSaved()),   this, SLOT(slot_imageNotSaved()));
+	  connect(myThread, SIGNAL(sourceNotOpened()), this, SLOT(slot_sourceNotOpened()));
 	  connect(myThread, SIGNAL(badAlloc()),        this, SLOT(slot_badAlloc()));
 	  connect(myThread, SIGNAL(tellProgress(int)), this, SLOT(slot_getProgress(int)));
    }
 
    EnlargeFormat format;
-   myFormatter->CalculateFormat(srcImage.width(), srcImage.height(), format);
+   myFormatter->CalculateFormat(w, h, format);
 
    QString msg;
    msg = "Started '" + dstName +"'. ";
    msg +="Zoom: (" + QString::number(format.scaleX) + " , " + QString::number(format.scaleY) + "). ";
    msg +="Result: " + QString::number(format.ClipW()) + "x" + QString::number(format.ClipH()) + ".";
    emit StatusMessage(msg);
-   myThread->EnlargeAndSave(srcImage, format, param.FloatParam(), dstPath, resultQuality);
+   myThread->SetWorkers(ThreadsUsed());
+   myThread->SetPoolPriority(int(act));
+   if(srcImg != 0)
+	  myThread->EnlargeAndSave(ImageSource::FromImage(*srcImg), format, param.FloatParam(), dstPath, resultQuality);
+   else
+	  myThread->EnlargeFileAndSave(srcPath, format, param.FloatParam(), dstPath, resultQuality);
    myThread->setPriority(QThread::IdlePriority);
    SetStatus(running);
 }
@@ -267,6 +312,13 @@ void SingleCalcJob::StartEnlarge(void) {
    EndEnlarge();
 }
 
+void SingleCalcJob::slot_sourceNotOpened(void){
+   emit ErrorMessage("<b>ERROR</b> calculating '"+dstName+"'. Could not open image '" + srcPath + "'.");
+   SetStatus(failed);
+   SetError(srcOpenFailed);
+   EndEnlarge();
+}
+
 void SingleCalcJob::slot_imageNotSaved(void){
    emit ErrorMessage("<b>ERROR</b> calculating '"+dstName+"'. Could not save '" + dstPath + "'.");
    SetStatus(failed);
@@ -303,12 +355,17 @@ DirCalcJob::DirCalcJob(FormatterClass *formatter, const QString & sPath,  const
 	  dstDir.mkpath("./");
    }
 
+   // the names are read when the child jobs are created, not kept all at once
+   // (in directory order, not sorted); counted by a thread for the status
    filters << "*.jpg" << "*.jpeg" << "*.bmp" << "*.png" << "*.tif" << "*.tiff" << "*.gif" << "*.ppm";
-   srcDir.setNameFilters(filters);
-   srcDir.setSorting (QDir::Name | QDir::IgnoreCase);
-   entries = srcDir.entryList();
+   entryIter = new QDirIterator(srcPath, filters, QDir::Files);
+   entriesLeft = true;
+   numCreated  = 0;
+   numTotal    = -1;
+   counter = new DirCounter(srcPath, filters);
+   connect(counter, SIGNAL(Counted(int)), this, SLOT(SetCount(int)), Qt::QueuedConnection);
+   counter->start(QThread::LowPriority);
 
-   numTotal    = entries.size();
    maxActive   = 0;
    numActive   = 0;
    numFinished = 0;
@@ -319,23 +376,44 @@ DirCalcJob::DirCalcJob(FormatterClass *formatter, const QString & sPath,  const
 DirCalcJob::~DirCalcJob(void) {
    if(!Ended())
       emit EndReached();
+   counter->requestInterruption();
+   counter->wait();
+   delete counter;
+   delete entryIter;
    delete myFormatter;
 }
 
 void DirCalcJob::SetActivity(CalcJobActivity  act) {
+   // enough children to keep all cores busy, the queue decides which of them run
    if(act == null) {
       maxActive = 0;
    }
-   else if(act == middle) {
-      maxActive = 1;
-   }
-   else if(act == high) {
-      maxActive = 3;
+   else {
+	  maxActive = IsInQueue() ? Queue()->CoreBudget() : 1;
    }
    ManageJobs();       // if there are free active places: create new jobs
    CalcJob::SetActivity(act);
 }
 
+void DirCounter::run(void) {
+   QDirIterator it(path, filters, QDir::Files);
+   int n = 0;
+   while(it.hasNext() && !isInterruptionRequested()) {
+      it.next();
+      n++;
+   }
+   if(!isInterruptionRequested())
+      emit Counted(n);
+}
+
+// the count of the thread: only for the status, the child jobs come from entryIter
+void DirCalcJob::SetCount(int n) {
+   if(!entriesLeft)   // entryIter at its end: numTotal is exact already
+      return;
+   numTotal = n > numCreated ? n : numCreated;
+   emit StatusChanged(this);
+}
+
 QString DirCalcJob::StatusString(void) {
    QString statusTxt;
    if(Status() == notStarted)
@@ -343,7 +421,7 @@ QString DirCalcJob::StatusString(void) {
    else if(Status() == failed)
       statusTxt = " [ failed ] ";
    else if(Status() == success) {
-	  statusTxt = " [ " + QString::number(numFinished) + "/" + QString::number(numTotal) + " finished";
+	  statusTxt = " [ " + QString::number(numFinished) + "/" + TotalString() + " finished";
 	  if(numError == 0)
          statusTxt += " ] ";
 	  else if(numError == 1)
@@ -352,7 +430,7 @@ QString DirCalcJob::StatusString(void) {
 		 statusTxt += ", " + QString::number(numError) + " errors ] ";
    }
    else {
-	  statusTxt = " [ " + QString::number(numFinished) + "/" + QString::number(numTotal);
+	  statusTxt = " [ " + QString::number(numFinished) + "/" + TotalString();
 	  if(numError == 0)
          statusTxt += " ] ";
 	  else if(numError == 1)
@@ -369,7 +447,7 @@ QString DirCalcJob::DetailedStatusString(void) {
    else if(Status() == success)
       return "Job finished. ";
    else if(Status() == running)
-	  return "Job is running (" + QString::number(numFinished) + " / " + QString::number(numTotal) +"done). ";
+	  return "Job is running (" + QString::number(numFinished) + " / " + TotalString() +"done). ";
    else if(Status() != failed)
       return "Job in unkown condition. ";
 
@@ -410,10 +488,10 @@ void DirCalcJob::ManageJobs(void) {
    if(manageJobsRecursionBlock)
       return;
    manageJobsRecursionBlock = true;
-   if(numFinished >= numTotal) {
-	  if(entries.size() > 0) {
-         cout<<"DirCalcJob::ManageJobs: All finished, but entries left.\n"<<flush;
-      }
+   while(numActive < maxActive && entriesLeft) {
+      NewChildJob();
+   }
+   if(numFinished >= numCreated && AtEnd()) {
 	  if(!Ended()) {
 		 emit StatusMessage("<b>Finished Folder</b> '"+dstName+"'. Saved to '" + dstPath + "'.");
          emit EndReached();
@@ -423,25 +501,33 @@ void DirCalcJob::ManageJobs(void) {
       }
       return;
    }
-   while(numActive < maxActive && entries.size() > 0) {
-      NewChildJob();
-   }
    manageJobsRecursionBlock = false;
 }
 
+// all files have their child job: then numTotal is the exact count
+bool DirCalcJob::AtEnd(void) {
+   if(entriesLeft && !entryIter->hasNext()) {
+	  entriesLeft = false;
+	  numTotal = numCreated;
+	  emit StatusChanged(this);
+   }
+   return !entriesLeft;
+}
+
 void DirCalcJob::NewChildJob(void) {
-   if(numActive >= maxActive || entries.size() == 0)
+   if(numActive >= maxActive || AtEnd())
       return;
 
    QFileInfo fi;
    QString childName, childDstName;
-   childName = entries.takeFirst();
+   QString childPath = entryIter->next();
+   childName = entryIter->fileName();
 
    SingleCalcJob *newJob;
    newJob = new SingleCalcJob(myFormatter);
 
    newJob->srcName = childName;
-   newJob->srcPath = srcDir.absoluteFilePath(childName);
+   newJob->srcPath = childPath;
    fi.setFile(childName);
    if(fi.suffix().compare("gif", Qt::CaseInsensitive) == 0)
       childDstName = fi.completeBaseName() + "_e.png";
@@ -461,6 +547,7 @@ void DirCalcJob::NewChildJob(void) {
    connect(newJob, SIGNAL(EndReached())         ,   this, SLOT(ChildJobEnded()));
    Queue()->AddJob(newJob);
    numActive++;
+   numCreated++;
 
    if(Status() == notStarted) {
 	  SetStatus(running);
@@ -472,9 +559,25 @@ void DirCalcJob::NewChildJob(void) {
 
 //------------------------------------------------------------------------
 
+// size of the RAM, 0 if it can't be found out
+static double PhysicalMemory(void) {
+   double bytes = 0.0;
+#if defined(_SC_PHYS_PAGES) && defined(_SC_PAGESIZE)
+   long pages = sysconf(_SC_PHYS_PAGES), pageSize = sysconf(_SC_PAGESIZE);
+   if(pages > 0 && pageSize > 0)
+	  bytes = double(pages)*double(pageSize);
+#endif
+   return bytes;
+}
+
 CalcQueue::CalcQueue(void) {
    finishedCount = 0;
    unfinishedCount = 0;
+   totalCount = 0;
+   updatePending = progressChanged = false;
+   admitFrom = 0;
+   SetCoreBudget(0);
+   SetMemoryBudget(0.0);
    UpdateProgress();
    updateTimer = new QTimer(this);
    connect(updateTimer, SIGNAL(timeout()), this, SLOT(slot_TimerUpdate()));
@@ -494,54 +597,109 @@ void CalcQueue::AddJob(CalcJob *newJob) {
    jobList.append(newJob);
    newJob->SetQueue(this);
    newJob->SetPosition(jobList.size() - 1);
+   dstPaths[newJob->DstPath()]++;
    queueDisplayModel.insertRow( jobList.size() - 1,  QModelIndex() );
    connect(newJob, SIGNAL(StatusChanged(CalcJob*)), this, SLOT(slot_JobStatusChanged(CalcJob*)));
+   Recount(newJob);
    UpdateQueue();
-   UpdateProgress();
    newJob->Update();
 }
 
 bool CalcQueue::IsInQueue(const QString & dstPath) {
-   for(int a=0; a<jobList.size(); a++) {
-	  if(jobList.at(a)->DstPath() == dstPath)
-         return true;
-   }
+   return dstPaths.contains(dstPath);
+}
 
-   return false;
+
+void CalcQueue::SetCoreBudget(int n) {
+   if(n < 1)
+	  n = QThread::idealThreadCount();
+   coreBudget = n < 1 ? 1 : n;
+   QThreadPool::globalInstance()->setMaxThreadCount(coreBudget);
+   UpdateQueue();
 }
 
+void CalcQueue::SetMemoryBudget(double bytes) {
+   if(bytes <= 0.0)
+	  bytes = 0.75*PhysicalMemory();
+   memoryBudget = bytes > 0.0 ? bytes : defaultMemoryBudget;
+   UpdateQueue();
+}
 
-// queue changed: update job positions&activity, rebuild the queueDisplayModel
+// queue changed: update activities & progress.
+// Deferred until the events are processed: adding or ending many jobs at once
+// (a dropped folder, the children of a dir-job) costs one pass over the queue, not one per job
 void CalcQueue::UpdateQueue(void) {
-   QStringList namesInQueue;
-
-   int priorityCounter = NumCalcJobs - 1;
-   for(int a=0; a<jobList.size(); a++) {
-	  CalcJob *currentJob = jobList.at(a);
-	  if(currentJob!=0) {
-		 currentJob->SetPosition(a);
-		 if(!currentJob->Ended()) {
-			if(priorityCounter == NumCalcJobs - 1)
-			   currentJob->SetActivity(high);
-			else if(priorityCounter == NumCalcJobs - 2)
-			   currentJob->SetActivity(middle);
-			else if(priorityCounter >= 0 )
-			   currentJob->SetActivity(low);
-            else
-			   currentJob->SetActivity(null);
-            priorityCounter -= currentJob->ThreadsUsed();  // for each running job decrease priority
+   if(updatePending)
+      return;
+   updatePending = true;
+   QTimer::singleShot(0, this, SLOT(slot_Update()));
+}
+
+void CalcQueue::slot_Update(void) {
+   updatePending = false;
+   AdmitJobs();         // starting jobs (or failing to) may request the next update
+   UpdateProgress();
+}
+
+// The blocks of all running jobs are tasks of the one shared pool of coreBudget threads
+// (see BlockWorkSource), the tasks of the jobs in front first: running more jobs only fills the
+// cores the first ones leave idle (few blocks, load & save), it doesn't slow them down.
+// So a job is started when it fits into what the running jobs leave of the memory budget,
+// with at most coreBudget jobs running. In queue order: the first job not fitting waits,
+// and all behind it, so a big job isn't overtaken forever. If nothing runs, the first job
+// is started even if it's too big (the estimate is rough, it may fit anyway).
+// Dir-jobs need nothing themselves, their children are queued behind.
+// The running jobs get decreasing priorities in queue order.
+// A pass doesn't look at the whole queue: the started jobs are kept in runningJobs (in queue order,
+// as they are started in order) and all jobs before admitFrom are started or ended.
+void CalcQueue::AdmitJobs(void) {
+   double bytesFree = memoryBudget;
+   int numRunning   = 0;
+
+   for(int a=runningJobs.size()-1; a>=0; a--) {
+	  CalcJob *job = runningJobs.at(a);
+	  if(job->Ended()) {
+		 runningJobs.removeAt(a);
+         continue;
+      }
+	  bytesFree -= job->PeakBytes();
+	  if(job->ThreadsUsed() > 0)
+		 numRunning++;
+   }
+
+   while(admitFrom < jobList.size()) {
+	  CalcJob *job = jobList.at(admitFrom);
+	  if(job!=0 && !job->Ended() && job->Activity() == null) {
+		 if(job->ThreadsUsed() > 0) {
+			double bytes = job->PeakBytes();
+			if(numRunning > 0 && (numRunning >= coreBudget || bytes > bytesFree))
+			   break;     // waits, and all behind it
+			bytesFree -= bytes;
+			numRunning++;
          }
+		 runningJobs.append(job);
       }
+	  admitFrom++;
+   }
+
+   for(int rank=0; rank<runningJobs.size(); rank++) {
+	  CalcJob *job = runningJobs.at(rank);
+	  if(rank == 0)
+		 job->SetActivity(high);
+	  else if(rank == 1)
+		 job->SetActivity(middle);
+      else
+		 job->SetActivity(low);
    }
+}
 
-   //for(int a=0; a<jobList.size(); a++) {
-   //   namesInQueue.append(jobList[ a ]->Name() + jobList[ a ]->StatusString());
-   //}
-   //queueDisplayModel.setJobList(namesInQueue);
-   //for(int a=0; a<jobList.size(); a++) {
-   //    PrintJob(jobList.at(a));
-   //}
-   PrintAll();
+// the counts of the job in totalCount & unfinishedCount: kept up to date, not summed up
+void CalcQueue::Recount(CalcJob *job) {
+   JobCounts & counts = jobCounts[job];
+   totalCount      += job->Total()      - counts.total;
+   unfinishedCount += job->Unfinished() - counts.unfinished;
+   counts.total      = job->Total();
+   counts.unfinished = job->Unfinished();
 }
 
 // calculate and emit the current progress
@@ -549,18 +707,12 @@ void CalcQueue::UpdateQueue(void) {
 // if reset==true: forget all finished jobs
 void CalcQueue::UpdateProgress(void) {
    float unfinProgress = 0.0;
-   int totalCount;
 
-   totalCount = 0;
-   unfinishedCount = 0;
-   for(int a=0; a<jobList.size(); a++) {
-	  CalcJob *currentJob = jobList.at(a);
-	  if(currentJob!=0) {
-         totalCount      += currentJob->Total();
-         unfinishedCount += currentJob->Unfinished();
-		 if(!currentJob->Ended()) {
-			unfinProgress += float(currentJob->Progress());
-         }
+   // only started jobs have progress
+   for(int a=0; a<runningJobs.size(); a++) {
+	  CalcJob *currentJob = runningJobs.at(a);
+	  if(!currentJob->Ended()) {
+		 unfinProgress += float(currentJob->Progress());
       }
    }
    // finished count contains all finished since last reset
@@ -573,6 +725,7 @@ void CalcQueue::UpdateProgress(void) {
       progress = 1.0;
    }
 
+   progressChanged = false;
    emit tellProgress(int(progress*100.0));
    emit tellJobCount(totalCount - unfinishedCount, totalCount);
 
@@ -590,28 +743,70 @@ void CalcQueue::PrintJob(CalcJob *job) {
    queueDisplayModel.setData(jobIdx, job->Name() + job->StatusString(), Qt::EditRole);
 }
 
-void CalcQueue::PrintAll(void) {
-   for(int a=0; a<jobList.size(); a++) {
-      CalcJob *job = jobList.at(a);
-	  QModelIndex jobIdx = queueDisplayModel.index(a, 0);
-	  if(jobIdx.isValid() && job!=0) {
-		 //queueDisplayModel.setData(jobIdx, job->Name() + job->StatusString(), Qt::DisplayRole);
-		 queueDisplayModel.setData(jobIdx, job->Name() + job->StatusString(), Qt::EditRole);
-      }
-   }
-}
-
-
-
+// the rows of the queueDisplayModel are set here only: when their job changes
 void CalcQueue::slot_JobStatusChanged(CalcJob *job) {
    PrintJob(job);
+   Recount(job);
    if(job->Ended()) {
       finishedCount++;
+	  if(job->RemoveAtEnd() && !endedToRemove.contains(job))
+		 endedToRemove.append(job);
    }
    if(job->Status() != running) {
       UpdateQueue();  // set new activities
    }
-   UpdateProgress();
+   else {
+	  progressChanged = true;
+   }
+}
+
+void CalcQueue::slot_TimerUpdate(void) {
+   SearchRemoveAtEnd();
+   if(progressChanged)
+	  UpdateProgress();
+}
+
+// positions of the jobs from 'from' on, after removing
+void CalcQueue::Renumber(int from) {
+   for(int a=from; a<jobList.size(); a++) {
+	  if(jobList.at(a) != 0)
+		 jobList.at(a)->SetPosition(a);
+   }
+}
+
+// The jobs are deleted last: a running child ends, so its dir-job may add the next child.
+void CalcQueue::TakeJobs(int pos, int count) {
+   QList < CalcJob* > taken = jobList.mid(pos, count);
+   jobList.erase(jobList.begin() + pos, jobList.begin() + pos + count);
+   queueDisplayModel.removeRows(pos, count, QModelIndex());
+   for(int a=0; a<taken.size(); a++) {
+	  CalcJob *job = taken.at(a);
+	  if(job == 0)
+         continue;
+	  int n = dstPaths.value(job->DstPath()) - 1;
+	  if(n > 0)
+		 dstPaths[job->DstPath()] = n;
+      else
+		 dstPaths.remove(job->DstPath());
+	  if(job->RemoveAtEnd())
+		 endedToRemove.removeOne(job);
+	  runningJobs.removeOne(job);
+	  JobCounts counts = jobCounts.value(job);
+	  totalCount      -= counts.total;
+	  unfinishedCount -= counts.unfinished;
+	  jobCounts.remove(job);
+   }
+   if(admitFrom >= pos + count)
+	  admitFrom -= count;
+   else if(admitFrom > pos)
+	  admitFrom = pos;
+   Renumber(pos);
+   UpdateQueue();
+
+   for(int a=0; a<taken.size(); a++) {
+	  if(taken.at(a) != 0)
+		 delete taken.at(a);
+   }
 }
 
 void CalcQueue::RemoveJob(CalcJob *job) {
@@ -624,16 +819,11 @@ void CalcQueue::RemoveJob(CalcJob *job) {
       cout<<"CalcQueue: RemoveJob: job with invalid position.\n"<<flush;
       return;
    }
-   queueDisplayModel.removeRow(jobPos, QModelIndex());
-
-   CalcJob *job1 = jobList.takeAt(jobPos);
-   if(job1 != job) {
+   if(jobList.at(jobPos) != job) {
       cout<<"CalcQueue: RemoveJob: Inconsistence in list.\n"<<flush;
+      return;
    }
-
-   UpdateQueue();
-   UpdateProgress();
-   delete job;
+   TakeJobs(jobPos, 1);
 }
 
 void CalcQueue::RemoveJob(QModelIndex jobIdx) {
@@ -644,47 +834,36 @@ void CalcQueue::RemoveJob(QModelIndex jobIdx) {
       cout<<"CalcQueue: RemoveJob 2: job with invalid position.\n"<<flush;
       return;
    }
-   queueDisplayModel.removeRow(jobPos, QModelIndex() );
-   CalcJob *job = jobList.takeAt(jobPos);
-   UpdateQueue();
-   UpdateProgress();
-   if(job != 0) {
-      delete job;
-   }
+   TakeJobs(jobPos, 1);
 }
 
 void CalcQueue::Clear(void) {
    while(jobList.size() > 0) {
-	  RemoveJob(jobList.last());
+	  TakeJobs(0, jobList.size());
    }
 }
 
+// the ended jobs are removed in runs of neighbours: one move of the list per run
 void CalcQueue::RemoveEnded(void) {
-   for(int a=jobList.size() - 1; a>=0; a--) {
-	  if(jobList.at(a)->Ended()) {
-		 CalcJob *job = jobList.takeAt(a);
-		 queueDisplayModel.removeRow(a);
-		 if(job != 0) {
-            delete job;
-         }
+   int a = jobList.size() - 1;
+   while(a >= 0) {
+	  if(jobList.at(a) == 0 || !jobList.at(a)->Ended()) {
+         a--;
+         continue;
       }
+      int end = a + 1;
+	  while(a > 0 && jobList.at(a-1) != 0 && jobList.at(a-1)->Ended())
+         a--;
+	  TakeJobs(a, end - a);
+      a--;
    }
-   UpdateQueue();
-   UpdateProgress();
 }
 
-// some jobs want to be removed when ended
+// some jobs (childs of dir-calc) want to be removed when ended:
+// they are collected in slot_JobStatusChanged, the queue isn't searched
 void CalcQueue::SearchRemoveAtEnd(void) {
-   bool found = false;
-   for(int a=jobList.size() - 1; a>=0; a--) {
-	  if(jobList.at(a)->Ended() && jobList.at(a)->RemoveAtEnd()) {
-         found = true;
-		 CalcJob *job = jobList.takeAt(a);
-		 queueDisplayModel.removeRow(a);
-		 if(job != 0) {
-            delete job;
-         }
-      }
+   while(endedToRemove.size() > 0) {
+	  CalcJob *job = endedToRemove.takeFirst();
+	  RemoveJob(job);
    }
-   UpdateQueue();
 }
@@ -26,22 +26,29 @@ along with this program; if not, see <http://www.gnu.org/licenses/>.
 #define CALCQUEUE_H
 
 #include <QObject>
+#include <QThread>
 #include <QStringList>
+#include <QHash>
 #include <QDir>
 #include <QAbstractListModel>
 #include "ImageEnlargerCode/ConstDefs.h"
 #include "ImageEnlargerCode/EnlargeParam.h"
 
-const int NumCalcJobs = 3;   // places in the queue with activity != null
+const double defaultMemoryBudget = 2.0*1024.0*1024.0*1024.0;   // if the physical memory is unknown
 
 class QImage;
 class QTimer;
+class QDirIterator;
 class EnlargerThread;
 class CalcQueue;
 class FormatterClass;
 
 enum CalcJobStatus   { notStarted, running, failed, success };
 enum CalcJobActivity { null, low, middle, high };
+
+// priority of the block-tasks in the shared pool (see BlockWorkSource):
+// the jobs' activity, the preview above all
+const int previewPoolPriority = high + 1;
 enum CalcJobError    { none, allocFailed, srcNotFound, srcOpenFailed, dstSaveFailed };
 
 class JobListModel : public QAbstractListModel {
@@ -70,7 +77,7 @@ private:
    int posInQueue;
    bool removeAtEnd;            // for child jobs of dir-calc
 public:
-   CalcJob(void) : status(notStarted), activity(null), error(none), posInQueue(-1), removeAtEnd(false) { }
+   CalcJob(void) : status(notStarted), activity(null), error(none), myQueue(0), posInQueue(-1), removeAtEnd(false) { }
    virtual void SetActivity(CalcJobActivity act) { activity = act; }
    virtual QString StatusString(void) { return ""; }
    virtual QString DetailedStatusString(void) { return ""; }
@@ -84,7 +91,9 @@ public:
    virtual int Unfinished(void) { return 1; }
    virtual int Total(void)      { return 1; }
    virtual float   Progress(void) { return 0.0; }
+   // block-workers & memory the job takes when running (estimated before the start, see CalcQueue)
    virtual int ThreadsUsed(void)  { return 1; }
+   virtual double PeakBytes(void) { return 0.0; }
 
    CalcJobStatus Status(void) { return status; }
    CalcJobError  Error (void) { return error; }
@@ -133,6 +142,9 @@ private:
                        // if srcImg==0, srcPath is used
    int progress;
    EnlargerThread *myThread;
+   bool   estimated;
+   int    workers;       // block-workers of the enlargement
+   double peakBytes;
 
 public:
    SingleCalcJob(FormatterClass *formatter);
@@ -148,7 +160,8 @@ public:
 
    int Unfinished(void) { if(!Ended()) return 1; return 0; }
    int Total(void)      { if(Ended() && RemoveAtEnd()) return 0; return 1; }
-   int ThreadsUsed(void)  { return 1; }
+   int ThreadsUsed(void)  { Estimate(); return workers; }
+   double PeakBytes(void) { Estimate(); return peakBytes; }
    float   Progress(void) { return float(progress)*0.01; }
 
 signals:
@@ -158,12 +171,29 @@ private slots:
    void slot_getProgress(int p) { progress = p; emit StatusChanged(this); }
    void slot_badAlloc(void);
    void slot_imageNotSaved(void);
+   void slot_sourceNotOpened(void);
    void slot_imageSaved(int w, int h);
 
 private:
-   void StartEnlarge(void); // create thread, give parameters, start enlarging
+   void StartEnlarge(CalcJobActivity act); // create thread, give parameters, start enlarging
    void EndEnlarge(void); //   delete thread
    void CalculateFormat(const QImage & srcImg, EnlargeFormat & format);
+   void Estimate(void);   // workers & peakBytes from the size of the src (not decoded)
+};
+
+// counts the src files of a DirCalcJob in the background, the GUI doesn't wait for the disk
+class DirCounter : public QThread {
+   Q_OBJECT
+
+   QString path;
+   QStringList filters;
+
+public:
+   DirCounter(const QString & p, const QStringList & f) : path(p), filters(f) {}
+   void run(void);
+
+signals:
+   void Counted(int n);
 };
 
 class DirCalcJob : public CalcJob {
@@ -183,10 +213,14 @@ private:
    QString dstName;
 
    QDir srcDir, dstDir;
-   QStringList entries;
+   QDirIterator *entryIter;  // the src files, read one by one when the child jobs are created
+   DirCounter *counter;
+   bool entriesLeft;         // entryIter not at its end yet
    int maxActive;            // maximum of child jobs (depends on activity)
    int numActive;
-   int numTotal, numFinished, numError;
+   int numCreated;           // child jobs
+   int numTotal;             // -1 until counted, exact when entryIter is at its end
+   int numFinished, numError;
    bool manageJobsRecursionBlock;
 
 public:
@@ -199,8 +233,8 @@ public:
    QString DstPath(void)  { return dstPath; }
    QString Name(void)     { return dstName; }
    float   Progress(void) { return 0.0; }   // no progress in this job, active jobs are put out into queue
-   int Unfinished(void)   { return entries.size(); }
-   int Total(void)        { return entries.size() + numFinished; }
+   int Unfinished(void)   { return numTotal > numCreated ? numTotal - numCreated : 0; }  // src files without child job yet
+   int Total(void)        { return Unfinished() + numFinished; }
    int ThreadsUsed(void)  { return 0; }     // no calculations within this job, calcjobs external
 
 signals:
@@ -210,21 +244,39 @@ private slots:
    void GetChildStatusMessage(const QString & message) { emit StatusMessage("   " + message); }
    void GetChildErrorMessage(const QString & message)  { emit ErrorMessage ("   " + message); numError++; }
    void ChildJobEnded(void);
+   void SetCount(int n);
 
 private:
+   QString TotalString(void) { return numTotal < 0 ? QString("?") : QString::number(numTotal); }
    void ManageJobs(void);  // push new jobs if possible, check if end reached
+   bool AtEnd(void);       // no src file left for a child job
    void NewChildJob(void); // create child job from an entry, put it into the queue
 };
 
+// the counts of a job, as summed up in the queue (see CalcQueue::Recount)
+struct JobCounts {
+   int total, unfinished;
+   JobCounts(void) : total(0), unfinished(0) {}
+};
 
 class CalcQueue  : public QObject {
    Q_OBJECT
 private:
    QList < CalcJob* > jobList;
+   QHash < QString, int > dstPaths;        // dst-paths of the jobs (with count), for IsInQueue
+   QList < CalcJob* > endedToRemove;       // ended jobs wanting removal (see SearchRemoveAtEnd)
+   QList < CalcJob* > runningJobs;         // started, not yet ended, in queue order (see AdmitJobs)
+   int admitFrom;                          // the jobs before are started or ended
    JobListModel queueDisplayModel;         // used for displaying the queue in a ListView
    int finishedCount;                      // all jobs finished since last progress reset
    int unfinishedCount;                    // all jobs unfinished at the moment
+   int totalCount;
+   QHash < CalcJob*, JobCounts > jobCounts;  // what each job adds to the counts
    QTimer *updateTimer;                    // for  clean-up and printing
+   int coreBudget;                         // threads of the shared pool, max. running jobs
+   double memoryBudget;                    // the running jobs' estimated peak memory fits in
+   bool updatePending;                     // UpdateQueue: the update is waiting for the event loop
+   bool progressChanged;                   // running jobs progressed: put out by the timer
 
 public:
    CalcQueue(void);
@@ -237,6 +289,11 @@ public:
    void RemoveEnded(void);
    void RemoveJob(QModelIndex jobIdx);
    void ResetProgress(void) { finishedCount = 0; }
+   // n < 1: all cores (sets the global QThreadPool);  bytes <= 0: 3/4 of the physical memory
+   void SetCoreBudget(int n);
+   void SetMemoryBudget(double bytes);
+   int    CoreBudget(void)   { return coreBudget; }
+   double MemoryBudget(void) { return memoryBudget; }
 
 signals:
    void tellProgress(int p);
@@ -244,14 +301,18 @@ signals:
 
 private slots:
    void slot_JobStatusChanged(CalcJob *job);
-   void slot_TimerUpdate(void) { SearchRemoveAtEnd(); PrintAll(); }
+   void slot_TimerUpdate(void);
+   void slot_Update(void);
 
 private:
    void RemoveJob(CalcJob *job);
-   void UpdateQueue(void);    // queue changed: update job positions&activity, rebuild the queueDisplayModel
+   void TakeJobs(int pos, int count);  // remove jobs pos..pos+count-1 from the queue & delete them
+   void Renumber(int from);
+   void UpdateQueue(void);    // queue changed: update activities & progress (deferred, see slot_Update)
+   void AdmitJobs(void);      // activities: start the jobs in order, as long as they fit into the budgets
+   void Recount(CalcJob *job);
    void UpdateProgress(void);
    void PrintJob(CalcJob *job);
-   void PrintAll(void);
    void SearchRemoveAtEnd(void);  // some jobs (childs of dir-calc) want to be removed at end
 };
 
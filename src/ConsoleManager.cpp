@@ -26,8 +26,10 @@ along with this program; if not, see <http://www.gnu.org/licenses/>.
 #include <QString>
 #include <QObject>
 #include <QFile>
+#include <QDir>
+#include <QFileInfo>
 #include <QImage>
-#include <QApplication>
+#include <QCoreApplication>
 #include <iostream>
 
 #include "ConsoleManager.h"
@@ -35,13 +37,30 @@ along with this program; if not, see <http://www.gnu.org/licenses/>.
 #include "EnlargerDialog.h"
 #include "EnlargerThread.h"
 #include "formatterclass.h"
+#include "ImageEnlargerCode/BlockGeometry.h"
+#include "BandWriter.h"
+#include "ImageSource.h"
 
 using namespace std;
 
-ConsoleManager::ConsoleManager(int argc, char *argv[]) : QObject() {
+// the suffixes of the images TryOpenSource accepts
+static QStringList SourceTypes(void) {
+   QStringList typeList;
+   typeList << "jpg" << "jpeg" << "bmp" << "png" << "tif" << "tiff" << "ppm" << "pam" << "raw" << "gif";
+   return typeList;
+}
+
+ConsoleManager::ConsoleManager(int argc, char *argv[], bool quietParse) : QObject() {
+   quiet = quietParse;
+   nextSrc    = 0;
+   numRunning = 0;
+   numFailed  = 0;
+   myParser.SetQuiet(quiet);
    oZoom.Set    (&myParser, "-z", "-zoom"); oZoom.SetRange (1, 100000);   oZoom.SetDefault(200);
    oWidth.Set   (&myParser, "-width"     ); oWidth.SetRange(1, 1000000);
    oHeight.Set  (&myParser, "-height"    ); oHeight.SetRange(1, 1000000);
+   oRawWidth.Set (&myParser, "-rawwidth" ); oRawWidth.SetRange(1, 1000000);
+   oRawHeight.Set(&myParser, "-rawheight"); oRawHeight.SetRange(1, 1000000);
 
    oSharp.Set   (&myParser, "-sharp"     ); oSharp.SetRange(0, 100);      oSharp.SetDefault   (80);
    oFlat.Set    (&myParser, "-flat"      ); oFlat.SetRange(0, 100);       oFlat.SetDefault    (20);
@@ -51,6 +70,7 @@ ConsoleManager::ConsoleManager(int argc, char *argv[]) : QObject() {
    oFNoise.Set  (&myParser, "-fNoise"    ); oFNoise.SetRange(0, 100);     oFNoise.SetDefault  ( 0);
 
    oQuality.Set (&myParser, "-quality"   ); oQuality.SetRange(0, 100);    oQuality.SetDefault  (90);
+   oJobs.Set    (&myParser, "-j"         ); oJobs.SetRange(1, 64);        oJobs.SetDefault     ( 1);
    oOutput.Set  (&myParser, "-o");
    oOutputFolder.Set  (&myParser, "-saveto");
 
@@ -60,20 +80,38 @@ ConsoleManager::ConsoleManager(int argc, char *argv[]) : QObject() {
    oFormatFit. Set(&myParser, "-fit");
    oFormatCrop.Set(&myParser, "-coverandcrop");
    oFormatBars.Set(&myParser, "-fitandbars");
+   oAutotune.Set(&myParser, "-autotune");
+   oStream.Set(&myParser, "-stream");
    parseError = false;
    if(!myParser.Parse(argc, argv)) {
-      cout<<"Error parsing command line arguments. \n"<<flush;
-      PrintHelp();
       parseError = true;
+      if(!quiet) {
+         cout<<"Error parsing command line arguments. \n"<<flush;
+         PrintHelp();
+      }
       return;
    }
-   if(oHelp.IsThere())
+   if(oHelp.IsThere() && !quiet)
       PrintHelp();
 
    // informations are now saved in option objects and argumentParser (otherArguments)
    // can be used in SetupEnlargerDialog, RunConsoleEnlarge
 }
 
+ConsoleManager::~ConsoleManager(void) {
+   for(int i=0; i<jobs.size(); i++) {
+      delete jobs[i].thread;   // aborts & waits
+      delete jobs[i].out;
+   }
+}
+
+// Unknown options might be Qt's (-style, -platform ..., removed by QApplication):
+// then the GUI-path decides again
+bool ConsoleManager::ConsoleMode(int argc, char *argv[]) {
+   ConsoleManager probe(argc, argv, true);
+   return !probe.parseError && !probe.UseGUI();
+}
+
 // decide if GUI or Console mode is used
 bool ConsoleManager::UseGUI(void) {
    if(parseError) {
@@ -86,7 +124,8 @@ bool ConsoleManager::UseGUI(void) {
       return true;
    }
    else if(!oZoom.IsThere() && !oWidth.IsThere() && !oHeight.IsThere()) { // no output dimensions
-      cout<<"No output dimensions given. Starting in interactive mode.\n"<<flush;
+      if(!quiet)
+         cout<<"No output dimensions given. Starting in interactive mode.\n"<<flush;
       return true;
    }
    else if(myParser.OptionsFound()) {               // options & file -> Console mode
@@ -116,30 +155,100 @@ void ConsoleManager::SetupEnlargerDialog (EnlargerDialog & theDialog) {
    theDialog.DoPreview();
 }
 
-bool ConsoleManager::StartConsoleEnlarge  (EnlargerThread & myThread) {
+bool ConsoleManager::StartConsoleEnlarge  (void) {
 	if(parseError) {
        cout<<"Parse error, aborting.\n"<<flush;
        return false;
     }
-	if(myParser.NonOptionArguments().isEmpty()) {
-       cout<<"No filename given, aborting.\n"<<flush;
+	if(!CollectSources())
+       return false;
+	if(oOutput.IsThere() && srcFiles.size() > 1) {
+       cout<<"-o needs a single source, use -saveto for several. Aborting.\n"<<flush;
+       srcFiles.clear();
        return false;
     }
+	if(oOutputFolder.IsThere() && !QDir(oOutputFolder.Value()).exists()) {
+       QDir().mkpath(oOutputFolder.Value());
+    }
+
+    SetStreamOutput(oStream.IsThere());
+    SetBlockAutotune(oAutotune.IsThere());
 
-    QImage srcImage;
-	if(!TryOpenSource(myParser.NonOptionArguments().at(0), srcImage)) {
+    jobs.resize(srcFiles.size());
+    FillJobs();
+	if(numRunning == 0) {     // all sources failed to open
+       PrintSummary();
+       return false;
+    }
+    return true;
+}
+
+int ConsoleManager::ExitCode(void) {
+   if(parseError || srcFiles.isEmpty() || numFailed > 0)
+      return 1;
+   return 0;
+}
+
+// the non-option arguments: files, and dirs with their images (not recursive)
+bool ConsoleManager::CollectSources(void) {
+   QStringList filters, types = SourceTypes();
+   for(int i=0; i<types.size(); i++)
+      filters << "*." + types.at(i);
+
+   srcFiles.clear();
+   const QStringList & args = myParser.NonOptionArguments();
+   for(int a=0; a<args.size(); a++) {
+      const QString & arg = args.at(a);
+      QFileInfo fi(arg);
+	  if(!fi.isDir()) {
+         srcFiles << arg;
+         continue;
+      }
+      QDir srcDir(arg);
+      srcDir.setNameFilters(filters);
+      QStringList entries = srcDir.entryList(QDir::Files, QDir::Name | QDir::IgnoreCase);
+	  if(entries.isEmpty())
+         cout<<"No images found in folder '" + arg.toStdString() + "'.\n"<<flush;
+      for(int i=0; i<entries.size(); i++)
+         srcFiles << srcDir.absoluteFilePath(entries.at(i));
+   }
+	if(srcFiles.isEmpty()) {
+       cout<<"No filename given, aborting.\n"<<flush;
        return false;
+    }
+   return true;
+}
+
+// start jobs until -j are running or no sources are left
+void ConsoleManager::FillJobs(void) {
+   while(numRunning < oJobs.Value() && nextSrc < srcFiles.size())
+      StartJob(nextSrc++);
+}
+
+void ConsoleManager::StartJob(int srcIdx) {
+    QString srcName = srcFiles.at(srcIdx);
+    int srcW, srcH;
+	if(!TryOpenSource(srcName, srcW, srcH)) {
+       numFailed++;
+       return;
     }
 	if(oOutput.IsThere()) {
        dstName = oOutput.Value();
     }
-	myEnOut.SetName(dstName);
+    usedDstPaths.insert(QFileInfo(dstName).absoluteFilePath());   // -o may be relative
+
+    ConsoleJob & job = jobs[srcIdx];
+    job.out    = new EnlargerOut;
+    job.thread = new EnlargerThread(0, srcIdx);
+	job.out->SetName(dstName);
+	job.out->SetLineMode(oJobs.Value() > 1 && srcFiles.size() > 1);
 
-	connect(&myThread, SIGNAL(enlargeEnd(int)),   qApp,     SLOT(quit()));
-	connect(&myThread, SIGNAL(imageNotSaved()),   &myEnOut, SLOT(imageNotSaved()));
-	connect(&myThread, SIGNAL(imageSaved(int,int)),      &myEnOut, SLOT(imageSaved(int,int)));
-	connect(&myThread, SIGNAL(tellProgress(int)), &myEnOut, SLOT(PrintProgress(int)));
-	connect(&myThread, SIGNAL(badAlloc()),        &myEnOut, SLOT(badAlloc()));
+	connect(job.thread, SIGNAL(enlargeEnd(int)),   this,    SLOT(JobEnded(int)));
+	connect(job.thread, SIGNAL(imageNotSaved()),   job.out, SLOT(imageNotSaved()));
+	connect(job.thread, SIGNAL(sourceNotOpened()), job.out, SLOT(sourceNotOpened()));
+	connect(job.thread, SIGNAL(imageSaved(int,int)),      job.out, SLOT(imageSaved(int,int)));
+	connect(job.thread, SIGNAL(tellProgress(int)), job.out, SLOT(PrintProgress(int)));
+	connect(job.thread, SIGNAL(badAlloc()),        job.out, SLOT(badAlloc()));
 
     EnlargeFormat format;
     EnlargeParamInt param;
@@ -151,15 +260,54 @@ bool ConsoleManager::StartConsoleEnlarge  (EnlargerThread & myThread) {
     param.preSharp =   oPreSharp.Value();
     param.fractNoise = oFNoise.Value();
 
-    format.srcWidth  = srcImage.width();
-    format.srcHeight = srcImage.height();
+    CalculateFormat(srcW, srcH, format);
+
+    job.running = true;
+    numRunning++;
+    job.out->StartMessage();
+	// decoded in the thread: the next sources are read while the others enlarge
+	job.thread->EnlargeFileAndSave(srcName, format, param.FloatParam(), dstName, oQuality.Value(),
+								   oRawWidth.Value(), oRawHeight.Value());
+}
+
+// the thread of source srcIdx has ended: start the next source, quit after the last
+void ConsoleManager::JobEnded(int srcIdx) {
+   if(srcIdx < 0 || srcIdx >= jobs.size() || !jobs[srcIdx].running)
+      return;
+   ConsoleJob & job = jobs[srcIdx];
+   job.running = false;
+   numRunning--;
+   if(!job.out->Saved())
+      numFailed++;
+   job.thread->deleteLater();
+   job.thread = 0;
+
+   FillJobs();
+   if(numRunning == 0) {
+      PrintSummary();
+      QCoreApplication::exit(ExitCode());
+   }
+}
+
+void ConsoleManager::PrintSummary(void) {
+   if(srcFiles.size() < 2)
+      return;
+   cout<<"\n"<<srcFiles.size()-numFailed<<" of "<<srcFiles.size()<<" images enlarged";
+   if(numFailed > 0)
+      cout<<", "<<numFailed<<" failed";
+   cout<<".\n"<<flush;
+}
+
+void ConsoleManager::CalculateFormat(int srcW, int srcH, EnlargeFormat & format) {
+    format.srcWidth  = srcW;
+    format.srcHeight = srcH;
 
 	if(oZoom.IsThere()) {
 	   format.SetScaleFact(float(oZoom.Value())*0.01);
     }
 
-	float sx =  float(oWidth.Value() ) / float(srcImage.width());
-	float sy =  float(oHeight.Value()) / float(srcImage.height());
+	float sx =  float(oWidth.Value() ) / float(srcW);
+	float sy =  float(oHeight.Value()) / float(srcH);
 	if(oWidth.IsThere() && !oHeight.IsThere()) {
 	   format.SetScaleFact(sx);
     }
@@ -181,24 +329,22 @@ bool ConsoleManager::StartConsoleEnlarge  (EnlargerThread & myThread) {
        }
 	   else if(oFormatCrop.IsThere()) {
 		  CropFormatter myFormatter(oWidth.Value(), oHeight.Value());
-		  myFormatter.CalculateFormat(srcImage.width(), srcImage.height(), format);
+		  myFormatter.CalculateFormat(srcW, srcH, format);
        }
 	   else if(oFormatBars.IsThere()) {
 		  MaxBoundBarFormatter myFormatter(oWidth.Value(), oHeight.Value());
-		  myFormatter.CalculateFormat(srcImage.width(), srcImage.height(), format);
+		  myFormatter.CalculateFormat(srcW, srcH, format);
        }
        else {
 		  format.SetScaleFact(sx, sy);
        }
     }
-
-    myEnOut.StartMessage();
-	myThread.EnlargeAndSave(srcImage, format, param.FloatParam(), dstName, oQuality.Value());
-    return true;
 }
 
 
-bool ConsoleManager::TryOpenSource(QString fileName, QImage & srcImage) {
+// checks the source & reads its size (without decoding), sets dstName.
+// fileName becomes the absolute path of the image (the target of a symLink)
+bool ConsoleManager::TryOpenSource(QString & fileName, int & srcW, int & srcH) {
    QString dstDirPath,body,type,typeL;
    QString symLinkTarget, symLinkPath;
    bool isSymLink = false;
@@ -228,21 +374,17 @@ bool ConsoleManager::TryOpenSource(QString fileName, QImage & srcImage) {
    else {
       dstDirPath = fi.absolutePath();
    }
-   QStringList typeList;
-   typeList << "jpg" << "jpeg" << "bmp" << "png" << "tif" << "tiff" << "ppm" << "gif";
-   if(!typeList.contains(type, Qt::CaseInsensitive)) {
+   if(!SourceTypes().contains(type, Qt::CaseInsensitive)) {
       cout<<"Source file '" + fileName.toStdString() + "' of unsupported type < " + type.toStdString() + " >.\n"<<flush;
       return false;
    }
 
-   if(!srcImage.load(fileName)) {
+   // only the header, if possible: the image is decoded by the thread
+   bool hasAlpha;
+   if(!ImageSource::ReadSize(fileName, srcW, srcH, hasAlpha, oRawWidth.Value(), oRawHeight.Value())) {
       cout<<"Could not open image '" + fileName.toStdString() + "'.\n"<<flush;
       return false;
    }
-   if(srcImage.hasAlphaChannel())
-	  srcImage = srcImage.convertToFormat(QImage::Format_ARGB32);
-   else
-	  srcImage = srcImage.convertToFormat(QImage::Format_RGB32);
 
    if(type.toLower() == QString("gif"))
       type = QString("png");
@@ -261,7 +403,7 @@ void ConsoleManager::IncDestName(QString & dstName ,  const QString & dstDirPath
    QDir dDir(dstDirPath);
 
    dstPath = dDir.absoluteFilePath(dstName);
-   if(!dDir.exists(dstName))
+   if(!dDir.exists(dstName) && !usedDstPaths.contains(dstPath))
        return;
 
    QFileInfo fi(dstName);
@@ -289,7 +431,7 @@ void ConsoleManager::IncDestName(QString & dstName ,  const QString & dstDirPath
    while(num < 1000) {
       dstName = body + QString::number(num) + type;
 	  dstPath = dDir.absoluteFilePath(dstName);
-	  if( !dDir.exists(dstName))
+	  if( !dDir.exists(dstName) && !usedDstPaths.contains(dstPath))
           break;
       num++;
    }
@@ -298,7 +440,8 @@ void ConsoleManager::IncDestName(QString & dstName ,  const QString & dstDirPath
 void ConsoleManager::PrintHelp(void) {
    cout<<"\n";
    cout<<"Usage:\n\n";
-   cout<<"SmillaEnlarger [ < sourcename > ] [ -options... ]\n";
+   cout<<"SmillaEnlarger [ < sourcename > ... ] [ -options... ]\n";
+   cout<<"   sources may be image files and folders (all their images)\n";
    cout<<"   with options \n";
    cout<<"   -z <number>  / -zoom <number> \n";
    cout<<"       Set zoom-factor to <number> percent (integer value).\n";
@@ -306,6 +449,9 @@ void ConsoleManager::PrintHelp(void) {
    cout<<"       Write result to file <filename> .\n";
    cout<<"   -saveto <foldername>   \n";
    cout<<"       Write results into folder <foldername> .\n";
+   cout<<"   -j <number>   \n";
+   cout<<"       Enlarge <number> sources at once (default 1).\n";
+   cout<<"       Exit status is 0 only if all sources were enlarged and saved.\n";
    cout<<"\n";
    cout<<"Output Dimensions: \n";
    cout<<"   -width < sizex > and -height < sizey >   \n";
@@ -332,6 +478,15 @@ void ConsoleManager::PrintHelp(void) {
    cout<<"\n";
    cout<<"   -quality <number>   \n";
    cout<<"       Set image quality of the result.\n";
+   cout<<"   -autotune \n";
+   cout<<"       Time some block sizes before enlarging, use the fastest.\n";
+   cout<<"   -stream \n";
+   cout<<"       Write the result band by band, without holding it in memory\n";
+   cout<<"       (png, tif, ppm, pam, raw; for very big results).\n";
+   cout<<"       A result named *.dzi is always written this way: as a deep zoom\n";
+   cout<<"       tile pyramid, the tiles in the folder *_files beside it.\n";
+   cout<<"   -rawwidth <w> -rawheight <h> \n";
+   cout<<"       Size of a raw source (r,g,b or r,g,b,a bytes without header).\n";
    cout<<"   -h / -help \n";
    cout<<"       Print this help.\n";
    cout<<"   -i \n";
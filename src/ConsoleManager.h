@@ -25,8 +25,11 @@ along with this program; if not, see <http://www.gnu.org/licenses/>.
 #define CONSOLEMANAGER_H
 
 #include <QString>
+#include <QStringList>
 #include <QObject>
 #include <QImage>
+#include <QVector>
+#include <QSet>
 #include <iostream>
 
 #include "ArgumentParser.h"
@@ -42,71 +45,122 @@ class EnlargerOut : public QObject {
    Q_OBJECT
 
    QString dstName;
-   bool ended;
+   bool ended, saved;
+   bool lineMode;     // several jobs at once: whole lines, progress in steps of 10%
+   int  lastStep;
 public:
-   EnlargerOut() : QObject(), ended(false) {}
+   EnlargerOut() : QObject(), ended(false), saved(false), lineMode(false), lastStep(0) {}
    ~EnlargerOut() {}
    void SetName(const QString &name) { dstName = name; }
+   void SetLineMode(bool l) { lineMode = l; }
+   bool Saved(void) { return saved; }
    void StartMessage() {
-	   cout << "Calculating '" << dstName.toStdString() << "' - " << flush;
+	   if(lineMode)
+		   cout << "Calculating '" << dstName.toStdString() << "'\n" << flush;
+	   else
+		   cout << "Calculating '" << dstName.toStdString() << "' - " << flush;
    }
 
 public slots:
 	void PrintProgress(int  p) {
-	   if(!ended) {
+	   if(ended)
+		   return;
+	   if(!lineMode) {
 		   cout << "\rCalculating '" << dstName.toStdString() << "' - [ "<<p<<"% ]   "
 				<<flush;
 	   }
+	   else if(p/10 > lastStep && p < 100) {
+		   lastStep = p/10;
+		   cout << "'" << dstName.toStdString() << "' - [ "<<lastStep*10<<"% ]\n" <<flush;
+	   }
 	}
 	void badAlloc() {
-		cout << "\n[ ERROR ]\nCould not allocate enough memory for '" <<
+		cout << (lineMode ? "" : "\n") << "[ ERROR ] - Could not allocate enough memory for '" <<
 				dstName.toStdString() << "'.\n" << flush;
 		ended=true;
 	}
+	void sourceNotOpened() {
+		cout << (lineMode ? "" : " \n") << "[ ERROR ] - Could not open the source of '" << dstName.toStdString()<<"'.\n"<<flush; ended=true;  }
 	void imageNotSaved() {
-		cout << " \n[ ERROR ] - Could not save image '" << dstName.toStdString()<<"'.\n"<<flush; ended=true;  }
+		cout << (lineMode ? "" : " \n") << "[ ERROR ] - Could not save image '" << dstName.toStdString()<<"'.\n"<<flush; ended=true;  }
 	void imageSaved(int w, int h) {
 		Q_UNUSED(w);
 		Q_UNUSED(h);
-		cout << " OK.\n" << flush;
+		if(lineMode)
+			cout << "'" << dstName.toStdString() << "' - OK.\n" << flush;
+		else
+			cout << " OK.\n" << flush;
 		ended=true;
+		saved=true;
 	}
  };
 
+// one image of the console batch: its own thread, its own output
+struct ConsoleJob {
+   EnlargerThread *thread;
+   EnlargerOut    *out;
+   bool running;
+   ConsoleJob(void) : thread(0), out(0), running(false) {}
+};
+
 class ConsoleManager : public QObject {
    Q_OBJECT
 
    bool parseError;
+   bool quiet;       // no messages, no help (see ConsoleMode)
    ArgumentParser myParser;
    IntegerOption oZoom;
    IntegerOption oWidth,   oHeight;
+   IntegerOption oRawWidth, oRawHeight;
 
    IntegerOption oSharp,   oFlat;
    IntegerOption oDeNoise, oPreSharp;
    IntegerOption oDither,  oFNoise;
 
    IntegerOption oQuality;
+   IntegerOption oJobs;
 
    StringOption oOutput;
    StringOption oOutputFolder;
    BasicOption  oHelp, oInteractive;
    BasicOption  oFormatCover, oFormatFit;
    BasicOption  oFormatCrop, oFormatBars;
-
-   EnlargerOut myEnOut;
+   BasicOption  oAutotune, oStream;
 
    QString dstName;
 
+   // the batch: all source files (dirs expanded), started in order, -j at once
+   QStringList srcFiles;
+   QVector<ConsoleJob> jobs;       // per source file
+   QSet<QString> usedDstPaths;     // absolute, handed out to jobs, maybe not yet saved
+   int nextSrc;
+   int numRunning, numFailed;
+
 public:
-   ConsoleManager(int argc, char *argv[]);
-   ~ConsoleManager(void) {}
+   ConsoleManager(int argc, char *argv[], bool quietParse=false);
+   ~ConsoleManager(void);
+   // console mode for these arguments? Called before any application is created:
+   // the console needs only a QCoreApplication (no widgets, no display)
+   static bool ConsoleMode(int argc, char *argv[]);
    bool UseGUI(void);
    void SetupEnlargerDialog (EnlargerDialog & theDialog);
-   bool StartConsoleEnlarge  (EnlargerThread & myThread);
-   bool TryOpenSource(QString filename, QImage & srcImage);
+   // starts the batch, false if nothing is left to wait for (see ExitCode)
+   bool StartConsoleEnlarge  (void);
+   // 0: all sources enlarged & saved, 1: parse error, nothing to do or a source failed
+   int  ExitCode(void);
+   bool TryOpenSource(QString & fileName, int & srcW, int & srcH);
    void IncDestName(QString & dstName ,  const QString & dstDirPath );
    void PrintHelp(void);
 
+private slots:
+   void JobEnded(int srcIdx);
+
+private:
+   bool CollectSources(void);
+   void FillJobs(void);
+   void StartJob(int srcIdx);
+   void CalculateFormat(int srcW, int srcH, EnlargeFormat & format);
+   void PrintSummary(void);
 };
 
 
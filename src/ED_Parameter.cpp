@@ -163,6 +163,12 @@ void EnlargerDialog::ReadSettings(void) {
    }
    theSettings->endGroup();
 
+   //--- Calculation Queue: 0 = all cores, 3/4 of the memory ---
+   theSettings->beginGroup("Queue");
+   theCalcQueue->SetCoreBudget(  theSettings->value("cores",    0).toInt());
+   theCalcQueue->SetMemoryBudget(theSettings->value("memoryMB", 0).toDouble()*1024.0*1024.0);
+   theSettings->endGroup();
+
 }
 
 void EnlargerDialog::WriteSettings(void) {
@@ -224,6 +230,12 @@ void EnlargerDialog::WriteSettings(void) {
    theSettings->setValue("customY",      ui->cropFormatYBox->value()) ;
    theSettings->endGroup();
 
+   //--- Calculation Queue: set only in the file, written back to show the keys ---
+   theSettings->beginGroup("Queue");
+   theSettings->setValue("cores",    theSettings->value("cores",    0).toInt());
+   theSettings->setValue("memoryMB", theSettings->value("memoryMB", 0).toInt());
+   theSettings->endGroup();
+
 }
 
 QString EnlargerDialog::FindSettingsFile(void) {
@@ -422,6 +422,7 @@ void EnlargerDialog::DoPreview(void) {
 	format.SetDstClip(dstRect.x(), dstRect.y(), dstRect.x() + dstRect.width(), dstRect.y() + dstRect.height());
 
 	ReadParameters(enlargeParam);
+	previewThread->SetPoolPriority(previewPoolPriority);
 	previewThread->Enlarge(srcImage, format, enlargeParam.FloatParam());
 	previewThread->setPriority(QThread::NormalPriority);
 
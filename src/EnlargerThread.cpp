@@ -26,8 +26,11 @@ along with this program; if not, see <http://www.gnu.org/licenses/>.
 
 #include "EnlargerThread.h"
 #include <QThread>
-#include "ImageEnlargerCode/timing.h"
+#include <QThreadPool>
+#include <QRunnable>
+#include <QSemaphore>
 #include "ImageEnlargerCode/FractTab.h"
+#include "BandWriter.h"
 #include "ImageEnlargerCode/EnlargerTemplate.h"
 #include "ImageEnlargerCode/EnlargerTemplateDefs.h"
 
@@ -36,116 +39,504 @@ using namespace std;
 template class BasicEnlarger <Point>;  // explicit instantiations
 template class BasicEnlarger <Point4>;
 
-bool ThColorEnlarger::Enlarge(QImage *dstI) {
-   const int dstStepBY = 50;
-   Timer timer0;
-   int dstX, dstY;
+// one block of a worker of RunBlockWorkers, run by the global QThreadPool
+class BlockWorker : public QRunnable {
+   BlockWorkSource *src;
+   int workerIdx;
+   QSemaphore *doneSem;
+
+public:
+   BlockWorker(BlockWorkSource *s, int idx, QSemaphore *done)
+	  : src(s), workerIdx(idx), doneSem(done) {}
+
+   // the next block is a new task: queued behind the tasks of higher priority
+   void run(void) {
+	  BlockWorkState state = src->WorkOnBlocks(workerIdx);
+	  if(state == workGoesOn)
+		 RestartBlockWorker(src, workerIdx, doneSem);
+	  else if(state == workEnded)
+		 doneSem->release();
+   }
+};
+
+// the calling thread only waits: all enlargements together keep at most
+// the pool's threads (one per core) busy
+void RunBlockWorkers(BlockWorkSource *src, int numWorkers) {
+   QSemaphore doneSem(0);
+
+   StartBlockWorkers(src, numWorkers, &doneSem);
+   doneSem.acquire(numWorkers);
+}
+
+void StartBlockWorkers(BlockWorkSource *src, int numWorkers, QSemaphore *done) {
+   int w;
+
+   for(w=0; w<numWorkers; w++)
+	  RestartBlockWorker(src, w, done);
+}
+
+void RestartBlockWorker(BlockWorkSource *src, int workerIdx, QSemaphore *done) {
+   QThreadPool::globalInstance()->start(new BlockWorker(src, workerIdx, done), src->PoolPriority());
+}
+
+// fill the output outside the calculated rect [x0,x1)x[y0,y1) (the black margins)
+static void FillMargins(QImage *img, int x0, int y0, int x1, int y1, QRgb c) {
+   int x, y, w = img->width(), h = img->height();
+   for(y=0; y<h; y++) {
+	  QRgb *line = reinterpret_cast<QRgb *>(img->scanLine(y));
+	  if(y < y0 || y >= y1) {
+		 for(x=0; x<w; x++)
+            line[x] = c;
+         continue;
+      }
+	  for(x=0; x<x0; x++)
+         line[x] = c;
+	  for(x=x1; x<w; x++)
+         line[x] = c;
+   }
+}
 
+template<class T>
+bool ThEnlarger<T>::Enlarge(QImage *dstI, BandWriter *writer) {
    dstImg = dstI;
-   if(dstImg->width() != OutputWidth() || dstImg->height() != OutputHeight()) {  // image not correctly allocated
-      cout<<" ClipError: "<<dstImg->width()<<" "<< OutputWidth() <<" \n";
-      cout<<"          : "<<dstImg->height()<<" "<< OutputHeight() <<" \n"<<flush;
+   bandWriter = writer;
+   if(bandWriter != 0)
+      return EnlargeToWriter();
+   if(dstImg->width() != this->OutputWidth() || dstImg->height() != this->OutputHeight()) {  // image not correctly allocated
+      cout<<" ClipError: "<<dstImg->width()<<" "<< this->OutputWidth() <<" \n";
+      cout<<"          : "<<dstImg->height()<<" "<< this->OutputHeight() <<" \n"<<flush;
       return false;
    }
 
-   dstImg->fill(qRgb(0,0,0));
+   // the blocks write the whole clip-rect: only the margins need to be filled
+   // (shrinking might leave a rounded-off line at the border)
+   if(this->OnlyShrinking())
+      dstImg->fill(MarginColor());
+   else
+      FillMargins(dstImg, this->OffsetX(), this->OffsetY(), this->OffsetX() + this->ClipX1() - this->ClipX0(),
+                  this->OffsetY() + this->ClipY1() - this->ClipY0(), MarginColor());
+
+   // fetch the scanline data once: bits() may detach, must not be called by the workers
+   dstBits = dstImg->bits();
+   dstBytesPerLine = dstImg->bytesPerLine();
+   dstRow0 = 0;
+   dstRingRows = this->OutputHeight();
+
+   if(this->OnlyShrinking())   // shrinking
+      return ShrinkBands();
+
+   if(BlockAutotune())
+      this->AutotuneBlockLen();
+   return EnlargeBlocks();
+}
 
-   if(OnlyShrinking()) {  // shrinking
-      ShrinkClip();
+// streaming: the blocks are written into a ring of bands (block-rows),
+// each band is passed to the bandWriter when all its blocks are done
+template<class T>
+bool ThEnlarger<T>::EnlargeToWriter(void) {
+   if(this->OnlyShrinking()) {   // the result is smaller than the src: shrink into a whole image
+      QImage whole(this->OutputWidth(), this->OutputHeight(), DstFormat());
+	  if(whole.isNull())
+         return false;
+      whole.fill(MarginColor());
+      dstBits = whole.bits();
+      dstBytesPerLine = whole.bytesPerLine();
+      dstRow0 = 0;
+      dstRingRows = this->OutputHeight();
+      if(!ShrinkBands())
+         return false;
+	  return bandWriter->WriteRows(whole.constBits(), whole.bytesPerLine(), whole.height());
+   }
+
+   if(BlockAutotune())
+      this->AutotuneBlockLen();
+
+   // one band more than the workers can have in progress
+   int aLen = this->AnalysisLen();
+   int analysesX = (this->ClipX1() - this->AnalysisGridPos(this->ClipX0()) + aLen - 1) / aLen;
+   if(analysesX < 1)
+      analysesX = 1;
+   ringBands = 2 + (numWorkers - 1)/analysesX;
+   QImage ring(this->OutputWidth(), ringBands*aLen, DstFormat());
+   if(ring.isNull())
+      return false;
+   bandAnalysesDone = vector<int>(ringBands, 0);
+   bandsWritten = 0;
+   dstBits = ring.bits();
+   dstBytesPerLine = ring.bytesPerLine();
+   dstRow0 = this->OffsetY() - this->ClipY0() + this->AnalysisGridPos(this->ClipY0());   // output-row of the first band
+   dstRingRows = ringBands*aLen;
+
+   if(!bandWriter->WriteRows(MarginColor(), this->OffsetY()))
+      return false;
+   if(!EnlargeBlocks())
+      return false;
+   int endRow = this->OffsetY() + this->ClipY1() - this->ClipY0();
+   if(endRow < this->OffsetY())
+      endRow = this->OffsetY();
+   return bandWriter->WriteRows(MarginColor(), this->OutputHeight() - endRow);
+}
+
+// the output-rows of band b, with the margins left & right
+template<class T>
+bool ThEnlarger<T>::WriteBand(int band) {
+   int row0 = dstRow0 + band*this->AnalysisLen(), row1 = row0 + this->AnalysisLen();
+   if(row0 < this->OffsetY())
+      row0 = this->OffsetY();
+   if(row1 > this->OffsetY() + this->ClipY1() - this->ClipY0())
+      row1 = this->OffsetY() + this->ClipY1() - this->ClipY0();
+   int x0 = this->OffsetX(), x1 = this->OffsetX() + this->ClipX1() - this->ClipX0();
+   QRgb c = MarginColor();
+   for(int row=row0; row<row1; row++) {
+      QRgb *line = (QRgb *)DstLine(row);
+	  for(int x=0; x<x0; x++)
+         line[x] = c;
+	  for(int x=x1; x<this->OutputWidth(); x++)
+         line[x] = c;
+   }
+   if(row1 <= row0)
       return true;
+   return bandWriter->WriteRows(DstLine(row0), dstBytesPerLine, row1 - row0);
+}
+
+// job thread, while the workers run: writes the bands in order as they are complete,
+// outside of workMutex, then frees their ring-slots and restarts the workers parked
+// for a slot. bandsWritten is changed only here
+template<class T>
+void ThEnlarger<T>::WriteBands(void) {
+   while(bandsWritten < numAnalysisY) {
+      int slot = bandsWritten % ringBands;
+      workMutex.lock();
+      while(bandAnalysesDone[slot] < numAnalysisX && failed.loadAcquire() == 0)
+         bandReady.wait(&workMutex);
+      workMutex.unlock();
+      if(failed.loadAcquire() != 0)
+         return;
+      if(!WriteBand(bandsWritten)) {
+         Fail();
+         return;
+      }
+      QMutexLocker locker(&workMutex);
+      bandAnalysesDone[slot] = 0;
+      bandsWritten++;
+      RestartParked();
    }
+}
 
-   timer0.Clear();
-   timer0.Start();
+// stop all workers, also the parked ones, and the job thread waiting for a band
+template<class T>
+void ThEnlarger<T>::Fail(void) {
+   QMutexLocker locker(&workMutex);
+   failed.storeRelease(1);
+   bandReady.wakeAll();
+   RestartParked();
+}
+
+// the parked workers look for work again (or end)
+template<class T>
+void ThEnlarger<T>::RestartParked(void) {
+   for(size_t w=0; w<parkedWorkers.size(); w++)
+	  RestartBlockWorker(this, parkedWorkers[w], workersDone);
+   parkedWorkers.clear();
+}
 
-   long totalSteps;
-   float progressStep=0.0;
-   totalSteps  = (ClipX1() - ClipX0()) / blockLen + 1;
-   totalSteps *= (ClipY1() - ClipY0()) / blockLen + 1;
-   totalSteps *= blockLen;
+template<class T>
+bool ThEnlarger<T>::EnlargeBlocks(void) {
+   int len = this->SizeDstBlock(), aLen = this->AnalysisLen();
+   int numBlocksX = (this->ClipX1() - this->BlockGridPos(this->ClipX0()) + len - 1) / len;
+   int numBlocksY = (this->ClipY1() - this->BlockGridPos(this->ClipY0()) + len - 1) / len;
+   numAnalysisX = (this->ClipX1() - this->AnalysisGridPos(this->ClipX0()) + aLen - 1) / aLen;
+   numAnalysisY = (this->ClipY1() - this->AnalysisGridPos(this->ClipY0()) + aLen - 1) / aLen;
+
+   qint64 totalSteps;
+   progressStep=0.0;
+   totalSteps  = qint64(numBlocksX) * qint64(numBlocksY) * len;
    if(totalSteps>0)
 	   progressStep = 1.0/float(totalSteps);
 
-   for(dstY=ClipY0(); dstY<ClipY1(); dstY+=blockLen) {
-	  for(dstX=ClipX0(); dstX<ClipX1(); dstX+=blockLen) {
-		 if(myThread->CheckStop())
-            { return false; }
-		 BlockBegin(dstX, dstY);
-         ReadSrcBlock();
-
-         SrcBlockReduceNoise();
-         SrcBlockSharpen();
-         CalcBaseWeights();
-
-		 if(myThread->CheckStop())
-            { return false; }
-
-         BlockEnlargeSmooth();
-         MaskBlockEnlargeSmooth();
-
-         int dstStartBY;
-         int progressOld = 0;
-		 for(dstStartBY = DstMinBY(); dstStartBY + dstStepBY < DstMaxBY(); dstStartBY+=dstStepBY) {
-			 if(myThread->CheckStop())
-                { return false; }
-			 EnlargeBlockPart(dstStartBY, dstStartBY+dstStepBY);
-			 myThread->AddProgress(progressStep*float(dstStartBY+dstStepBY-progressOld));
-             progressOld = dstStartBY + dstStepBY;
+   int workers = numWorkers;
+   if(workers > numBlocksX*numBlocksY)
+      workers = numBlocksX*numBlocksY;
+   if(workers < 1)
+      workers = 1;
+   // one slot more than the workers: one of them can analyse the next analysis block,
+   // while the others enlarge the blocks of the last ones
+   int numSlots = workers + 1;
+   if(numSlots > numAnalysisX*numAnalysisY)
+      numSlots = numAnalysisX*numAnalysisY;
+   AnalysisSlot freeSlot;
+   freeSlot.ac = 0;
+   freeSlot.analysis = -1;
+   freeSlot.ready = false;
+   freeSlot.x0 = freeSlot.y0 = freeSlot.numX = 0;
+   freeSlot.numBlocks = freeSlot.nextBlock = freeSlot.blocksLeft = 0;
+   analysisSlots.assign(numSlots, freeSlot);
+   nextAnalysis = 0;
+   failed.storeRelease(0);
+
+   contexts.assign(workers, 0);
+   QSemaphore doneSem(0);
+   workersDone = &doneSem;
+   StartBlockWorkers(this, workers, &doneSem);
+   if(bandWriter != 0)   // streaming: this thread writes the bands while the pool works
+      WriteBands();
+   doneSem.acquire(workers);
+   workersDone = 0;
+   DeleteContexts();
+   return failed.loadAcquire() == 0;
+}
+
+// the bands of output-rows, independent of each other
+template<class T>
+bool ThEnlarger<T>::ShrinkBands(void) {
+   progressStep = 0.0;
+   failed.storeRelease(0);
+   nextBlock.storeRelease(0);
+   try {
+      this->BeginShrink();
+   }
+   catch (bad_alloc&)
+   {
+      this->EndShrink();
+      return false;
+   }
+   if(this->NumShrinkBands() > 0)
+      progressStep = 1.0/float(this->NumShrinkBands());
+
+   int workers = numWorkers < this->NumShrinkBands() ? numWorkers : this->NumShrinkBands();
+   if(workers < 1)
+      workers = 1;
+   shrinkScratch.assign(workers, 0);
+   shrinking = true;
+   RunBlockWorkers(this, workers);
+   shrinking = false;
+   DeleteContexts();
+   this->EndShrink();
+   return failed.loadAcquire() == 0;
+}
+
+template<class T>
+BlockWorkState ThEnlarger<T>::WorkOnShrinkBands(int workerIdx) {
+   try {
+      int b = nextBlock.fetchAndAddOrdered(1);
+	  if(b >= this->NumShrinkBands() || failed.loadAcquire() != 0)
+         return workEnded;
+	  if(myThread->CheckStop()) {
+         failed.storeRelease(1);
+         return workEnded;
+      }
+	  if(shrinkScratch[workerIdx] == 0)
+		 shrinkScratch[workerIdx] = new ScratchArena(this->ShrinkScratchBytes());
+	  this->ShrinkBand(b, *shrinkScratch[workerIdx]);
+	  myThread->AddProgress(progressStep);
+   }
+   catch (bad_alloc&)
+   {
+      failed.storeRelease(1);
+   }
+   return failed.loadAcquire() == 0 ? workGoesOn : workEnded;
+}
+
+// the blocks of the oldest analysed slot first, so the slots are freed in order,
+// else a free slot for the next analysis block (streaming: if its band has a ring-slot).
+// block: of the slot to enlarge, -1: analyse the slot
+template<class T>
+BlockWorkState ThEnlarger<T>::FetchWork(AnalysisSlot *& slot, int & block) {
+   size_t s;
+   bool busy = false;
+
+   slot = 0;
+   if(failed.loadAcquire() != 0)
+      return workEnded;
+   for(s=0; s<analysisSlots.size(); s++) {
+      AnalysisSlot & sl = analysisSlots[s];
+	  if(sl.analysis >= 0)
+         busy = true;
+	  if(sl.ready && sl.nextBlock < sl.numBlocks && (slot == 0 || sl.analysis < slot->analysis))
+         slot = &sl;
+   }
+   if(slot != 0) {
+      block = slot->nextBlock++;
+      return workGoesOn;
+   }
+   if(nextAnalysis >= numAnalysisX*numAnalysisY)
+      return busy ? workParked : workEnded;
+   if(bandWriter != 0 && nextAnalysis / numAnalysisX >= bandsWritten + ringBands)
+      return workParked;
+   s = 0;
+   while(s < analysisSlots.size() && analysisSlots[s].analysis >= 0)
+      s++;
+   if(s == analysisSlots.size())
+      return workParked;
+   slot = &analysisSlots[s];
+   slot->analysis = nextAnalysis++;
+   slot->ready = false;
+   block = -1;
+   return workGoesOn;
+}
+
+// all blocks of the slot are done: it's free again. Streaming: counted for its band,
+// the complete band is written by the job thread
+template<class T>
+void ThEnlarger<T>::SlotDone(AnalysisSlot & slot) {
+   if(bandWriter != 0 && ++bandAnalysesDone[(slot.analysis / numAnalysisX) % ringBands] == numAnalysisX)
+      bandReady.wakeAll();
+   slot.analysis = -1;
+   slot.ready = false;
+   RestartParked();
+}
+
+template<class T>
+BlockWorkState ThEnlarger<T>::WorkOnBlocks(int workerIdx) {
+   if(shrinking)
+      return WorkOnShrinkBands(workerIdx);
+   try {
+      AnalysisSlot *slot;
+      int b;
+      workMutex.lock();
+      BlockWorkState state = FetchWork(slot, b);
+	  if(state == workParked)   // restarted when a slot gets ready or free, or a band is written
+         parkedWorkers.push_back(workerIdx);
+      workMutex.unlock();
+	  if(state != workGoesOn)
+         return state;
+
+	  if(b < 0) {
+		 if(!AnalyseBlock(*slot)) {
+            Fail();
+            return workEnded;
+         }
+         QMutexLocker locker(&workMutex);
+         slot->ready = true;   // its blocks for all workers
+		 if(slot->blocksLeft == 0)
+            SlotDone(*slot);
+         RestartParked();
+      }
+      else {
+		 if(contexts[workerIdx] == 0)
+			contexts[workerIdx] = this->NewBlockContext();
+		 int dstX = slot->x0 + (b % slot->numX)*this->SizeDstBlock();
+		 int dstY = slot->y0 + (b / slot->numX)*this->SizeDstBlock();
+		 if(!EnlargeDstBlock(*contexts[workerIdx], *slot->ac, dstX, dstY)) {
+            Fail();
+            return workEnded;
          }
-		 if(myThread->CheckStop())
-            { return false; }
-
-		 EnlargeBlockPart(dstStartBY, DstMaxBY());
-         AddRandomNew ();
-		 if(FractNoise() > 0.0)
-            FractModify();
-         CurrentDstBlock()->Clamp01();
-         WriteDstBlock();
-		 myThread->AddProgress(progressStep*float(blockLen - progressOld));
+         QMutexLocker locker(&workMutex);
+		 if(--slot->blocksLeft == 0)
+            SlotDone(*slot);
       }
    }
+   catch (bad_alloc&)
+   {
+      Fail();
+   }
+   return failed.loadAcquire() == 0 ? workGoesOn : workEnded;
+}
+
+// the analysis block of the slot & the geometry of its blocks
+template<class T>
+bool ThEnlarger<T>::AnalyseBlock(AnalysisSlot & slot) {
+   int len = this->SizeDstBlock(), aLen = this->AnalysisLen(), x1, y1;
+   int ax = this->AnalysisGridPos(this->ClipX0()) + (slot.analysis % numAnalysisX)*aLen;
+   int ay = this->AnalysisGridPos(this->ClipY0()) + (slot.analysis / numAnalysisX)*aLen;
+
+   this->AnalysisBlocks(ax, ay, slot.x0, slot.y0, x1, y1);
+   slot.numX = (x1 - slot.x0 + len - 1)/len;
+   slot.numBlocks = slot.numX*((y1 - slot.y0 + len - 1)/len);
+   slot.nextBlock = 0;
+   slot.blocksLeft = slot.numBlocks;
+   if(myThread->CheckStop() || failed.loadAcquire() != 0)
+      { return false; }
+   if(slot.ac == 0)
+      slot.ac = this->NewAnalysisContext();
+   this->AnalysisBegin(*slot.ac, ax, ay);
+   this->AnalyseSrcBlock(*slot.ac);
    return true;
 }
 
-void ThColorEnlarger::ReadSrcPixel(int srcX, int srcY, Point & dstP) {
-   ColorToPoint(srcImg.pixel(srcX, srcY) , dstP);
+template<class T>
+int ThEnlarger<T>::PoolPriority(void) {
+   return myThread->PoolPriority();
 }
 
-void ThColorEnlarger::WriteDstPixel(Point p, int dstCX, int dstCY) {
-   QRgb c = qRgb(int(p.x*255.0 + 0.5), int(p.y*255.0 + 0.5),  int(p.z*255.0 + 0.5));
-   dstImg->setPixel(dstCX, dstCY, c);
+template<class T>
+void ThEnlarger<T>::DeleteContexts(void) {
+   for(size_t w=0; w<contexts.size(); w++)
+	  delete contexts[w];
+   contexts.clear();
+   for(size_t w=0; w<shrinkScratch.size(); w++)
+	  delete shrinkScratch[w];
+   shrinkScratch.clear();
+   for(size_t s=0; s<analysisSlots.size(); s++)
+	  delete analysisSlots[s].ac;
+   analysisSlots.clear();
+}
+
+template<class T>
+bool ThEnlarger<T>::EnlargeDstBlock(BlockContext<T> & bc, BlockContext<T> & ac, int dstX, int dstY) {
+   const int dstStepBY = 50;
+
+   if(myThread->CheckStop() || failed.loadAcquire() != 0)
+      { return false; }
+   this->BlockBegin(bc, dstX, dstY, ac);
+
+   this->BlockEnlargeSmooth(bc);
+   this->MaskBlockEnlargeSmooth(bc);
+
+   int dstStartBY;
+   int progressOld = 0;
+   for(dstStartBY = bc.DstMinBY(); dstStartBY + dstStepBY < bc.DstMaxBY(); dstStartBY+=dstStepBY) {
+	  if(myThread->CheckStop() || failed.loadAcquire() != 0)
+         { return false; }
+	  this->EnlargeBlockPart(bc, dstStartBY, dstStartBY+dstStepBY);
+	  myThread->AddProgress(progressStep*float(dstStartBY+dstStepBY-progressOld));
+      progressOld = dstStartBY + dstStepBY;
+   }
+   if(myThread->CheckStop() || failed.loadAcquire() != 0)
+      { return false; }
+
+   this->EnlargeBlockPart(bc, dstStartBY, bc.DstMaxBY());
+   AddRandomNew(bc);
+   if(this->FractNoise() > 0.0)
+      FractModify(bc);
+   bc.DstBlock()->Clamp01(bc.DstMinBX(), bc.DstMinBY(), bc.DstMaxBX(), bc.DstMaxBY());
+   this->WriteDstBlock(bc);
+   myThread->AddProgress(progressStep*float(this->SizeDstBlock() - progressOld));
+   return true;
 }
 
-void ThColorEnlarger::AddRandomNew(void) {
+template<class T>
+void ThEnlarger<T>::AddRandomNew(BlockContext<T> & bc) {
    int dstBX,dstBY;
-   Point p;
+   T p;
 
-   if(OnlyShrinking())
+   if(this->OnlyShrinking())
       return;
 
-   BasicArray< Point > *dstBlock = CurrentDstBlock();
-   for(dstBY = DstMinBY(); dstBY<DstMaxBY() ; dstBY++) {
-	  for(dstBX = DstMinBX(); dstBX<DstMaxBX() ; dstBX++) {
+   PlanarArray< T > *dstBlock = bc.DstBlock();
+   for(dstBY = bc.DstMinBY(); dstBY<bc.DstMaxBY() ; dstBY++) {
+	  for(dstBX = bc.DstMinBX(); dstBX<bc.DstMaxBX() ; dstBX++) {
          float maxW;
-         float w = (2.0 * RandF() - 1.0);
-         w *= RandF();
+         bc.RandPos(dstBX, dstBY);
+         float w = (2.0 * bc.RandF() - 1.0);
+         w *= bc.RandF();
 		 p = dstBlock->Get( dstBX, dstBY);
 
-         maxW = 0.5*Dither();
+         maxW = 0.5*this->Dither();
 		 if(p.x  < maxW)
             maxW = p.x;
 		 if(1.0 - p.x  < maxW)
             maxW = 1.0 - p.x;
          p.x += w*maxW*p.x;
 
-         maxW = 0.5*Dither();
+         maxW = 0.5*this->Dither();
 		 if(p.y  < maxW)
             maxW = p.y;
 		 if(1.0 - p.y  < maxW)
             maxW = 1.0 - p.y;
          p.y += w*maxW*p.y;
 
-         maxW = 0.5*Dither();
+         maxW = 0.5*this->Dither();
 		 if(p.z  < maxW)
             maxW = p.z;
 		 if(1.0 - p.z  < maxW)
@@ -157,21 +548,22 @@ void ThColorEnlarger::AddRandomNew(void) {
    }
 }
 
-void ThColorEnlarger::FractModify(void) {
+template<class T>
+void ThEnlarger<T>::FractModify(BlockContext<T> & bc) {
    int dstBX,dstBY;
-   Point p;
+   T p;
 
-   if(OnlyShrinking() || MyFractTab()==0 || FractNoise()==0.0)
+   if(this->OnlyShrinking() || this->MyFractTab()==0 || this->FractNoise()==0.0)
       return;
 
-   BasicArray< Point > *dstBlock = CurrentDstBlock();
-   for(dstBY = DstMinBY(); dstBY<DstMaxBY() ; dstBY++) {
-	  for(dstBX = DstMinBX(); dstBX<DstMaxBX() ; dstBX++) {
-         const float fractW = 0.2*FractNoise();
+   PlanarArray< T > *dstBlock = bc.DstBlock();
+   for(dstBY = bc.DstMinBY(); dstBY<bc.DstMaxBY() ; dstBY++) {
+	  for(dstBX = bc.DstMinBX(); dstBX<bc.DstMaxBX() ; dstBX++) {
+         const float fractW = 0.2*this->FractNoise();
          float maxW;
-         int dstX = dstBX + DstBlockEdgeX();
-         int dstY = dstBY + DstBlockEdgeY();
-		 float w = 0.03*MyFractTab()->GetT(dstX, dstY);
+         int dstX = dstBX + bc.DstBlockEdgeX();
+         int dstY = dstBY + bc.DstBlockEdgeY();
+		 float w = 0.03*this->MyFractTab()->GetT(dstX, dstY);
 
 		 p = dstBlock->Get( dstBX, dstBY);
 
@@ -201,171 +593,72 @@ void ThColorEnlarger::FractModify(void) {
    }
 }
 
+template class ThEnlarger <Point>;  // explicit instantiations
+template class ThEnlarger <Point4>;
+
 //--------------------------------------------------------------------
 
-bool ThColorEnlargerAlpha::Enlarge(QImage *dstI) {
-   const int dstStepBY = 50;
-   Timer timer0;
-   int dstX, dstY;
+void ThColorEnlarger::ReadSrcPixel(int srcX, int srcY, Point & dstP) {
+   ReadSrcSpan(srcX, srcY, 1, &dstP);
+}
 
-   dstImg = dstI;
-   if(dstImg->width() != OutputWidth() || dstImg->height() != OutputHeight()) {  // image not correctly allocated
-      cout<<" ClipError: "<<dstImg->width()<<" "<< OutputWidth() <<" \n";
-      cout<<"          : "<<dstImg->height()<<" "<< OutputHeight() <<" \n"<<flush;
-      return false;
-   }
-   dstImg->fill(qRgba(0,0,0,0));
+void ThColorEnlarger::WriteDstPixel(Point p, int dstCX, int dstCY) {
+   QRgb c = qRgb(int(p.x*255.0 + 0.5), int(p.y*255.0 + 0.5),  int(p.z*255.0 + 0.5));
+   ((QRgb*)DstLine(dstCY))[dstCX] = c;   // no setPixel: would detach in each worker
+}
 
-   if(OnlyShrinking()) {  // shrinking
-      ShrinkClip();
-      return true;
+void ThColorEnlarger::ReadSrcSpan(int srcX, int srcY, int len, Point *dstSpan) {
+   if(srcImg->PixelLayout() == ImageSource::rgb32) {
+      const QRgb *line = (const QRgb*)srcImg->Line(srcY) + srcX;
+      for(int a=0; a<len; a++)
+         ColorToPoint(line[a], dstSpan[a]);
    }
+   else {     // mapped file: bytes
+      int bpp = srcImg->BytesPerPixel();
+      const uchar *pix = srcImg->Line(srcY) + qint64(srcX)*bpp;
+      for(int a=0; a<len; a++, pix+=bpp)
+         BytesToPoint(pix, dstSpan[a]);
+   }
+}
 
-   timer0.Clear();
-   timer0.Start();
-
-   long totalSteps;
-   float progressStep=0.0;
-   totalSteps  = (ClipX1() - ClipX0()) / blockLen + 1;
-   totalSteps *= (ClipY1() - ClipY0()) / blockLen + 1;
-   totalSteps *= blockLen;
-   if(totalSteps>0)
-	   progressStep = 1.0/float(totalSteps);
-
-   for(dstY=ClipY0(); dstY<ClipY1(); dstY+=blockLen) {
-	  for(dstX=ClipX0(); dstX<ClipX1(); dstX+=blockLen) {
-		 if(myThread->CheckStop())
-            { return false; }
-		 BlockBegin(dstX, dstY);
-         ReadSrcBlock();
-
-         SrcBlockReduceNoise();
-         SrcBlockSharpen();
-         CalcBaseWeights();
-
-		 if(myThread->CheckStop())
-            { return false; }
-
-         BlockEnlargeSmooth();
-         MaskBlockEnlargeSmooth();
-
-         int dstStartBY;
-         int progressOld = 0;
-		 for(dstStartBY = DstMinBY(); dstStartBY + dstStepBY < DstMaxBY(); dstStartBY+=dstStepBY) {
-			 if(myThread->CheckStop())
-                { return false; }
-			 EnlargeBlockPart(dstStartBY, dstStartBY+dstStepBY);
-			 myThread->AddProgress(progressStep*float(dstStartBY+dstStepBY-progressOld));
-             progressOld = dstStartBY + dstStepBY;
-         }
-		 if(myThread->CheckStop())
-            { return false; }
-
-		 EnlargeBlockPart(dstStartBY, DstMaxBY());
-         AddRandomNew ();
-		 if(FractNoise() > 0.0)
-            FractModify();
-         CurrentDstBlock()->Clamp01();
-         WriteDstBlock();
-		 myThread->AddProgress(progressStep*float(blockLen - progressOld));
-      }
+void ThColorEnlarger::WriteDstSpan(const Point *srcSpan, int len, int dstCX, int dstCY) {
+   QRgb *line = (QRgb*)DstLine(dstCY) + dstCX;
+   for(int a=0; a<len; a++) {
+	  const Point & p = srcSpan[a];
+	  line[a] = qRgb(int(p.x*255.0 + 0.5), int(p.y*255.0 + 0.5),  int(p.z*255.0 + 0.5));
    }
-   //timer0.Stop();
-   //cout<<"EnlargeTime: "<<timer0.Get()<<" \n"<<flush;
-   return true;
 }
 
+//--------------------------------------------------------------------
+
 void ThColorEnlargerAlpha::ReadSrcPixel(int srcX, int srcY, Point4 & dstP) {
-   ColorToPoint(srcImg.pixel(srcX, srcY) , dstP);
+   ReadSrcSpan(srcX, srcY, 1, &dstP);
 }
 
 void ThColorEnlargerAlpha::WriteDstPixel(Point4 p, int dstCX, int dstCY) {
    QRgb c = qRgba(int(p.x*255.0 + 0.5), int(p.y*255.0 + 0.5),  int(p.z*255.0 + 0.5), int(p.w*255.0 + 0.5));
-   dstImg->setPixel(dstCX, dstCY, c);
+   ((QRgb*)DstLine(dstCY))[dstCX] = c;
 }
 
-void ThColorEnlargerAlpha::AddRandomNew(void) {
-   int dstBX,dstBY;
-   Point4 p;
-
-   if(OnlyShrinking())
-      return;
-
-   BasicArray< Point4 > *dstBlock = CurrentDstBlock();
-   for(dstBY = DstMinBY(); dstBY<DstMaxBY() ; dstBY++) {
-	  for(dstBX = DstMinBX(); dstBX<DstMaxBX() ; dstBX++) {
-         float maxW;
-         float w = (2.0 * RandF() - 1.0);
-         w *= RandF();
-		 p = dstBlock->Get( dstBX, dstBY);
-
-         maxW = 0.5*Dither();
-		 if(p.x  < maxW)
-            maxW = p.x;
-		 if(1.0 - p.x  < maxW)
-            maxW = 1.0 - p.x;
-         p.x += w*maxW*p.x;
-
-         maxW = 0.5*Dither();
-		 if(p.y  < maxW)
-            maxW = p.y;
-		 if(1.0 - p.y  < maxW)
-            maxW = 1.0 - p.y;
-         p.y += w*maxW*p.y;
-
-         maxW = 0.5*Dither();
-		 if(p.z  < maxW)
-            maxW = p.z;
-		 if(1.0 - p.z  < maxW)
-            maxW = 1.0 - p.z;
-         p.z += w*maxW*p.z;
-
-		 dstBlock->Set(dstBX, dstBY, p);
-      }
+void ThColorEnlargerAlpha::ReadSrcSpan(int srcX, int srcY, int len, Point4 *dstSpan) {
+   if(srcImg->PixelLayout() == ImageSource::rgb32) {
+      const QRgb *line = (const QRgb*)srcImg->Line(srcY) + srcX;
+      for(int a=0; a<len; a++)
+         ColorToPoint(line[a], dstSpan[a]);
+   }
+   else {     // mapped file: bytes
+      int bpp = srcImg->BytesPerPixel();
+      const uchar *pix = srcImg->Line(srcY) + qint64(srcX)*bpp;
+      for(int a=0; a<len; a++, pix+=bpp)
+         BytesToPoint(pix, dstSpan[a]);
    }
 }
 
-void ThColorEnlargerAlpha::FractModify(void) {
-   int dstBX,dstBY;
-   Point4 p;
-
-   if(OnlyShrinking() || MyFractTab()==0 || FractNoise()==0.0)
-      return;
-
-   BasicArray< Point4 > *dstBlock = CurrentDstBlock();
-   for(dstBY = DstMinBY(); dstBY<DstMaxBY() ; dstBY++) {
-	  for(dstBX = DstMinBX(); dstBX<DstMaxBX() ; dstBX++) {
-         const float fractW = 0.2*FractNoise();
-         float maxW;
-         int dstX = dstBX + DstBlockEdgeX();
-         int dstY = dstBY + DstBlockEdgeY();
-		 float w = 0.03*MyFractTab()->GetT(dstX, dstY);
-
-		 p = dstBlock->Get( dstBX, dstBY);
-
-         maxW = fractW;
-		 if(p.x  < maxW)
-            maxW = p.x;
-		 if(1.0 - p.x  < maxW)
-            maxW = 1.0 - p.x;
-         p.x += w*maxW*p.x;
-
-         maxW = fractW;
-		 if(p.y  < maxW)
-            maxW = p.y;
-		 if(1.0 - p.y  < maxW)
-            maxW = 1.0 - p.y;
-         p.y += w*maxW*p.y;
-
-         maxW = fractW;
-		 if(p.z  < maxW)
-            maxW = p.z;
-		 if(1.0 - p.z  < maxW)
-            maxW = 1.0 - p.z;
-         p.z += w*maxW*p.z;
-
-		 dstBlock->Set(dstBX, dstBY, p);
-      }
+void ThColorEnlargerAlpha::WriteDstSpan(const Point4 *srcSpan, int len, int dstCX, int dstCY) {
+   QRgb *line = (QRgb*)DstLine(dstCY) + dstCX;
+   for(int a=0; a<len; a++) {
+	  const Point4 & p = srcSpan[a];
+	  line[a] = qRgba(int(p.x*255.0 + 0.5), int(p.y*255.0 + 0.5),  int(p.z*255.0 + 0.5), int(p.w*255.0 + 0.5));
    }
 }
 
@@ -379,6 +672,9 @@ EnlargerThread::EnlargerThread(QObject *parent, int id) {
     stopEnlarge = false;
     abort = false;
     threadId = id;
+    workers = 0;
+    poolPriority = 0;
+    srcRawW = srcRawH = 0;
 }
 
 EnlargerThread::~EnlargerThread(void) {
@@ -391,10 +687,12 @@ EnlargerThread::~EnlargerThread(void) {
 
 
 void EnlargerThread::Enlarge(const QImage & src, const EnlargeFormat & f, const EnlargeParameter & p) {
+	std::shared_ptr<const ImageSource> srcData = ImageSource::FromImage(src);
 	QMutexLocker locker(&mutex);
-    sourceImage = src;
+    source = srcData;
     format = f;
     param  = p;
+    srcFileName = QString();
 	if(f.srcWidth != src.width() || f.srcHeight != src.height()) {
        cout<<"EnlargerThread:  Enlarge: source does not fit to format.\n"<<flush;
     }
@@ -413,14 +711,21 @@ void EnlargerThread::Enlarge(const QImage & src, const EnlargeFormat & f, const
 
 void EnlargerThread::EnlargeAndSave(const QImage & src, const EnlargeFormat & f, const EnlargeParameter & p,
 									 const QString & dstName, int resultQuality )
+{
+	EnlargeAndSave(ImageSource::FromImage(src), f, p, dstName, resultQuality);
+}
+
+void EnlargerThread::EnlargeAndSave(const std::shared_ptr<const ImageSource> & src, const EnlargeFormat & f,
+									 const EnlargeParameter & p, const QString & dstName, int resultQuality )
 {
 	QMutexLocker locker(&mutex);
-    sourceImage = src;
+    source = src;
     format = f;
     param  = p;
     quality = resultQuality;
+    srcFileName = QString();
 
-	if(f.srcWidth != src.width() || f.srcHeight != src.height()) {
+	if(f.srcWidth != src->Width() || f.srcHeight != src->Height()) {
        cout<<"EnlargerThread:  EnlargeAndSave: source does not fit to format.\n"<<flush;
     }
 
@@ -437,80 +742,221 @@ void EnlargerThread::EnlargeAndSave(const QImage & src, const EnlargeFormat & f,
     }
 }
 
+void EnlargerThread::EnlargeFileAndSave(const QString & srcName, const EnlargeFormat & f, const EnlargeParameter & p,
+										const QString & dstName, int resultQuality, int rawW, int rawH)
+{
+	QMutexLocker locker(&mutex);
+    source.reset();
+    srcFileName = srcName;
+    srcRawW = rawW;
+    srcRawH = rawH;
+    format = f;
+    param  = p;
+    quality = resultQuality;
+
+    saveAtEnd = true;
+    dstFileName = dstName;
+    restartEnlarge = true;
+
+	if(!isRunning()) {
+		start(QThread::LowPriority);
+    }
+    else {
+        stopEnlarge = true;
+        waiter.wakeOne();
+    }
+}
+
+const double maxImageBytes = 2147483647.0;
+
+// the dst-block len the enlarger will choose (without autotune)
+static int EstimateBlockLen(const EnlargeFormat & format, int pointBytes) {
+   return 1 << ChooseBlockExp(1.0/format.scaleX, 1.0/format.scaleY,
+                              7*pointBytes + 4*sizeof(float), pointBytes + sizeof(float), CacheSizeL2());
+}
+
+static int EstimateAnalysisLen(const EnlargeFormat & format) {
+   return 1 << ChooseAnalysisExp(1.0/format.scaleX, 1.0/format.scaleY);
+}
+
+static bool Shrinking(const EnlargeFormat & format) {
+   return format.scaleX < 1.0 && format.scaleY < 1.0;
+}
+
+double EstimatePeakBytes(const EnlargeFormat & format, bool hasAlpha, const QString & dstName, int numWorkers) {
+   int pointBytes = hasAlpha ? sizeof(Point4) : sizeof(Point);
+   double srcW = format.srcWidth, srcH = format.srcHeight;
+   double dstW = format.ClipW(),  dstH = format.ClipH();
+   double bytes = 4.0*srcW*srcH;             // the src, 32 bit
+   int len;                                  // rows of a band of the result
+
+   if(Shrinking(format)) {
+      len = shrinkBandRows;
+      // per worker a src- and a dst-line, the column & row tables
+      bytes += numWorkers*2.0*(srcW + dstW)*pointBytes + 16.0*(dstW + dstH);
+   }
+   else {
+      len = EstimateAnalysisLen(format);
+      int dstLen = EstimateBlockLen(format, pointBytes);
+      // an analysis context (one more than the workers) holds the srcBlock of an analysis block
+      double srcBX = double(len)/format.scaleX + 2*srcBlockMargin;
+      double srcBY = double(len)/format.scaleY + 2*srcBlockMargin;
+      double perAnalysis = srcBX*srcBY*(7*pointBytes + 4*sizeof(float))  // srcBlock, derivs, weights
+                         + 2.25*srcBX*srcBY*pointBytes;                  // scratch (ReduceNoise)
+      double perWorker = double(dstLen)*dstLen*(pointBytes + sizeof(float));   // dstBlock, workMaskDst
+      bytes += (numWorkers + 1)*perAnalysis + numWorkers*perWorker;
+      bytes += 2.0*5*sizeof(float)*(dstW + dstH);                        // kernel tables
+   }
+
+   if(StreamOutput() || BandWriter::NeedsStream(dstName) || 4.0*dstW*dstH > maxImageBytes) {
+      int bandsX = (int(dstW) + len - 1)/len;
+      double ringRows = double(len)*(2 + (numWorkers - 1)/(bandsX > 0 ? bandsX : 1));
+      bytes += 4.0*dstW*(ringRows < dstH ? ringRows : dstH);
+   }
+   else
+      bytes += 4.0*dstW*dstH;
+   return bytes;
+}
+
+int UsefulWorkers(const EnlargeFormat & format, bool hasAlpha) {
+   qint64 units;
+   if(Shrinking(format))
+      units = (format.ClipH() + shrinkBandRows - 1)/shrinkBandRows;
+   else {
+      int len = EstimateBlockLen(format, hasAlpha ? sizeof(Point4) : sizeof(Point));
+      units = qint64((format.ClipW() + len - 1)/len) * ((format.ClipH() + len - 1)/len);
+   }
+   int cores = QThread::idealThreadCount();
+   if(cores < 1)
+      cores = 1;
+   if(units < 1)
+      return 1;
+   return units < cores ? int(units) : cores;
+}
+
 void EnlargerThread::run(void) {
    bool sourceHasAlpha;
-   QImage *dstImg=0;
-   long *dstBuffer=0;        // the data of dstImg are created in dstBuffer
-   FractTab *fractTab=0;       // the plasma fractal; tab is deleted/reconstructed when scaleF changes
-   float    fractTScaleF = 1.0;
+   QImage *dstImg=0;         // owns its data: the result is handed on without copy
+   BandWriter *writer=0;     // streaming output: instead of dstImg, see BandWriter.h
+   std::shared_ptr<FractTab> fractTab;   // the plasma fractal of the scaleF, shared (see SetupCache.h)
 
 
    for(;;) {
       waitForRestart();
 	  if(abort) {
-		 if(fractTab != 0)
-            delete fractTab;
          return;
       }
       mutex.lock();
       restartEnlarge = false;
       stopEnlarge = false;
-      sourceHasAlpha = sourceImage.hasAlphaChannel();
+      QString openName = srcFileName;
+      int rawW = srcRawW, rawH = srcRawH;
+      mutex.unlock();
+
+      // EnlargeFileAndSave: decode here, meanwhile the pool works on the blocks of others
+	  if(!openName.isEmpty()) {
+		 std::shared_ptr<const ImageSource> opened;
+         try {
+			opened = ImageSource::Open(openName, rawW, rawH);
+         }
+         catch (bad_alloc&)
+         {
+			opened.reset();
+         }
+         mutex.lock();
+		 if(restartEnlarge || abort) {     // new task meanwhile
+            mutex.unlock();
+            continue;
+         }
+		 bool fits = opened && opened->Width() == format.srcWidth && opened->Height() == format.srcHeight;
+		 if(fits)
+			source = opened;
+         mutex.unlock();
+		 if(!fits) {
+			emit sourceNotOpened();
+			emit enlargeEnd(threadId);
+            continue;
+         }
+      }
+
+      mutex.lock();
+      sourceHasAlpha = source->HasAlpha();
       progress = 0.0;
 	  emit tellProgress(0);
       mutex.unlock();
 
+      bool notSaved = false;
       try {
          mutex.lock();
-		 if(fractTab == 0) {
-			fractTab = new FractTab(format.scaleX);
-            fractTScaleF =  format.scaleX ;
+         float fractScaleF = format.scaleX;
+         int dstW = format.ClipW(), dstH = format.ClipH();
+         mutex.unlock();
+		 if(!fractTab || fractTab->ScaleF() != fractScaleF)
+			fractTab = SharedFractTab(fractScaleF);
+
+		 // a QImage holds at most 2GB: bigger results are streamed (if the type allows),
+		 // as the types QImage can't save (pam, raw, dzi)
+		 if(saveAtEnd && (StreamOutput() || BandWriter::NeedsStream(dstFileName)
+						  || 4.0*double(dstW)*double(dstH) > maxImageBytes))
+			writer = BandWriter::Create(dstFileName, dstW, dstH, sourceHasAlpha, quality);
+		 if(writer != 0) {
+			if(!writer->Open()) {
+               notSaved = true;
+               stopEnlarge = true;
+            }
          }
-		 else if( format.scaleX != fractTScaleF) {  // not the scaleFactor for which the fractTab was constructed
-            delete fractTab;
-			fractTab = new FractTab(format.scaleX);
-            fractTScaleF = format.scaleX;
+         else {
+            // 32 bit per pixel, exactly the size of the result
+			dstImg = new QImage(dstW, dstH, sourceHasAlpha ? QImage::Format_ARGB32 : QImage::Format_RGB32);
+			if(dstImg->isNull())     // QImage doesn't throw, if the data can't be allocated
+               throw bad_alloc();
          }
-         mutex.unlock();
-
-         dstBuffer = new long[ (format.ClipW()+1) * (format.ClipH()+1) ];
       }
       catch (bad_alloc&)
       {
          stopEnlarge = true;
-         dstBuffer = 0;
+		 if(dstImg != 0)
+            delete dstImg;
+         dstImg = 0;
          emit badAlloc();
       }
 
-	  if(!stopEnlarge && dstBuffer!=0) {
-		 if(sourceHasAlpha)
-			dstImg = new QImage((uchar*)dstBuffer, format.ClipW(), format.ClipH(), QImage::Format_ARGB32);
-         else
-			dstImg = new QImage((uchar*)dstBuffer, format.ClipW(), format.ClipH(), QImage::Format_RGB32);
-
+	  if(!stopEnlarge && (dstImg!=0 || writer!=0)) {
          // Enlarge with stop/restart/abort-check and progress
-		 if(!ExecEnlarge(dstImg, fractTab)) {
+		 if(!ExecEnlarge(dstImg, fractTab.get(), writer)) {
 			if(!abort && !stopEnlarge) {  // enlarged was not aborted by user
                stopEnlarge = true;
-               emit badAlloc();
-			   emit enlargeEnd(threadId);
+			   if(writer != 0 && writer->Failed())
+                  notSaved = true;
+               else
+                  emit badAlloc();
             }
          }
       }
 
 	  if(abort) {
-		 if(dstBuffer != 0) {
-            delete[] dstBuffer;
-			if(dstImg!=0)
-               delete dstImg;
+		 if(dstImg!=0)
+            delete dstImg;
+		 if(writer != 0) {
+            writer->Remove();
+            delete writer;
          }
-		 if(fractTab != 0)
-            delete fractTab;
 		 emit enlargeEnd(threadId);
          return;
       }
 	  if(!stopEnlarge) {     // enlarge finished, no restart/abort
-		 if(saveAtEnd) {
+		 // save: a src opened here isn't needed any more
+         mutex.lock();
+		 if(!srcFileName.isEmpty() && !restartEnlarge)
+			source.reset();
+         mutex.unlock();
+		 if(writer != 0) {
+			if(!writer->Close())
+               notSaved = true;
+            else
+			   emit imageSaved(writer->Width(), writer->Height());
+         }
+		 else if(saveAtEnd) {
 			if(!dstImg->save(dstFileName, 0, quality)) {
                emit imageNotSaved();
             }
@@ -519,28 +965,27 @@ void EnlargerThread::run(void) {
             }
          }
          else {
-            QImage emitImg = *dstImg;
-            emitImg.detach();  // detach from the dstBuffer created above, this is destroyed below
-			emit enlargedImage(emitImg);
+            // implicitly shared: after deleting dstImg below, the receiver owns the only reference
+			emit enlargedImage(*dstImg);
          }
       }
-	  if(dstBuffer != 0) {
-         delete[] dstBuffer;
-		 if(dstImg!=0)
-            delete dstImg;
+	  if(writer != 0) {
+		 if(stopEnlarge || notSaved)    // don't leave a broken file
+            writer->Remove();
+         delete writer;
       }
-      dstBuffer = 0;
+	  if(notSaved)
+         emit imageNotSaved();
+	  if(dstImg!=0)
+         delete dstImg;
       dstImg    = 0;
+      writer    = 0;
 	  emit tellProgress(100);
 	  emit enlargeEnd(threadId);
    }
 
-   if(dstBuffer != 0)
-      delete[] dstBuffer;
    if(dstImg!=0)
       delete dstImg;
-   if(fractTab != 0)
-      delete fractTab;
 
 }
 
@@ -551,23 +996,30 @@ void EnlargerThread::waitForRestart(void) {
     }
 }
 
-bool EnlargerThread::ExecEnlarge(QImage *dstImg,  FractTab *fractTab) {
+bool EnlargerThread::ExecEnlarge(QImage *dstImg,  FractTab *fractTab, BandWriter *writer) {
    bool resultFlag;
 
-   if(dstImg == 0)
+   if(dstImg == 0 && writer == 0)
       return false;
 
    mutex.lock();
-   QImage srcImg = sourceImage;
+   std::shared_ptr<const ImageSource> srcImg = source;
    EnlargeFormat eFormat = format;
    EnlargeParameter eParam = param;
+   int numWorkers = workers;
    mutex.unlock();
 
-   if(srcImg.hasAlphaChannel()) {
+   // one block-worker per core (if not set), the blocks share the tables of one enlarger
+   if(numWorkers < 1)
+      numWorkers = QThread::idealThreadCount();
+   if(numWorkers < 1)
+      numWorkers = 1;
+
+   if(srcImg->HasAlpha()) {
       //cout<<"Enlarge WITH ALPHA.\n"<<flush;
       ThColorEnlargerAlpha *theEnlarger=0;
       try {
-		 theEnlarger = new ThColorEnlargerAlpha (srcImg, eFormat, eParam, this);
+		 theEnlarger = new ThColorEnlargerAlpha (srcImg, eFormat, eParam, this, numWorkers);
          mutex.lock();
 		 if(fractTab != 0) {
 			theEnlarger->SetFractTab(fractTab);
@@ -579,7 +1031,7 @@ bool EnlargerThread::ExecEnlarge(QImage *dstImg,  FractTab *fractTab) {
          return false;
       }
 
-	  resultFlag = theEnlarger->Enlarge(dstImg);
+	  resultFlag = theEnlarger->Enlarge(dstImg, writer);
       delete theEnlarger;
    }
    else {   // no alpha channel
@@ -592,7 +1044,7 @@ bool EnlargerThread::ExecEnlarge(QImage *dstImg,  FractTab *fractTab) {
      */
       ThColorEnlarger *theEnlarger=0;
       try {
-		 theEnlarger = new ThColorEnlarger (srcImg, eFormat, eParam, this);
+		 theEnlarger = new ThColorEnlarger (srcImg, eFormat, eParam, this, numWorkers);
          mutex.lock();
 		 if(fractTab != 0) {
 			theEnlarger->SetFractTab(fractTab);
@@ -604,7 +1056,7 @@ bool EnlargerThread::ExecEnlarge(QImage *dstImg,  FractTab *fractTab) {
          return false;
       }
 
-	  resultFlag = theEnlarger->Enlarge(dstImg);
+	  resultFlag = theEnlarger->Enlarge(dstImg, writer);
       delete theEnlarger;
    }
   return resultFlag;
@@ -30,74 +30,191 @@ along with this program; if not, see <http://www.gnu.org/licenses/>.
 #include <QMutex>
 #include <QWaitCondition>
 #include <QImage>
+#include <QAtomicInt>
+#include <vector>
+#include <memory>
 
 #include "ImageEnlargerCode/EnlargerTemplate.h"
 #include "ImageEnlargerCode/EnlargeParam.h"
+#include "ImageSource.h"
 
 class EnlargerThread;
 class FractTab;
+class BandWriter;
+class QSemaphore;
+
+// an enlarger handing out its dst-blocks (or shrink-bands) to several workers,
+// as tasks of the global QThreadPool shared by all enlargements: a worker is a chain of tasks,
+// each calls WorkOnBlocks once for one unit (a block, an analysis or a band), which tells if the chain goes on
+// (workEnded: none left or the calculation stopped). The tasks of one worker never run at once.
+// Between the blocks the pool runs the tasks of other enlargements, the higher PoolPriority first.
+// So a task must never wait: if its work can't be done yet, WorkOnBlocks returns workParked,
+// the chain stops until the source calls RestartBlockWorker for it
+enum BlockWorkState { workGoesOn, workEnded, workParked };
+
+class BlockWorkSource {
+public:
+   virtual ~BlockWorkSource(void) {}
+   virtual BlockWorkState WorkOnBlocks(int workerIdx) = 0;
+   virtual int  PoolPriority(void) = 0;
+};
 
-class ThColorEnlarger : public BasicEnlarger<Point> {
+// runs the numWorkers workers of src in the global QThreadPool,
+// returns after all workers are finished
+void RunBlockWorkers(BlockWorkSource *src, int numWorkers);
+// the same without waiting: each worker releases done once when it's finished
+void StartBlockWorkers(BlockWorkSource *src, int numWorkers, QSemaphore *done);
+// continues the chain of a parked worker
+void RestartBlockWorker(BlockWorkSource *src, int workerIdx, QSemaphore *done);
+
+// rough peak memory of enlarging & saving to dstName (see EnlargerThread::run): the decoded src,
+// the result (or the ring of bands of a streamed result), per worker an analysis context
+// (srcBlock with its ~10 analysis planes), a dstBlock & their scratch memory and the kernel tables
+double EstimatePeakBytes(const EnlargeFormat & format, bool hasAlpha, const QString & dstName, int numWorkers);
+// the workers an enlargement keeps busy: one per dst-block (shrinking: per band of rows)
+int UsefulWorkers(const EnlargeFormat & format, bool hasAlpha);
+
+// the block-machinery of the enlargers of an ImageSource into a 32bit QImage or BandWriter:
+// the workers, the ring of bands, progress & stop. The subclasses convert the pixels
+template<class T>
+class ThEnlarger : public BasicEnlarger<T>, public BlockWorkSource {
 
    EnlargerThread *myThread;
 
-   QImage srcImg, *dstImg;
+   QImage *dstImg;
+   uchar *dstBits;          // scanline data of dstImg, written by all workers
+   int    dstBytesPerLine;
+   int    dstRow0, dstRingRows;   // scanline of output-row r: (r - dstRow0) % dstRingRows
+
+   // the work: the analysis blocks in row-major order, each analysed once by a worker into a slot,
+   // then its blocks enlarged by any workers. The slots (analysis contexts) are bounded,
+   // a worker finding neither a block nor a free slot parks
+   struct AnalysisSlot {
+      BlockContext<T> *ac;
+      int analysis;             // index of the analysis block, -1: free
+      bool ready;               // analysed, its blocks are handed out
+      int x0, y0, numX;         // its blocks in the clipping: edge of the first, blocks per row
+      int numBlocks, nextBlock, blocksLeft;   // blocksLeft: not done yet
+   };
+   vector<AnalysisSlot> analysisSlots;
+   int numAnalysisX, numAnalysisY;
+   int nextAnalysis;
+
+   // streaming (bandWriter!=0): the blocks are written into a ring of ringBands bands
+   // (rows of analysis blocks), the finished bands are written in order by the calling (job)
+   // thread, not by the pool
+   BandWriter *bandWriter;
+   int ringBands, bandsWritten;
+   vector<int> bandAnalysesDone;  // per ring-slot
+   QMutex workMutex;              // protects the slots, nextAnalysis & the band-data
+   QWaitCondition bandReady;      // wakes the job thread waiting for the next band
+
+   int numWorkers;
+   QAtomicInt nextBlock;    // shrinking: next band to be fetched by a worker
+   QAtomicInt failed;       // set on stop or bad_alloc, lets all workers quit
+   QSemaphore *workersDone; // of the running workers, for restarting the parked ones
+   vector<int> parkedWorkers;   // protected by workMutex
+   bool shrinking;          // workers shrink bands of output-rows (scale < 1), not blocks
+   float progressStep;
+   vector<BlockContext<T> *> contexts;   // per worker, kept over its tasks
+   vector<ScratchArena *> shrinkScratch; // per worker while shrinking
+
+   // the whole pipeline for one dst-block of the analysis in ac, false if stopped
+   bool EnlargeDstBlock(BlockContext<T> & bc, BlockContext<T> & ac, int dstX, int dstY);
+   bool AnalyseBlock(AnalysisSlot & slot);   // false if stopped
+   BlockWorkState WorkOnShrinkBands(int workerIdx);
+   void DeleteContexts(void);
+   bool EnlargeBlocks(void);     // all blocks by the workers
+   bool ShrinkBands(void);       // scale < 1: all bands by the workers
+   bool EnlargeToWriter(void);
+   bool WriteBand(int band);
+   void WriteBands(void);
+   // with workMutex locked: the next work of a worker (a block of a slot, or a slot to analyse)
+   BlockWorkState FetchWork(AnalysisSlot *& slot, int & block);
+   void SlotDone(AnalysisSlot & slot);   // with workMutex locked
+   void Fail(void);
+   void RestartParked(void);     // with workMutex locked
+   void AddRandomNew(BlockContext<T> & bc);
+   void FractModify(BlockContext<T> & bc);
 
-   Timer t1,t2,tTotal;
+protected:
+   std::shared_ptr<const ImageSource> srcImg;   // read by all workers
 
+   uchar *DstLine(int dstCY) { return dstBits + qint64((dstCY - dstRow0) % dstRingRows)*dstBytesPerLine; }
+   // the margins outside the clip-rect, the images made for the result
+   virtual QRgb MarginColor(void) = 0;
+   virtual QImage::Format DstFormat(void) = 0;
 
 public:
-   ThColorEnlarger( const QImage & srcI, const EnlargeFormat & format, const EnlargeParameter & param, EnlargerThread *thread)
-	  :  BasicEnlarger<Point> (format, param), myThread(thread)
-   {
-      srcImg = srcI;
-   }
+   ThEnlarger( const std::shared_ptr<const ImageSource> & srcI, const EnlargeFormat & format, const EnlargeParameter & param,
+               EnlargerThread *thread, int workers=1)
+	  :  BasicEnlarger<T> (format, param), myThread(thread), bandWriter(0), numWorkers(workers), workersDone(0), shrinking(false), srcImg(srcI)
+   {}
+   ~ThEnlarger(void) { DeleteContexts(); }
 
    // Enlarge can be stopped by thread, gives progress to thread
-   bool Enlarge(QImage *dstI);
+   // with writer (streaming), dstI isn't used: the result is passed to the writer band by band
+   bool Enlarge(QImage *dstI, BandWriter *writer=0);
+   BlockWorkState WorkOnBlocks(int workerIdx);   // one block or one analysis
+   int  PoolPriority(void);
+};
+
+class ThColorEnlarger : public ThEnlarger<Point> {
+
+   QRgb MarginColor(void) { return qRgb(0,0,0); }
+   QImage::Format DstFormat(void) { return QImage::Format_RGB32; }
+
+public:
+   ThColorEnlarger( const std::shared_ptr<const ImageSource> & srcI, const EnlargeFormat & format, const EnlargeParameter & param,
+                    EnlargerThread *thread, int workers=1)
+	  :  ThEnlarger<Point> (srcI, format, param, thread, workers)
+   {}
 
    // those have to be implemented for communication between real src/dst and BasicEnlarger
    void ReadSrcPixel(int srcX, int srcY, Point & dstP);
    void WriteDstPixel(Point p, int dstCX, int dstCY);
-   void AddRandomNew(void);
-   void FractModify(void);
+   void ReadSrcSpan (int srcX, int srcY, int len, Point *dstSpan);
+   void WriteDstSpan(const Point *srcSpan, int len, int dstCX, int dstCY);
    void ColorToPoint(QRgb c, Point & p) {
 	  p.x = float(qRed  (c))*(1.0/255.0);
 	  p.y = float(qGreen(c))*(1.0/255.0);
 	  p.z = float(qBlue (c))*(1.0/255.0);
    }
+   void BytesToPoint(const uchar *c, Point & p) {
+	  p.x = float(c[0])*(1.0/255.0);
+	  p.y = float(c[1])*(1.0/255.0);
+	  p.z = float(c[2])*(1.0/255.0);
+   }
 };
 
-class ThColorEnlargerAlpha : public BasicEnlarger<Point4> {
-
-   EnlargerThread *myThread;
-
-   QImage srcImg, *dstImg;
-
-   Timer t1,t2,tTotal;
+class ThColorEnlargerAlpha : public ThEnlarger<Point4> {
 
+   QRgb MarginColor(void) { return qRgba(0,0,0,0); }
+   QImage::Format DstFormat(void) { return QImage::Format_ARGB32; }
 
 public:
-   ThColorEnlargerAlpha( const QImage & srcI, const EnlargeFormat & format, const EnlargeParameter & param, EnlargerThread *thread)
-	  :  BasicEnlarger<Point4> (format, param), myThread(thread)
-   {
-      srcImg = srcI;
-   }
-
-   // Enlarge can be stopped by thread, gives progress to thread
-   bool Enlarge(QImage *dstI);
+   ThColorEnlargerAlpha( const std::shared_ptr<const ImageSource> & srcI, const EnlargeFormat & format, const EnlargeParameter & param,
+                    EnlargerThread *thread, int workers=1)
+	  :  ThEnlarger<Point4> (srcI, format, param, thread, workers)
+   {}
 
    // those have to be implemented for communication between real src/dst and BasicEnlarger
    void ReadSrcPixel(int srcX, int srcY, Point4 & dstP);
    void WriteDstPixel(Point4 p, int dstCX, int dstCY);
-   void AddRandomNew(void);
-   void FractModify(void);
+   void ReadSrcSpan (int srcX, int srcY, int len, Point4 *dstSpan);
+   void WriteDstSpan(const Point4 *srcSpan, int len, int dstCX, int dstCY);
    void ColorToPoint(QRgb c, Point4 & p) {
 	  p.x = float(qRed  (c))*(1.0/255.0);
 	  p.y = float(qGreen(c))*(1.0/255.0);
 	  p.z = float(qBlue (c))*(1.0/255.0);
 	  p.w = float(qAlpha(c))*(1.0/255.0);
    }
+   void BytesToPoint(const uchar *c, Point4 & p) {   // r,g,b(,a)
+	  p.x = float(c[0])*(1.0/255.0);
+	  p.y = float(c[1])*(1.0/255.0);
+	  p.z = float(c[2])*(1.0/255.0);
+	  p.w = srcImg->PixelLayout() == ImageSource::rgbaBytes ? float(c[3])*(1.0/255.0) : 1.0f;
+   }
 };
 
 
@@ -106,18 +223,22 @@ class EnlargerThread : public QThread {
     Q_OBJECT
 private:
     QMutex mutex;  // protects the following data
-    QImage sourceImage;
+    std::shared_ptr<const ImageSource> source;
     float scaleF;
     EnlargeFormat    format;
     EnlargeParameter param;
     int quality;             // result image quality for QImage::save
     float progress;
+    int workers;             // block-workers of an enlargement, 0: one per core
+    int poolPriority;        // of its block-tasks in the shared pool (see BlockWorkSource)
 
     bool stopEnlarge;
     bool restartEnlarge;
     bool abort;
     bool saveAtEnd;
     QString dstFileName;
+    QString srcFileName;     // EnlargeFileAndSave: opened in run, else empty
+    int srcRawW, srcRawH;
 
     QWaitCondition waiter;
 
@@ -132,7 +253,21 @@ public:
 	void Enlarge(const QImage & src, const EnlargeFormat & f, const EnlargeParameter & p);
 	void EnlargeAndSave(const QImage & src, const EnlargeFormat & f, const EnlargeParameter & p,
 						 const QString & dstName, int resultQuality);
+	// src e.g. mapped from file (see ImageSource::Map)
+	void EnlargeAndSave(const std::shared_ptr<const ImageSource> & src, const EnlargeFormat & f,
+						 const EnlargeParameter & p, const QString & dstName, int resultQuality);
+	// the src is opened (decoded) by this thread, not by the caller; f from its header (see
+	// ImageSource::ReadSize). Then it's enlarged by the pool, while this thread is free to save
+	// the last result, and saved by this thread (the decoded src released before).
+	// sourceNotOpened() if it can't be opened or doesn't fit f
+	void EnlargeFileAndSave(const QString & srcName, const EnlargeFormat & f, const EnlargeParameter & p,
+							const QString & dstName, int resultQuality, int rawW=0, int rawH=0);
 	void SetParameter(const EnlargeParameter & p) { QMutexLocker locker(&mutex); param = p; }
+	// used from the next enlargement on, 0: one per core
+	void SetWorkers(int n) { QMutexLocker locker(&mutex); workers = n; }
+	// takes effect at the next block, higher first (e.g. the queue position)
+	void SetPoolPriority(int p) { QMutexLocker locker(&mutex); poolPriority = p; }
+	int  PoolPriority(void) { QMutexLocker locker(&mutex); return poolPriority; }
 
 	bool AddProgress(float pAdd) {
 		QMutexLocker locker(&mutex);
@@ -160,11 +295,12 @@ signals:
 	void badAlloc(void);
 	void imageNotSaved(void);
 	void imageSaved(int w, int h);
+	void sourceNotOpened(void);
 	void enlargeEnd(int myId);
 
 private:
 	void waitForRestart(void);
-	bool ExecEnlarge(QImage *dstImg, FractTab *fractTab);
+	bool ExecEnlarge(QImage *dstImg, FractTab *fractTab, BandWriter *writer=0);
 };
 
 #endif // ENLARGERTHREAD_H
@@ -56,6 +56,22 @@ public:
 
    float RandF(void) { return float((RandL()>>5)&65535) * (1.0 / 65535.0); } 
 
+   // restart the sequence at position (x,y): the following numbers depend
+   // only on seed and position, not on the numbers drawn before
+   void SetPos(long seed, int x, int y) {
+      unsigned int h = Mix(Mix(Mix((unsigned int)seed) ^ (unsigned int)x) ^ (unsigned int)y);
+      rx = long(h);
+      ry = long(Mix(h ^ 934021));
+   }
+
+private:
+   static unsigned int Mix(unsigned int h) {  // 32bit finalizer of MurmurHash3
+      h ^= h >> 16;  h *= 0x85ebca6bu;
+      h ^= h >> 13;  h *= 0xc2b2ae35u;
+      h ^= h >> 16;
+      return h;
+   }
+
  };
 
 class DirArray;
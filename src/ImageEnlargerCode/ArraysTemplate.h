@@ -25,24 +25,28 @@ along with this program; if not, see <http://www.gnu.org/licenses/>.
 #ifndef ARRAYS_TEMPLATE_H
 #define ARRAYS_TEMPLATE_H
 
+#include "ConstDefs.h"
+#include "ScratchArena.h"
+
 template<class T>
 class BasicArray {
    
    int sizeX,sizeY;
    T *buf;
+   bool ownBuf;     // false: buf is a window into another array (see SetView)
 public:
-   BasicArray(void)          : sizeX(0), sizeY(0)   { buf = 0; }
-   BasicArray(int sx,int sy) : sizeX(sx), sizeY(sy) { buf = new T[sizeX*sizeY]; }
+   BasicArray(void)          : sizeX(0), sizeY(0), ownBuf(true)   { buf = 0; }
+   BasicArray(int sx,int sy) : sizeX(sx), sizeY(sy), ownBuf(true) { buf = new T[Count()]; }
    BasicArray(BasicArray<T> & aSrc);
-   ~BasicArray(void) { if(buf!=0) delete[] buf; }
+   ~BasicArray(void) { if(buf!=0 && ownBuf) delete[] buf; }
 
    BasicArray<T> &operator= (BasicArray<T> & aSrc);
 
-   T     Get(int x, int y) const { return buf[ x + y*sizeX ]; }
-   void  Set(int x, int y, T p)     { buf[ x + y*sizeX ] =  p; }
-   void  Add(int x, int y, T p)     { buf[ x + y*sizeX ] += p; }
-   void  Sub(int x, int y, T p)     { buf[ x + y*sizeX ] -= p; }
-   void  Mul(int x, int y, float f) { buf[ x + y*sizeX ] *= f; }
+   T     Get(int x, int y) const { return buf[ x + pixIdx(y)*sizeX ]; }
+   void  Set(int x, int y, T p)     { buf[ x + pixIdx(y)*sizeX ] =  p; }
+   void  Add(int x, int y, T p)     { buf[ x + pixIdx(y)*sizeX ] += p; }
+   void  Sub(int x, int y, T p)     { buf[ x + pixIdx(y)*sizeX ] -= p; }
+   void  Mul(int x, int y, float f) { buf[ x + pixIdx(y)*sizeX ] *= f; }
    T     DX(int x, int y)  { return 0.5*(Get(x+1,y) - Get(x-1,y)); }
    T     DY(int x, int y)  { return 0.5*(Get(x,y+1) - Get(x,y-1)); }
    T     D2X(int x, int y) { return Get(x+1,y) + Get(x-1,y) - 2.0*Get(x,y); }
@@ -59,12 +63,31 @@ public:
    
    int SizeX(void) const { return sizeX; }
    int SizeY(void) const { return sizeY; }
+   pixIdx Count(void) const { return pixIdx(sizeX)*sizeY; }
    T *Buffer(void) { return buf; }
+   void Clear(void) { for(pixIdx i=0; i<Count(); i++) buf[i] = T(); }
    
    void ChangeSize(int sxNew, int syNew) {
       sizeX = sxNew; sizeY = syNew;
-      if(buf!=0) delete[] buf;
-      buf = new T[sizeX*sizeY];
+      if(buf!=0 && ownBuf) delete[] buf;
+      buf = new T[Count()];
+      ownBuf = true;
+   }
+   // other size within the own memory, no reallocation: sxNew*syNew <= the size allocated
+   void Reshape(int sxNew, int syNew) { sizeX = sxNew; sizeY = syNew; }
+   // use the memory of another array: (0,0) at b, rows of len rowLen (of the other array).
+   // Only for element access (Get, Set, ...), the whole-array methods need own memory
+   void SetView(T *b, int rowLen, int sy) {
+      if(buf!=0 && ownBuf) delete[] buf;
+      buf = b; sizeX = rowLen; sizeY = sy;
+      ownBuf = false;
+   }
+   // temp. array: memory from scratch if given (not initialized), else own
+   void TempSize(int sx, int sy, ScratchArena *scratch) {
+      if(scratch != 0)
+         SetView(scratch->Get<T>(pixIdx(sx)*sy), sx, sy);
+      else
+         ChangeSize(sx, sy);
    }
    void CopyFromArray(BasicArray<T> *srcArr, int srcX,int srcY);
    
@@ -76,6 +99,7 @@ public:
    }
    
    BasicArray<T> *SmoothDouble (void);
+   void SmoothDoubleInto(BasicArray<T> *dst, T *lines);   // dst: 2*sizeX x 2*sizeY, lines: 6*sizeX
    BasicArray<T> *SmoothDoubleTorus (void);
    BasicArray<T> *ShrinkHalf   (void);
    BasicArray<T> *Shrink       (int sizeXNew, int sizeYNew);
@@ -85,10 +109,10 @@ public:
    void AddArray (BasicArray<T> *arr);
    void SubArray (BasicArray<T> *arr);
    void MulArray (float f);
-   void Sharpen  (float f);
-   void Smoothen (void);
+   void Sharpen  (float f, ScratchArena *scratch = 0);
+   void Smoothen (void);       // like Smooth, but in place (the border stays)
    void Clamp01  (void);
-   void ReduceNoise(float reduceF);
+   void ReduceNoise(float reduceF, ScratchArena *scratch = 0);
    void HiSharpen (float f);
 
 
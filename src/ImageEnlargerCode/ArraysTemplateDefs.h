@@ -43,10 +43,10 @@ along with this program; if not, see <http://www.gnu.org/licenses/>.
 using namespace std;
 
 template<class T>
-BasicArray<T>::BasicArray(BasicArray<T> & aSrc) : sizeX(aSrc.sizeX) , sizeY(aSrc.sizeY) {
-   buf = new T[sizeX*sizeY];
+BasicArray<T>::BasicArray(BasicArray<T> & aSrc) : sizeX(aSrc.sizeX) , sizeY(aSrc.sizeY), ownBuf(true) {
+   buf = new T[Count()];
    
-   int a = sizeX*sizeY;
+   pixIdx a = Count();
    T *src = aSrc.buf, *dst = buf;
    while(a-- > 0) 
       *(dst++) = *(src++);
@@ -56,7 +56,7 @@ BasicArray<T>::BasicArray(BasicArray<T> & aSrc) : sizeX(aSrc.sizeX) , sizeY(aSrc
 template<class T>
 BasicArray<T> & BasicArray<T>::operator= (BasicArray<T> & aSrc) {
    ChangeSize(aSrc.sizeX, aSrc.sizeY);
-   int a = sizeX*sizeY;
+   pixIdx a = Count();
    T *src = aSrc.buf, *dst = buf;
    while(a-- > 0)
       *(dst++) = *(src++);
@@ -96,7 +96,7 @@ void BasicArray<T>::CopyFromArray(BasicArray<T> *srcArr, int srcX,int srcY) {
       
    while(sy < srcArr->sizeY - 1 && y<sizeY) {   
       x=0;sx=srcX;
-      src = srcArr->buf + sy*srcArr->sizeX;
+      src = srcArr->buf + pixIdx(sy)*srcArr->sizeX;
       if(sx>0)
          src += sx;
       // while dst outside: write src-edge-pixel
@@ -118,7 +118,7 @@ void BasicArray<T>::CopyFromArray(BasicArray<T> *srcArr, int srcX,int srcY) {
    // for outside-parts: copy pixels of last src-line
    while(y<sizeY) {   
       x=0;sx=srcX;
-      src = srcArr->buf + (srcArr->sizeY - 1)*srcArr->sizeX;
+      src = srcArr->buf + pixIdx(srcArr->sizeY - 1)*srcArr->sizeX;
       if(sx>0)
          src += sx;
       // while dst outside: write src-edge-pixel
@@ -241,38 +241,58 @@ BasicArray<T> *BasicArray<T>::ShrinkHalf(void) {
 }
 
 template<class T>
-void BasicArray<T>::Sharpen(float f) {
-   BasicArray<T> src(*this);
+void BasicArray<T>::Sharpen(float f, ScratchArena *scratch) {
    int x,y;
    
-   if(f==0.0)
+   if(f==0.0 || sizeX<3 || sizeY<3)
       return;
-      
+
+   // in place: only the unchanged rows y-1 and y are kept, row y+1 is still untouched
+   size_t mark = scratch != 0 ? scratch->Mark() : 0;
+   T *rows = scratch != 0 ? scratch->Get<T>(2*sizeX) : new T[2*sizeX];
+   T *r0 = rows, *r1 = rows + sizeX, *r2;
+
+   for(x=0; x<sizeX; x++) { r0[x] = buf[x]; r1[x] = buf[x + sizeX]; }
    for(y=1;y<sizeY-1;y++) {
+      T *lineNext = buf + pixIdx(y+1)*sizeX;
       for(x=1;x<sizeX-1;x++) {
          T l;
-		 l  = src.Get(x  , y-1) + src.Get(x-1, y  );
-		 l += src.Get(x+1, y  ) + src.Get(x  , y+1);
+		 l  = r0[x  ] + r1[x-1];
+		 l += r1[x+1] + lineNext[x];
          l*=2.0;
-		 l += src.Get(x-1, y-1) + src.Get(x+1, y-1);
-		 l += src.Get(x-1, y+1) + src.Get(x+1, y+1);
+		 l += r0[x-1] + r0[x+1];
+		 l += lineNext[x-1] + lineNext[x+1];
          l*=(1.0/12.0);
-		 l -= src.Get(x  , y  );
-		 l = src.Get(x  , y  ) - f*l;
+		 l -= r1[x];
+		 l = r1[x] - f*l;
          Set(x,y,l);
       }
+      r2 = r0; r0 = r1; r1 = r2;
+	  for(x=0; x<sizeX; x++) r1[x] = lineNext[x];
    }
+   if(scratch != 0)
+      scratch->Release(mark);
+   else
+      delete[] rows;
 }
 
 
 template<class T>
 BasicArray<T> *BasicArray<T>::SmoothDouble(void) {
    BasicArray<T> *newArray = new BasicArray<T>(sizeX*2,sizeY*2);
+   T *lines = new T[6*sizeX];
+   SmoothDoubleInto(newArray, lines);
+   delete[] lines;
+   return newArray;
+}
+
+template<class T>
+void BasicArray<T>::SmoothDoubleInto(BasicArray<T> *newArray, T *lines) {
    T *line0, *line1, *line2;
    
-   line0 = new T[2*sizeX];
-   line1 = new T[2*sizeX];
-   line2 = new T[2*sizeX];
+   line0 = lines;
+   line1 = lines + 2*sizeX;
+   line2 = lines + 4*sizeX;
 
 	ReadLineSmoothDouble(0,line1);
 	ReadLineSmoothDouble(0,line2);
@@ -298,10 +318,6 @@ BasicArray<T> *BasicArray<T>::SmoothDouble(void) {
 		 newArray->Set(x, 2*y+1 , p);
       }
    }
-   delete[] line0;
-   delete[] line1;
-   delete[] line2;
-   return newArray;
 }
 
 template<class T>
@@ -309,7 +325,7 @@ void BasicArray<T>::ReadLineSmoothDouble(int y,T *line) {
    int x;
    T *src,p0,p1,p2;
    
-   src = buf + y*sizeX;
+   src = buf + pixIdx(y)*sizeX;
    p0 = *src;
    p1 = *src;
    p2 = *(src+1);
@@ -374,7 +390,7 @@ void BasicArray<T>::ReadLineSmoothDoubleTorus(int y,T *line) {
    int x;
    T *src,p0,p1,p2;
    T *pFirst, *pLast;
-   pFirst = buf + y*sizeX;
+   pFirst = buf + pixIdx(y)*sizeX;
    pLast  = pFirst + sizeX-1;
 
    src = pFirst;
@@ -420,19 +436,28 @@ BasicArray<T> *BasicArray<T>::Smooth(void) {
 template<class T>
 void BasicArray<T>::Smoothen(void) {
    int x,y;
-   BasicArray<T> src(*this);
+   if(sizeX<3 || sizeY<3)
+      return;
+   // in place: only the unchanged rows y-1 and y are kept, row y+1 is still untouched
+   T *rows = new T[2*sizeX];
+   T *r0 = rows, *r1 = rows + sizeX, *r2;
 
+   for(x=0; x<sizeX; x++) { r0[x] = buf[x]; r1[x] = buf[x + sizeX]; }
    for (y=1; y<sizeY-1; y++)   {
+      T *lineNext = buf + pixIdx(y+1)*sizeX;
 	  for (x=1; x<sizeX-1; x++)   {
          T pSmooth;
          
-         pSmooth  =       src.Get(x-1,y-1) + 2.0*src.Get(x  ,y-1) + src.Get(x+1,y-1);
-		 pSmooth += 2.0*(src.Get(x-1,y ) + 2.0*src.Get(x  ,y ) + src.Get(x+1,y ));
-         pSmooth +=       src.Get(x-1,y+1) + 2.0*src.Get(x  ,y+1) + src.Get(x+1,y+1);
+         pSmooth  =       r0[x-1] + 2.0*r0[x] + r0[x+1];
+		 pSmooth += 2.0*(r1[x-1] + 2.0*r1[x] + r1[x+1]);
+         pSmooth +=       lineNext[x-1] + 2.0*lineNext[x] + lineNext[x+1];
          pSmooth*=0.0625;
          Set(x,y,pSmooth);
       }
+      r2 = r0; r0 = r1; r1 = r2;
+	  for(x=0; x<sizeX; x++) r1[x] = lineNext[x];
    }
+   delete[] rows;
 }
 
 template<class T>
@@ -594,7 +619,7 @@ void BasicArray<T>::HiSharpen(float f) {
 
          dd = 10.0*f*dd;
          if(dd>1.0)dd=1.0;
-         dd = pow_f(dd,2.0);
+         dd = sqr_f(dd);
          //dd = dd*dd*(3.0 - 2.0*dd);
 
          ff = c.Norm1();
@@ -605,8 +630,8 @@ void BasicArray<T>::HiSharpen(float f) {
 }
 
 template<class T>
-void BasicArray<T>::ReduceNoise(float reduceF) {
-   BasicArray<T> *hiF,*loF;
+void BasicArray<T>::ReduceNoise(float reduceF, ScratchArena *scratch) {
+   BasicArray<T> hiF,loArr,loSmooth;
    int x,y;
    int sizeX = SizeX(), sizeY = SizeY();
 
@@ -614,15 +639,43 @@ void BasicArray<T>::ReduceNoise(float reduceF) {
       return;
    reduceF =1.0/reduceF;
 
-   hiF = new BasicArray<T>(*this);
-   loF = hiF->SplitLowFreq(1);
+   // hiF = this - low frequencies, as SplitLowFreq(1) but with temp. arrays
+   size_t mark = scratch != 0 ? scratch->Mark() : 0;
+   int loX = (sizeX+2)>>1, loY = (sizeY+2)>>1;
+   hiF.TempSize(sizeX, sizeY, scratch);
+   loArr.TempSize(loX, loY, scratch);
+   loSmooth.TempSize(2*loX, 2*loY, scratch);
+   T *lines = scratch != 0 ? scratch->Get<T>(6*loX) : new T[6*loX];
+
+   for (y=0; y<loY; y++)   {
+	  for (x=0; x<loX; x++)   {
+		 loArr.Set(x,y, T(0.0));
+      }
+   }
+   for (y=0; y<sizeY; y++)   {
+	  for (x=0; x<sizeX; x++)   {
+         loArr.Add(x>>1,y>>1,Get(x,y));
+      }
+   }
+   float fFakt = 1.0/float(1<<2);
+   for (y=0; y<loY; y++)   {
+	  for (x=0; x<loX; x++)   {
+		 loArr.Set(x,y, loArr.Get(x,y)*fFakt);
+      }
+   }
+   loArr.SmoothDoubleInto(&loSmooth, lines);
+   for (y=0; y<sizeY; y++)   {
+	  for (x=0; x<sizeX; x++)   {
+         hiF.Set(x,y, Get(x,y) - loSmooth.Get(x,y));
+      }
+   }
 
    for(y=0;y<sizeY;y++) {
       for(x=0;x<sizeX;x++) {
          T p;
          float w,dd;
 
-         p = hiF->Get(x,y);
+         p = hiF.Get(x,y);
          dd = p.Norm1() * 5.0*reduceF;
          if(dd<1.0) {
             w = dd;
@@ -642,8 +695,10 @@ void BasicArray<T>::ReduceNoise(float reduceF) {
          }
       }
    }
-   delete hiF;
-   delete loF;
+   if(scratch != 0)
+      scratch->Release(mark);
+   else
+      delete[] lines;
 }
 
 #endif
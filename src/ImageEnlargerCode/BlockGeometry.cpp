@@ -0,0 +1,117 @@
+/* ----------------------------------------------------------------
+
+SmillaEnlarger  -  resize, especially magnify bitmaps in high quality
+    BlockGeometry.cpp: choice of the block lens for a scale factor
+
+Copyright (C) 2009 Mischa Lusteck
+Copyright (C) 2017 Alejandro Sirgo
+
+This program is free software;
+you can redistribute it and/or modify it under the terms of the
+GNU General Public License as published by the Free Software Foundation;
+either version 3 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+---------------------------------------------------------------------- */
+
+#include <mutex>
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+#include "ConstDefs.h"
+#include "BlockGeometry.h"
+
+const long  defaultCacheL2   = 1024*1024;
+const long  blockCacheFakt   = 4;      // working set of a block <= blockCacheFakt * L2:
+                                       // the block-passes are streams, L2-misses are prefetched,
+                                       // but a dstBlock beyond L3 is expensive
+const int   windowMargin     = 3;      // src-window of a block around its BigPixels
+const float minAnalysisSrc   = 128.0;  // src-len of an analysis block, if not longer than maxAnalysisExp
+
+int ChooseAnalysisExp(float invScaleX, float invScaleY) {
+   int e;
+
+   for(e = blockExp; e < maxAnalysisExp; e++) {
+      float len = float(1<<e);
+	  if(invScaleX*len >= minAnalysisSrc && invScaleY*len >= minAnalysisSrc)
+         break;
+   }
+   return e;
+}
+
+int ChooseBlockExp(float invScaleX, float invScaleY, int bytesPerSrcPixel, int bytesPerDstPixel,
+                   long cacheBytes) {
+   int e;
+
+   // biggest block whose working set still fits
+   for(e = maxBlockExp; e > minBlockExp; e--) {
+      float len  = float(1<<e);
+      float srcX = invScaleX*len + float(2*windowMargin);
+      float srcY = invScaleY*len + float(2*windowMargin);
+      float workingSet = srcX*srcY*float(bytesPerSrcPixel) + len*len*float(bytesPerDstPixel);
+	  if(workingSet <= float(blockCacheFakt*cacheBytes))
+         break;
+   }
+   return e;
+}
+
+long CacheSizeL2(void) {
+   static long cacheSize = 0;
+
+   if(cacheSize == 0) {
+      long s = 0;
+#ifdef _SC_LEVEL2_CACHE_SIZE
+      s = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+	  cacheSize = s > 0 ? s : defaultCacheL2;
+   }
+   return cacheSize;
+}
+
+// the autotuned block exps, for the last few scale factors
+struct TunedEntry {
+   float invScaleX, invScaleY;
+   int bytesPerSrcPixel;
+   int exp;
+};
+
+const int tunedListLen = 16;
+static TunedEntry tunedList[tunedListLen];
+static int tunedNum = 0, tunedNext = 0;
+static std::mutex tunedMutex;
+static bool autotuneOn = false;
+
+void SetBlockAutotune(bool on) { autotuneOn = on; }
+bool BlockAutotune(void) { return autotuneOn; }
+
+bool TunedBlockExp(float invScaleX, float invScaleY, int bytesPerSrcPixel, int & blockExpOut) {
+   std::lock_guard<std::mutex> lock(tunedMutex);
+   for(int a=0; a<tunedNum; a++) {
+      const TunedEntry & t = tunedList[a];
+	  if(t.invScaleX == invScaleX && t.invScaleY == invScaleY && t.bytesPerSrcPixel == bytesPerSrcPixel) {
+         blockExpOut = t.exp;
+         return true;
+      }
+   }
+   return false;
+}
+
+void SetTunedBlockExp(float invScaleX, float invScaleY, int bytesPerSrcPixel, int tunedExp) {
+   std::lock_guard<std::mutex> lock(tunedMutex);
+   TunedEntry & t = tunedList[tunedNext];
+   t.invScaleX = invScaleX;
+   t.invScaleY = invScaleY;
+   t.bytesPerSrcPixel = bytesPerSrcPixel;
+   t.exp = tunedExp;
+   tunedNext = (tunedNext + 1) % tunedListLen;
+   if(tunedNum < tunedListLen)
+      tunedNum++;
+}
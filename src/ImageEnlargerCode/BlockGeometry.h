@@ -0,0 +1,53 @@
+/* ----------------------------------------------------------------
+
+SmillaEnlarger  -  resize, especially magnify bitmaps in high quality
+    BlockGeometry.h: choice of the block lens for a scale factor
+
+Copyright (C) 2009 Mischa Lusteck
+Copyright (C) 2017 Alejandro Sirgo
+
+This program is free software;
+you can redistribute it and/or modify it under the terms of the
+GNU General Public License as published by the Free Software Foundation;
+either version 3 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+---------------------------------------------------------------------- */
+
+#ifndef BLOCK_GEOMETRY_H
+#define BLOCK_GEOMETRY_H
+
+// The analysis (derivatives, weights, deNoise, sharpen) is calculated once per analysis block
+// (see ConstDefs.h), all dstBlocks in it read it. Its srcBlock has margins of srcBlockMargin,
+// at high zoom they are a big part of a short srcBlock: ChooseAnalysisExp takes longer
+// analysis blocks there, until they cover 128 src-pixels per row (at most 2^maxAnalysisExp).
+int ChooseAnalysisExp(float invScaleX, float invScaleY);
+
+// A dstBlock of len L reads L/scale + few pixels of the analysis, the image doesn't depend on L.
+// Big blocks don't fit in the cache: dstBlock at high zoom, the src-planes at low zoom.
+// ChooseBlockExp takes the biggest block whose working set is bounded by cacheBytes,
+// at most maxBlockExp. The result depends only on the scale (not on the clipping),
+// so preview and final image use the same blocks.
+int ChooseBlockExp(float invScaleX, float invScaleY, int bytesPerSrcPixel, int bytesPerDstPixel,
+                   long cacheBytes);
+
+// size of the L2-cache of one core, a default if it can't be found out
+long CacheSizeL2(void);
+
+// Autotune: instead of ChooseBlockExp the enlarger times a sample block for some block lens.
+// Off by default: the chosen block len then depends on the machine & its load.
+// The result is kept for each scale factor, so all enlargements of a scale use the same.
+void SetBlockAutotune(bool on);
+bool BlockAutotune(void);
+bool TunedBlockExp(float invScaleX, float invScaleY, int bytesPerSrcPixel, int & blockExpOut);
+void SetTunedBlockExp(float invScaleX, float invScaleY, int bytesPerSrcPixel, int tunedExp);
+
+#endif // BLOCK_GEOMETRY_H
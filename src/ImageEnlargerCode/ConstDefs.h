@@ -23,10 +23,15 @@ along with this program; if not, see <http://www.gnu.org/licenses/>.
 ---------------------------------------------------------------------- */
 
 #include <math.h>
+#include <cstddef>
 
 #ifndef CONST_DEFS_H
 #define CONST_DEFS_H
 
+// pixel counts & offsets within whole images (beyond 46k x 46k they exceed int;
+// long is only 32 bit on win64)
+typedef std::ptrdiff_t pixIdx;
+
 #ifndef PI
 const double PI = 3.14159265358979323846;
 #endif
@@ -34,9 +39,19 @@ const double PI = 3.14159265358979323846;
 const int enExp = 3 ;
 const int enLen = (1<<enExp) ;
 
-const int blockExp = 9;               // len of dstBlock
-const int blockLen = (1<<blockExp);
+const int blockExp = 9;               // the analysis blocks: deNoise, sharpen & weights are calculated
+const int blockLen = (1<<blockExp);   // once on the srcBlocks of the dst-grid of this len, at high zoom
+const int maxAnalysisExp = 10;        // up to 2^maxAnalysisExp. The dstBlocks are parts of them, their
+const int minBlockExp = 6;            // len depends on the scale factor (see BlockGeometry.h), not the image
+const int maxBlockExp = blockExp;
+const int maxBlockLen = (1<<maxBlockExp);
 const int srcBlockMargin = 9;        // srcBlock contains additional margins of borderPixels
+const int analysisHalo = 16;         // even, > range of the analysis-filters (12)
+const long ditherSeed = 635017;      // dither noise depends only on this and the dst-position
+const int quadRestartExp = 4;        // quadrics are incremented along a row, recalculated every
+const int quadRestartLen = (1<<quadRestartExp);   // quadRestartLen pixels (divides each block len)
+const int shrinkBandRows = 64;       // shrinking: output-rows per band (unit of the workers)
+const float shrinkPrefilterMax = 0.125;  // shrinking below: average 2x2 src pixels first (repeatedly)
 
 const float similPeakThinness   = 8.0 ;      // sharper peak at 0.0 -> others are less similar
 const float similPeakFlatness   = 1.5 ;      //
@@ -56,6 +71,7 @@ const int diffTabLen = 1000;
 const int invTabLen  = 10000;
 
 inline float pow_f(float a,float b) {return (float)pow(a,b); }
+inline float sqr_f(float a) {return a*a; }   // = pow_f(a,2.0), exact
 
 
 #endif
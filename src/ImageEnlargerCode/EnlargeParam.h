@@ -71,8 +71,9 @@ public:
    void SetSrcSize(int w, int h) { srcWidth = w; srcHeight = h; }
    void SetScaleFact(float f) { scaleX = scaleY = f; SetFullClip(); }
    void SetScaleFact(float fx, float fy) { scaleX = fx; scaleY = fy; SetFullClip(); }
-   int  DstWidth (void) const { return int(float(srcWidth) *scaleX + 0.5); }
-   int  DstHeight(void) const { return int(float(srcHeight)*scaleY + 0.5); }
+   // in double: a float product is off by pixels beyond 2^24
+   int  DstWidth (void) const { return int(double(srcWidth) *scaleX + 0.5); }
+   int  DstHeight(void) const { return int(double(srcHeight)*scaleY + 0.5); }
    void SetDstClip(int cx0, int cy0, int cx1, int cy1) { clipX0=cx0; clipY0=cy0; clipX1=cx1; clipY1=cy1; }
    void SetSrcClip(float sx0, float sy0, float sx1, float sy1) {
 	  clipX0 = int(scaleX*sx0),  clipY0 = int(scaleY*sy0);
@@ -26,18 +26,111 @@ along with this program; if not, see <http://www.gnu.org/licenses/>.
 #define ENLARGER_TEMPLATE_H
 
 #include <iostream>
+#include <atomic>
 #include "ConstDefs.h"
 #include "Array.h"
 #include "PointClass.h"
 #include "FractTab.h"
 #include "EnlargeParam.h"
+#include "SelectKernel.h"
+#include "PlanarArray.h"
+#include "BlockGeometry.h"
+#include "ScratchArena.h"
+#include "KernelTab.h"
+#include "SetupCache.h"
 #include "timing.h"
 
 using namespace std;
 
-const long smallToBigMargin = blockLen + 40;     // need values<0,>size in smallToBigTabs
 
-// BasicEnlarger contains the algorithm, applied on srcBlock and dstBlock
+template<class T> class BasicEnlarger;
+
+// BlockContext contains the working set of one block:
+// srcBlock, dstBlock, the derivatives & weights calculated from srcBlock
+// and the helper-matrices of the current 5x5 BigPixels.
+// An analysis context holds the srcBlock of an analysis block & its analysis (no dstBlock),
+// the block contexts of its blocks only read it (their src-arrays are views, see BlockBegin).
+// Each worker enlarging blocks owns one block context,
+// the BasicEnlarger itself keeps only the shared read-only tables
+// (kernels, invTab, diffTabs, fractTab)
+
+template<class T>
+class BlockContext {
+   friend class BasicEnlarger<T>;
+
+   BasicArray<T> *srcBlock;    // srcBlock contains additional margins of borderPixels
+   PlanarArray<T> *dstBlock;   // planar: the smoothing passes run on contiguous channel-rows
+
+   int dstBlockEdgeX,dstBlockEdgeY;                   // smallPos of upper left edge of DstBlock
+   int srcBlockEdgeX,srcBlockEdgeY;                   // bigPos of upper left edge of   SrcBlock
+   int srcWinX, srcWinY;                              // its offset within the srcBlock of the analysis block
+   int dstMinBX, dstMinBY;
+   int dstMaxBX, dstMaxBY;                            // clipped part of the current block
+
+   RandGen  *randGen;
+   ScratchArena *scratch;    // temp. buffers of the block-passes: no allocation per block
+
+   // Before Enlarging, calculate the importance of each BigPixel in Block
+   //
+   // similWeights: big weight, if similar to neighbours
+   // border pixels are less important
+   //
+   // indieWeights: important are also pixels, which are totally
+   // independent from most neighbours, e.g single specs or thin lines in front of
+   // background of different color
+   MyArray *baseWeights;
+   MyArray *workMask;     // decides, if anything is to be done within bigPixel (smoothed -> multiply)
+   MyArray *workMaskDst;  // workMaskDst: smooth-enlarged
+   MyArray *baseParams;
+   BasicArray<T>  *dX, *dY, *d2X, *d2Y, *dXY, *d2L;   // get modified Gradient, 2nd Deriv, Laplace
+   MyArray *baseIntensity;
+
+   // Helper-Matrices containing values and weights of the current 5x5 BigPixels
+   T      bigPixelColor [5*5];
+   float  bigPixelWeight[5*5];
+   float  bigPixelIntensity[5*5];
+   float  bigPixelCenterW[5*5];  // increased weight near pixel-center dep. of d2L
+
+   T      bigPixelDX    [5*5];
+   T      bigPixelDY    [5*5];
+   T      bigPixelD2X   [5*5];
+   T      bigPixelD2Y   [5*5];
+   T      bigPixelDXY   [5*5];
+
+   T      bigPixelD2L   [5*5];
+
+   // for FractNoise: random kernel center pos & center val for fract deform kernels
+   int    bigPixelFractCX  [ 5*5 ];
+   int    bigPixelFractCY  [ 5*5 ];
+   float  bigPixelFractCVal[ 5*5 ];
+
+   // color, weights & quadrics of the 5x5 BigPixels as planes, for SelectNeighColor
+   NeighPlanes neigh;
+
+public:
+   BlockContext(int sizeSrcBlockX, int sizeSrcBlockY, int sizeDstBlock, size_t scratchBytes);
+   ~BlockContext(void);
+
+   int DstMinBX(void) const { return dstMinBX; }
+   int DstMaxBX(void) const { return dstMaxBX; }
+   int DstMinBY(void) const { return dstMinBY; }
+   int DstMaxBY(void) const { return dstMaxBY; }
+   int SrcBlockEdgeX(void) const { return srcBlockEdgeX; }
+   int SrcBlockEdgeY(void) const { return srcBlockEdgeY; }
+   int DstBlockEdgeX(void) const { return dstBlockEdgeX; }
+   int DstBlockEdgeY(void) const { return dstBlockEdgeY; }
+
+   BasicArray<T> *SrcBlock(void) { return srcBlock; }
+   PlanarArray<T> *DstBlock(void) { return dstBlock; }
+   ScratchArena *Scratch(void) { return scratch; }
+
+   // dither-noise for dst-pixel (dstBX,dstBY) of the block: seed the generator by the
+   // absolute position, so the noise is the same in any block order or clipping
+   void RandPos(int dstBX, int dstBY) { randGen->SetPos(ditherSeed, dstBX + dstBlockEdgeX, dstBY + dstBlockEdgeY); }
+   float RandF(void) { return randGen->RandF(); }
+};
+
+// BasicEnlarger contains the algorithm, applied on srcBlock and dstBlock of a BlockContext
 // a derived real enlarger has to implement
 //      void ReadCurrentBlock(int dstXEdge,int dstYEdge);
 //      for reading a block from the source
@@ -47,14 +140,14 @@ const long smallToBigMargin = blockLen + 40;     // need values<0,>size in small
 // Thus BasicEnlarger is independent from format, data type of source, destination
 // It needs only the size and scaleFactor,
 // and clipping, parameters
+// The block-methods only read the shared tables of the BasicEnlarger,
+// so different blocks can be enlarged at the same time with one BlockContext each.
 // There is no global enlarge-method, this has to be written in the derived enlarger-classes,
 // using EnlargeBlock
 
 template<class T>
 class BasicEnlarger {
 
-   BasicArray<T> *srcBlock, *dstBlock;  // srcBlock contains additional margins of borderPixels
-
    float scaleFaktX,invScaleFaktX;
    float scaleFaktY,invScaleFaktY;
    int sizeX,sizeY;
@@ -85,62 +178,41 @@ class BasicEnlarger {
    //--------- Helper-Objects -----------
    //
 
-   // Enlarging is done blockwise
+   // Enlarging is done blockwise, each block in its own BlockContext
    int sizeSrcBlockX, sizeSrcBlockY;
    int sizeDstBlock;
-   int dstBlockEdgeX,dstBlockEdgeY;                   // smallPos of upper left edge of DstBlock
-   int srcBlockEdgeX,srcBlockEdgeY;                   // bigPos of upper left edge of   SrcBlock
-   int dstMinBX, dstMinBY;
-   int dstMaxBX, dstMaxBY;                            // clipped part of the current block
+   int analysisLen;                              // dst-len of the analysis blocks (see BlockGeometry.h)
+   int sizeAnalysisBlockX, sizeAnalysisBlockY;   // srcBlock of an analysis block
+   std::atomic<pixIdx> analysedPixels;           // srcBlock-pixels analysed so far
+
+   // Shrinking: the src is reduced first by averaging shrinkFX x shrinkFY pixels
+   // (large reduction factors), the box-filter works on this reduced src.
+   // The weights of its columns & the state of the box-filter at each row are calculated
+   // once, so the output-rows can be shrunk in independent bands (see ShrinkBand)
+   int   shrinkFX, shrinkFY;            // prefilter: averaged src pixels, power of 2
+   int   shrinkSizeX, shrinkSizeY;      // size of the reduced src
+   float shrinkScaleX, shrinkScaleY;    // scale of the reduced src
+   int   shrinkSrcX0, shrinkSrcX1;      // its columns contributing to the clip
+   int   shrinkSrcY0, shrinkSrcY1;      // its rows
+   int   *shrinkColDst;     // per column: dstPixel, weight for it & for the next one (>0: step)
+   float *shrinkColW0, *shrinkColW1;
+   int   *shrinkRowDst;     // per row: dstLine & its floor before adding the row
+   float *shrinkRowFloor;
 
-   RandGen  *randGen;
    FractTab *fractTab;      // used for deforming kernels
-   float *selectDiffTab;
-   float *centerWeightTab;  // weight multiplied with factor increasing near center of bigPixel
-   float *invTab;           // table for x -> 1/x (for inner loop)
-   int   *smallToBigTabX;   // tables for mapping small/dst-pixels to big/src-pixels
-   int   *smallToBigTabY;   //
-
-   // Before Enlarging, calculate the importance of each BigPixel in Block
-   //
-   // similWeights: big weight, if similar to neighbours
-   // border pixels are less important
-   //
-   // indieWeights: important are also pixels, which are totally
-   // independent from most neighbours, e.g single specs or thin lines in front of
-   // background of different color
-   MyArray *baseWeights;
-   MyArray *workMask;     // decides, if anything is to be done within bigPixel (smoothed -> multiply)
-   MyArray *workMaskDst;  // workMaskDst: smooth-enlarged
-   MyArray *baseParams;
-   BasicArray<T>  *dX, *dY, *d2X, *d2Y, *dXY, *d2L;   // get modified Gradient, 2nd Deriv, Laplace
-   MyArray *baseIntensity;
+   // the tables below are shared with other enlargers (see SetupCache.h)
+   std::shared_ptr<const DiffTabs> diffTabs;
+   const float *selectDiffTab;
+   const float *centerWeightTab;  // weight multiplied with factor increasing near center of bigPixel
+   const float *invTab;           // table for x -> 1/x (for inner loop)
 
    // for each smallPixelPos calc. kernels for smooth-enlarging
-   // and for selecting of neigh. BigPixels
-   float **enlargeKernelX;
-   float **enlargeKernelY;
-   float **selectKernelX;    // 5-Kernel , multiply kx*ky
-   float **selectKernelY;
-
-   // Helper-Matrices containing values and weights of the current 5x5 BigPixels
-   T      bigPixelColor [5*5];
-   float  bigPixelWeight[5*5];
-   float  bigPixelIntensity[5*5];
-   float  bigPixelCenterW[5*5];  // increased weight near pixel-center dep. of d2L
-
-   T      bigPixelDX    [5*5];
-   T      bigPixelDY    [5*5];
-   T      bigPixelD2X   [5*5];
-   T      bigPixelD2Y   [5*5];
-   T      bigPixelDXY   [5*5];
-
-   T      bigPixelD2L   [5*5];
-
-   // for FractNoise: random kernel center pos & center val for fract deform kernels
-   int    bigPixelFractCX  [ 5*5 ];
-   int    bigPixelFractCY  [ 5*5 ];
-   float  bigPixelFractCVal[ 5*5 ];
+   // and for selecting of neigh. BigPixels (only the clipping and its blocks)
+   std::shared_ptr<const DirKernels> kernelsX, kernelsY;
+   const KernelTab *enlargeKernelX;
+   const KernelTab *enlargeKernelY;
+   const KernelTab *selectKernelX;    // 5-Kernel , multiply kx*ky
+   const KernelTab *selectKernelY;
 
 public:
    BasicEnlarger(const EnlargeFormat & format, const EnlargeParameter & param);
@@ -158,6 +230,9 @@ public:
    void SetDither(float pD)      { ditherF = pD;     }
    void SetFractNoise(float fN)  { fractNoiseF = fN; }
    void SetFractTab(FractTab *fT){ fractTab = fT; }
+   // time a sample block for some block lens, use the fastest (see BlockGeometry.h)
+   // call before creating the BlockContexts, needs the src & the fractTab
+   void AutotuneBlockLen(void);
 
    int SizeDstX(void) const { return sizeXDst; }
    int SizeDstY(void) const { return sizeYDst; }
@@ -166,30 +241,63 @@ public:
 
    float Dither(void)     { return ditherF;     }
    float FractNoise(void) { return fractNoiseF; }
+   // src-pixels read & analysed (deNoise, sharpen, weights) so far, also by AutotuneBlockLen
+   pixIdx AnalysedPixels(void) const { return analysedPixels.load(); }
 
 protected:
     // the methods for Enlarge, protected for use in class with calc-thread-design
 
    // the read & write methods,
    // normally only ReadSrcPixel & WriteDstPixel have to be implemented in real enlarger
-   // these are used by the predefined Block & Line Read/Write methods
+   // these are used by the predefined Block & Line Read/Write methods.
+   // For speed, a real enlarger should also implement ReadSrcSpan & WriteDstSpan
+   // (len pixels of one row, always inside src/dst), the defaults use the pixel-methods
    virtual void ReadSrcPixel(int, int, T &) {}
    virtual void WriteDstPixel(T p, int dstCX, int dstCY)   {}
-   virtual void ReadSrcBlock(void);
-   virtual void WriteDstBlock(void);
-   virtual void ReadSrcLine (int srcY, T *srcLine);  // read & write line: for case of shrinking
-   virtual void WriteDstLine(int dstY, T *dstLine);
-
-   void BlockBegin(int dstXEdge,int dstYEdge);  // calculate positions, clipping
-   void CalcBaseWeights(void);             // calc indie & simil Weights for BigPixels
-   void BlockEnlargeSmooth(void);
-   void AddRandom(void);
-   void EnlargeBlock(void);
-   void EnlargeBlockPart(int syStart, int syEnd);  // used for splitting up EnlargeBlock (-> calc thread)
-   void MaskBlockEnlargeSmooth(void);     // Smooth-Enlarging Mask-Field
+   virtual void ReadSrcSpan (int srcX, int srcY, int len, T *dstSpan);
+   virtual void WriteDstSpan(const T *srcSpan, int len, int dstCX, int dstCY);
+   virtual void ReadSrcBlock(BlockContext<T> & bc);
+   virtual void WriteDstBlock(BlockContext<T> & bc);
+   virtual void WriteDstLine(int dstY, T *dstLine);  // write line: for case of shrinking
+
+   // the contexts for the block-methods: one for each analysis block in progress,
+   // one for each worker enlarging its blocks
+   BlockContext<T> *NewAnalysisContext(void) {
+      return new BlockContext<T>(sizeAnalysisBlockX, sizeAnalysisBlockY, 0,
+                                 ScratchBytes(sizeAnalysisBlockX, sizeAnalysisBlockY, 0));
+   }
+   BlockContext<T> *NewBlockContext(void) {
+      return new BlockContext<T>(0, 0, sizeDstBlock, ScratchBytes(0, 0, sizeDstBlock));
+   }
 
-   // Shrinking (scaleF < 1.0)
+   // the analysis block at (dstXEdge,dstYEdge): its srcBlock, as far as its blocks in the clipping need it
+   void AnalysisBegin(BlockContext<T> & ac, int dstXEdge,int dstYEdge) {
+      AnalysisBegin(ac, dstXEdge, dstYEdge, clipX0, clipY0, clipX1, clipY1);
+   }
+   // read srcBlock, deNoise, sharpen, calc derivatives & weights
+   void AnalyseSrcBlock(BlockContext<T> & ac);
+   // a block of the analysis block analysed in ac: calculate positions, clipping.
+   // bc reads the analysis of ac, which must stay unchanged until the block is done
+   void BlockBegin(BlockContext<T> & bc, int dstXEdge,int dstYEdge, BlockContext<T> & ac) {
+      BlockBegin(bc, dstXEdge, dstYEdge, clipX0, clipY0, clipX1, clipY1, ac);
+   }
+   void CalcBaseWeights(BlockContext<T> & bc);             // calc indie & simil Weights for BigPixels
+   void BlockEnlargeSmooth(BlockContext<T> & bc);
+   void AddRandom(BlockContext<T> & bc);
+   void EnlargeBlock(BlockContext<T> & bc);
+   void EnlargeBlockPart(BlockContext<T> & bc, int syStart, int syEnd);  // used for splitting up EnlargeBlock (-> calc thread)
+   void MaskBlockEnlargeSmooth(BlockContext<T> & bc);     // Smooth-Enlarging Mask-Field
+
+   // Shrinking (scaleF < 1.0): ShrinkClip shrinks the whole clip-rect.
+   // Or for several workers: BeginShrink, then ShrinkBand for each band (in any order,
+   // in parallel, each worker with its own scratch of ShrinkScratchBytes), EndShrink.
+   // The result doesn't depend on the order or the workers.
    void ShrinkClip(void);
+   void BeginShrink(void);
+   void EndShrink(void);
+   int  NumShrinkBands(void) const { return (clipY1 - clipY0 + shrinkBandRows - 1) / shrinkBandRows; }
+   void ShrinkBand(int band, ScratchArena & scratch);
+   size_t ShrinkScratchBytes(void) const;   // the line-buffers of a band, after BeginShrink
    float ScaleFaktX(void) { return scaleFaktX; }
    float ScaleFaktY(void) { return scaleFaktY; }
 
@@ -200,24 +308,26 @@ protected:
    int ClipY1 (void) const { return clipY1; }
    int OutputWidth (void) const { return outputWidth; }
    int OutputHeight(void) const { return outputHeight; }
-   int DstMinBX(void) const { return dstMinBX; }
-   int DstMaxBX(void) const { return dstMaxBX; }
-   int DstMinBY(void) const { return dstMinBY; }
-   int DstMaxBY(void) const { return dstMaxBY; }
-   int SrcBlockEdgeX(void) const { return srcBlockEdgeX; }
-   int SrcBlockEdgeY(void) const { return srcBlockEdgeY; }
-   int DstBlockEdgeX(void) const { return dstBlockEdgeX; }
-   int DstBlockEdgeY(void) const { return dstBlockEdgeY; }
+   int OffsetX(void) const { return offsetX; }   // pos of the clip-rect within the output
+   int OffsetY(void) const { return offsetY; }
+   // the blocks lie on a fixed grid of the whole dst-image, independent of the clipping:
+   // edge of the block containing dstPos
+   int BlockGridPos(int dstPos) const { return dstPos - ((dstPos % sizeDstBlock) + sizeDstBlock) % sizeDstBlock; }
+   // block geometry: len of dstBlock (power of 2, at most maxBlockLen) & the resulting srcBlock sizes,
+   // set by the constructor or AutotuneBlockLen. Call before creating the BlockContexts
+   void SetBlockLen(int len);
+   // the analysis blocks (len a multiple of the block len) on their grid of the whole dst-image
+   int AnalysisLen(void) const { return analysisLen; }
+   int AnalysisGridPos(int dstPos) const { return dstPos - ((dstPos % analysisLen) + analysisLen) % analysisLen; }
+   // edges of the blocks of the analysis block at (ax,ay) inside the clipping: [x0,x1)x[y0,y1)
+   void AnalysisBlocks(int ax, int ay, int & x0, int & y0, int & x1, int & y1) const;
    int SizeSrcBlockX(void) const { return sizeSrcBlockX; }
    int SizeSrcBlockY(void) const { return sizeSrcBlockY; }
    int SizeDstBlock (void) const { return sizeDstBlock;  }
 
-   void SrcBlockReduceNoise(void) { srcBlock->ReduceNoise(deNoiseF); }
-   void SrcBlockSharpen(void)     { srcBlock->Sharpen(preSharpenF);  }
-   BasicArray<T> *CurrentSrcBlock(void) { return srcBlock; }
-   BasicArray<T> *CurrentDstBlock(void) { return dstBlock; }
+   void SrcBlockReduceNoise(BlockContext<T> & bc) { bc.srcBlock->ReduceNoise(deNoiseF, bc.scratch); }
+   void SrcBlockSharpen(BlockContext<T> & bc)     { bc.srcBlock->Sharpen(preSharpenF, bc.scratch);  }
 
-   float RandF(void) { return randGen->RandF(); }
    FractTab *MyFractTab(void) { return fractTab; }
 
 private:
@@ -225,37 +335,63 @@ private:
    // this is converted to new cliprect within bounds and additional offset
    void CalculateClipAndOffset(const EnlargeFormat & format);
    // Shrinking (scaleF < 1.0)
-   void ShrinkLineClip(T *srcLine, T *dstLine);
+   void ShrinkRows(int dstY0, int dstY1, ScratchArena & scratch);   // output-rows [dstY0,dstY1) of the clip
+   void ReadShrinkLine(int y, T *srcLine, T *readLine);   // reduced src-line y, columns [shrinkSrcX0,shrinkSrcX1)
+   void ShrinkLineClip(T *srcLine, T *dstLine);          // srcLine: from ReadShrinkLine
    // general kernelList-Creation
    void CreateKernels(void);            // Create the Smooth-Enlarger- and Select-Kernels
+   void CreateDirKernels(DirKernels & k, int dstLen, int srcLen, float scaleF, int pos0, int pos1);
    float *CreateSmoothEnlargeKernelTab(int len);
    float *CreateSelectKernelTab(int len);
    float *CreateSmoothEnlargeKernelIntegralTab(int len);
    float *CreateSelectKernelIntegralTab(int len);
-   void CreateKernelsFromTab(float **kerList, int kerListLen,
-                             float *kerTab, int kerTabLen, float scaleF);
-   void CreateKernelsFromIntegralTab(float **kerList, int kerListLen,
-                             float *kerITab, int kerTabLen, float scaleF, int *smallToBigTab);
 
-   void CreateDiffTabs(void);
-
-   void BlockReadLineSmooth(int srcY, T  *line);
-   void MaskBlockReadLineSmooth(int srcY, float *line);
+   void CreateDiffTabs(void);   // find the shared diffTabs of the parameters, or create them
+   void CreateDiffTabs(float *selectTab, float *centerTab);
+
+   int  BytesPerSrcPixel(void) const { return 7*sizeof(T) + 4*sizeof(float); } // srcBlock,derivs,weights
+   int  BytesPerDstPixel(void) const { return sizeof(T) + sizeof(float); }     // dstBlock,workMaskDst
+
+   // clipped to the given rect
+   void AnalysisBegin(BlockContext<T> & ac, int dstXEdge,int dstYEdge, int cx0, int cy0, int cx1, int cy1);
+   void BlockBegin(BlockContext<T> & bc, int dstXEdge,int dstYEdge, int cx0, int cy0, int cx1, int cy1,
+                   BlockContext<T> & ac);
+   void BlockClip(BlockContext<T> & bc, int dstXEdge,int dstYEdge, int cx0, int cy0, int cx1, int cy1);
+   void ClearAnalysis(BlockContext<T> & bc);   // derivatives & weights of srcBlock
+   // the part of the srcBlock of its analysis block the clipped block reads: [x0,x1)x[y0,y1),
+   // false if nothing is clipped
+   bool BlockWindow(BlockContext<T> & bc, int & x0, int & y0, int & x1, int & y1);
+   // [x0,x1)x[y0,y1) in the srcBlock of an analysis block: widened by analysisHalo,
+   // on its 2x2 grid (ReduceNoise), inside it
+   void AnalysisWindow(int & x0, int & y0, int & x1, int & y1);
+   void ReshapeSrcArrays(BlockContext<T> & bc, int sx, int sy);
+   void ViewSrcArrays(BlockContext<T> & bc, BlockContext<T> & ac);   // bc reads the arrays of ac
+   void BlockReadLineSmooth(BlockContext<T> & bc, int srcY, float *line);  // line: planar
+   void MaskBlockReadLineSmooth(BlockContext<T> & bc, int srcY, float *line);
+   // the smooth-enlarging covers the clipped rows & the columns EnlargeBlockPart reads
+   int  SmoothX0(BlockContext<T> & bc) const { return bc.dstMinBX & ~(quadRestartLen-1); }
+   int  SmoothStartLines(BlockContext<T> & bc, int *lineY);   // srcBY & the 5 src-lines at dstMinBY
 
    // bigPos of smallPixel / smallPixel in current block (margin: need values<0,etc)
-   int BigSrcPosX(int smallPos) { return smallToBigTabX[ smallPos + smallToBigMargin ]; }
-   int BigSrcPosY(int smallPos) { return smallToBigTabY[ smallPos + smallToBigMargin ]; }
-   int SrcX(int dstBX)  { return BigSrcPosX(dstBX + dstBlockEdgeX); }
-   int SrcY(int dstBY)  { return BigSrcPosY(dstBY + dstBlockEdgeY); }
+   int BigSrcPosX(int smallPos) { return SmallToBigPos(smallPos, invScaleFaktX); }
+   int BigSrcPosY(int smallPos) { return SmallToBigPos(smallPos, invScaleFaktY); }
+   int SrcX(BlockContext<T> & bc, int dstBX)  { return BigSrcPosX(dstBX + bc.dstBlockEdgeX); }
+   int SrcY(BlockContext<T> & bc, int dstBY)  { return BigSrcPosY(dstBY + bc.dstBlockEdgeY); }
+
+   // bigPos of the upper left edge of the srcBlock of the analysis block containing dstPos
+   int AnalysisSrcEdgeX(int dstPos) { return BigSrcPosX(AnalysisGridPos(dstPos)) - srcBlockMargin; }
+   int AnalysisSrcEdgeY(int dstPos) { return BigSrcPosY(AnalysisGridPos(dstPos)) - srcBlockMargin; }
 
    // bigPos in current srcBlock of  smallPos in current block
-   int CurrentSrcBlockX(int dstBX)    { return SrcX(dstBX) - srcBlockEdgeX; }
-   int CurrentSrcBlockY(int dstBY)    { return SrcY(dstBY) - srcBlockEdgeY; }
+   int CurrentSrcBlockX(BlockContext<T> & bc, int dstBX)    { return SrcX(bc, dstBX) - bc.srcBlockEdgeX; }
+   int CurrentSrcBlockY(BlockContext<T> & bc, int dstBY)    { return SrcY(bc, dstBY) - bc.srcBlockEdgeY; }
 
-   void ReadDerivatives(void);
+   void ReadDerivativesRow(BlockContext<T> & bc, int y);
+   void IntensityDiffRow(BlockContext<T> & bc, int y, float *diffRow);   // parts of the 7x7
+   void IntensitySumRow(BlockContext<T> & bc, int y, float *diff, float *intensity); // variation
    void CalcBaseWeights0(void);             // calc indie & simil Weights for BigPixels
    void CalcBaseWeights1(void);             // calc indie & simil Weights for BigPixels
-   void ReadBigPixelNeighs(int srcBX, int srcBY); // for a BigPixel (srcBX,srcBY) read surrounding 5x5
+   void ReadBigPixelNeighs(BlockContext<T> & bc, int srcBX, int srcBY); // for a BigPixel (srcBX,srcBY) read surrounding 5x5
 
    // Selection-WeightFact: used when selecting BigPixel for smallPixel
    float SelectWeight(float pointDiff) {
@@ -273,10 +409,29 @@ private:
    }
 
    int MatPos (int x,int y) { return x + 5*y; }
+
+   // Point and Point4 are plain float-vectors: the channels as float-array
+   static const int numChannels = sizeof(T)/sizeof(float);
+   static float *PointData(T & p) { return (float*)&p; }
+
+   // scratch needed by the passes of a block (srcBlock sx*sy, dstBlock len^2),
+   // each pass releases its buffers
+   static size_t ScratchBytes(int sx, int sy, int len);
+
+   // calc quadric a of the neighbour planes
+   void NeighQuadricCalc(BlockContext<T> & bc, float fx, float fy, int a, float deltaX) {
+      T  quad, quadD, quadD2;
+      QuadricCalc(bc, fx, fy, a, deltaX, quad, quadD, quadD2);
+	  for(int c=0; c<numChannels; c++) {
+		 bc.neigh.quad  [c][a] = PointData(quad  )[c];
+		 bc.neigh.quadD [c][a] = PointData(quadD )[c];
+		 bc.neigh.quadD2[c][a] = PointData(quadD2)[c];
+      }
+   }
    inline float Inverse (float x);
-   inline T     LinModColor  (float fx, float fy, int a);
-   inline T     LinModColorB (float fx, float fy, int a);
-   inline void  QuadricCalc  (float fx, float fy, int a, float deltaX, T  & quad, T  & quadD, T  & quadD2);
+   inline T     LinModColor  (BlockContext<T> & bc, float fx, float fy, int a);
+   inline T     LinModColorB (BlockContext<T> & bc, float fx, float fy, int a);
+   inline void  QuadricCalc  (BlockContext<T> & bc, float fx, float fy, int a, float deltaX, T  & quad, T  & quadD, T  & quadD2);
    inline float ModVal  (float f);
    inline float ModVal2 (float f, float f2);
 };
@@ -301,12 +456,12 @@ inline float BasicEnlarger<T>::Inverse(float x) {
 }
 
 template<class T>
-inline  T  BasicEnlarger<T>::LinModColor(float fx, float fy, int a) {
+inline  T  BasicEnlarger<T>::LinModColor(BlockContext<T> & bc, float fx, float fy, int a) {
    T  modC;
    const float faktD=1.0, faktD2=0.7;  //!!! 0.7;
-   modC = bigPixelColor[a] + faktD*(fx*bigPixelDX[a] + fy*bigPixelDY[a]);
+   modC = bc.bigPixelColor[a] + faktD*(fx*bc.bigPixelDX[a] + fy*bc.bigPixelDY[a]);
    T  modC2;
-   modC2 =  0.5*(fx*fx*bigPixelD2X[a] + fy*fy*bigPixelD2Y[a]) + fx*fy*bigPixelDXY[a] ;
+   modC2 =  0.5*(fx*fx*bc.bigPixelD2X[a] + fy*fy*bc.bigPixelD2Y[a]) + fx*fy*bc.bigPixelDXY[a] ;
 
    modC2 *= faktD2;
       //float ff = (4.0 - fx*fx - fy*fy)*(1.0/4.0);
@@ -320,29 +475,29 @@ inline  T  BasicEnlarger<T>::LinModColor(float fx, float fy, int a) {
 }
 
 template<class T>
-   inline T  BasicEnlarger<T>::LinModColorB(float fx, float fy, int a) {
+   inline T  BasicEnlarger<T>::LinModColorB(BlockContext<T> & bc, float fx, float fy, int a) {
    T  modC;
    const float faktD=1.0, faktD2=0.7;  //!!! 1.0 /  0.7;
 
-   modC = fx*bigPixelDX[a] + fy*bigPixelDY[a];
-   modC +=  (0.5*faktD2*fx*fx)*bigPixelD2X[a] + (0.5*faktD2*fy*fy)*bigPixelD2Y[a];
-   modC += (faktD2*fx*fy)*bigPixelDXY[a] ;
+   modC = fx*bc.bigPixelDX[a] + fy*bc.bigPixelDY[a];
+   modC +=  (0.5*faktD2*fx*fx)*bc.bigPixelD2X[a] + (0.5*faktD2*fy*fy)*bc.bigPixelD2Y[a];
+   modC += (faktD2*fx*fy)*bc.bigPixelDXY[a] ;
    return modC;
 }
 
 template<class T>
-inline void BasicEnlarger<T>::QuadricCalc(float fx, float fy, int a, float deltaX, T  & quad, T  & quadD, T  & quadD2) {
-   quad = fx*bigPixelDX[a] + fy*bigPixelDY[a];
-   quad +=  (0.35*fx*fx)*bigPixelD2X[a] + (0.35*fy*fy)*bigPixelD2Y[a];
-   quad += (0.7*fx*fy)*bigPixelDXY[a] ;
+inline void BasicEnlarger<T>::QuadricCalc(BlockContext<T> & bc, float fx, float fy, int a, float deltaX, T  & quad, T  & quadD, T  & quadD2) {
+   quad = fx*bc.bigPixelDX[a] + fy*bc.bigPixelDY[a];
+   quad +=  (0.35*fx*fx)*bc.bigPixelD2X[a] + (0.35*fy*fy)*bc.bigPixelD2Y[a];
+   quad += (0.7*fx*fy)*bc.bigPixelDXY[a] ;
    quad *= derivF;
 
-   quadD = deltaX*bigPixelDX[a];
-   quadD += (0.35*deltaX*(2.0*fx + deltaX))*bigPixelD2X[a];
-   quadD += (0.7*deltaX*fy)*bigPixelDXY[a] ;
+   quadD = deltaX*bc.bigPixelDX[a];
+   quadD += (0.35*deltaX*(2.0*fx + deltaX))*bc.bigPixelD2X[a];
+   quadD += (0.7*deltaX*fy)*bc.bigPixelDXY[a] ;
    quadD *= derivF;
 
-   quadD2 = (0.7*derivF*deltaX*deltaX)*bigPixelD2X[a];
+   quadD2 = (0.7*derivF*deltaX*deltaX)*bc.bigPixelD2X[a];
 }
 
 template<class T>
@@ -358,7 +513,7 @@ inline float BasicEnlarger<T>::ModVal2(float f, float f2) {
       f=f2;
    if(f<0.0)
       return 0.0;
-   return 6.0*pow_f((double)f,2.0);
+   return 6.0*sqr_f(f);
 }
 
 //
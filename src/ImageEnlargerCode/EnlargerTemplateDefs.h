@@ -27,6 +27,7 @@ along with this program; if not, see <http://www.gnu.org/licenses/>.
 
 #include <iostream>
 #include <math.h>
+#include <algorithm>
 #include <stdio.h>
 #include "EnlargerTemplate.h"
 #include "Array.h"
@@ -58,7 +59,6 @@ using namespace std;
 template<class T>
 BasicEnlarger<T>::BasicEnlarger(const EnlargeFormat & format, const EnlargeParameter & param) {
    // int srcSizeX, int srcSizeY, float scaleF) {
-   int a;
    sizeX = format.srcWidth;
    sizeY = format.srcHeight;
 
@@ -82,63 +82,25 @@ BasicEnlarger<T>::BasicEnlarger(const EnlargeFormat & format, const EnlargeParam
    outputHeight = format.ClipH();
    CalculateClipAndOffset(format);
    onlyShrinking = (scaleFaktX < 1.0  && scaleFaktY < 1.0);
-
-   randGen = new RandGen(635017,934021);
-   smallToBigTabX  = new int[sizeXDst + 2*smallToBigMargin];
-   smallToBigTabY  = new int[sizeYDst + 2*smallToBigMargin];
-   for(a=0; a<sizeXDst+2*smallToBigMargin; a++) {
-	   smallToBigTabX[a] = int(float(a-smallToBigMargin)*invScaleFaktX);
-   }
-   for(a=0; a<sizeYDst+2*smallToBigMargin; a++) {
-	   smallToBigTabY[a] = int(float(a-smallToBigMargin)*invScaleFaktY);
-   }
+   shrinkColDst = shrinkRowDst = 0;
+   shrinkColW0 = shrinkColW1 = shrinkRowFloor = 0;
+   analysedPixels = 0;
 
    if(OnlyShrinking())
       return;
 
-   sizeDstBlock = blockLen;
-   sizeSrcBlockX = int (invScaleFaktX * float(sizeDstBlock) + 0.5) + 2*srcBlockMargin;
-   sizeSrcBlockY = int (invScaleFaktY * float(sizeDstBlock) + 0.5) + 2*srcBlockMargin;
-   srcBlock = new BasicArray<T>(sizeSrcBlockX, sizeSrcBlockY);
-   dstBlock = new BasicArray<T>(sizeDstBlock, sizeDstBlock);
+   analysisLen = 1 << ChooseAnalysisExp(invScaleFaktX, invScaleFaktY);
+   sizeAnalysisBlockX = int (invScaleFaktX * float(analysisLen) + 0.5) + 2*srcBlockMargin;
+   sizeAnalysisBlockY = int (invScaleFaktY * float(analysisLen) + 0.5) + 2*srcBlockMargin;
+   SetBlockLen(1 << ChooseBlockExp(invScaleFaktX, invScaleFaktY,
+                                   BytesPerSrcPixel(), BytesPerDstPixel(), CacheSizeL2()));
 
-   baseWeights   = new MyArray(sizeSrcBlockX, sizeSrcBlockY);
-   workMask      = new MyArray(sizeSrcBlockX, sizeSrcBlockY);
-   baseParams    = new MyArray(sizeSrcBlockX, sizeSrcBlockY);
-   baseIntensity = new MyArray(sizeSrcBlockX, sizeSrcBlockY);
-   workMaskDst   = new MyArray(sizeDstBlock,  sizeDstBlock );
-
-   dX  = new BasicArray<T>(sizeSrcBlockX, sizeSrcBlockY);
-   dY  = new BasicArray<T>(sizeSrcBlockX, sizeSrcBlockY);
-   d2X = new BasicArray<T>(sizeSrcBlockX, sizeSrcBlockY);
-   d2Y = new BasicArray<T>(sizeSrcBlockX, sizeSrcBlockY);
-   dXY = new BasicArray<T>(sizeSrcBlockX, sizeSrcBlockY);
-   d2L = new BasicArray<T>(sizeSrcBlockX, sizeSrcBlockY);
-
-   selectDiffTab = new float[diffTabLen];
-   centerWeightTab = new float[diffTabLen];
-   invTab = new float[invTabLen];
-   invTab[0] = 1000000.0;
-   for(a=1;a<invTabLen;a++)
-      invTab[a] = float(invTabLen-1)/float(a);
+   invTab = SharedInvTab();
 
    // use different kernels in x,y-dir, because diff. scaleF in x,y
    // for sake of pixel-accuracy allow slight difference in aspect ratio
    // and thus change scaleF into slightly diff. scaleFX,scaleFY
 
-   enlargeKernelX = new float*[sizeXDst];
-   enlargeKernelY = new float*[sizeYDst];
-   selectKernelX  = new float*[sizeXDst];
-   selectKernelY  = new float*[sizeYDst];
-   for(a=0; a<sizeXDst; a++) {
-      enlargeKernelX[a] = new float[ 5 ];
-      selectKernelX[a]  = new float[ 5 ];
-   }
-   for(a=0; a<sizeYDst; a++) {
-      enlargeKernelY[a] = new float[ 5 ];
-      selectKernelY[a]  = new float[ 5 ];
-   }
-
    derivF = 0.0;
    sharpExp = 0.01;
    centerWeightF =  3.0;
@@ -154,9 +116,8 @@ BasicEnlarger<T>::BasicEnlarger(const EnlargeFormat & format, const EnlargeParam
    preSharpenF = 0.0;
    fractNoiseF = 0.0;
 
-   SetParameter(param);
+   SetParameter(param);   // creates the diffTabs
    CreateKernels();
-   CreateDiffTabs();
 
    fractTab = 0;   // fractTab has to be imported with SetFractTab
 }
@@ -184,36 +145,47 @@ void BasicEnlarger<T>::CalculateClipAndOffset(const EnlargeFormat & format) {
    if(clipY1 > sizeYDst) {
       clipY1 = sizeYDst;
    }
+   // clip-rect completely outside: nothing to calculate, only margins
+   if(clipX0 > clipX1) clipX0 = clipX1;
+   if(clipY0 > clipY1) clipY0 = clipY1;
 }
 
 template<class T>
 BasicEnlarger<T>::~BasicEnlarger(void) {
-   int a;
+   EndShrink();
 
-   delete randGen;
-   delete[] smallToBigTabX;
-   delete[] smallToBigTabY;
+}
 
-   if(OnlyShrinking())
-      return;
+template<class T>
+BlockContext<T>::BlockContext(int sizeSrcBlockX, int sizeSrcBlockY, int sizeDstBlock, size_t scratchBytes) {
+   randGen = new RandGen(ditherSeed,934021);
+   scratch = new ScratchArena(scratchBytes);
+   srcBlock = new BasicArray<T>(sizeSrcBlockX, sizeSrcBlockY);
+   dstBlock = new PlanarArray<T>(sizeDstBlock, sizeDstBlock);
 
-   for(a=0; a<sizeXDst; a++) {
-      delete[] enlargeKernelX[a];
-      delete[] selectKernelX[a];
-   }
-   for(a=0; a<sizeYDst; a++) {
-      delete[] enlargeKernelY[a];
-      delete[] selectKernelY[a];
-   }
-   delete[] enlargeKernelX;
-   delete[] enlargeKernelY;
-   delete[] selectKernelX;
-   delete[] selectKernelY;
+   baseWeights   = new MyArray(sizeSrcBlockX, sizeSrcBlockY);
+   workMask      = new MyArray(sizeSrcBlockX, sizeSrcBlockY);
+   baseParams    = new MyArray(sizeSrcBlockX, sizeSrcBlockY);
+   baseIntensity = new MyArray(sizeSrcBlockX, sizeSrcBlockY);
+   workMaskDst   = new MyArray(sizeDstBlock,  sizeDstBlock );
 
+   dX  = new BasicArray<T>(sizeSrcBlockX, sizeSrcBlockY);
+   dY  = new BasicArray<T>(sizeSrcBlockX, sizeSrcBlockY);
+   d2X = new BasicArray<T>(sizeSrcBlockX, sizeSrcBlockY);
+   d2Y = new BasicArray<T>(sizeSrcBlockX, sizeSrcBlockY);
+   dXY = new BasicArray<T>(sizeSrcBlockX, sizeSrcBlockY);
+   d2L = new BasicArray<T>(sizeSrcBlockX, sizeSrcBlockY);
 
-   delete [] selectDiffTab;
-   delete [] centerWeightTab;
-   delete [] invTab;
+   dstBlockEdgeX = dstBlockEdgeY = 0;
+   srcBlockEdgeX = srcBlockEdgeY = 0;
+   srcWinX = srcWinY = 0;
+   dstMinBX = dstMinBY = dstMaxBX = dstMaxBY = 0;
+}
+
+template<class T>
+BlockContext<T>::~BlockContext(void) {
+   delete randGen;
+   delete scratch;
 
    delete dX;
    delete dY;
@@ -231,27 +203,89 @@ BasicEnlarger<T>::~BasicEnlarger(void) {
    delete dstBlock;
 }
 
-// example for enlarging the clip-rect
+// example for enlarging the clip-rect: each analysis block is analysed once, then its blocks enlarged
 template<class T>
 void BasicEnlarger<T>::Enlarge(void) {
-   int dstX,dstY;
+   int ax,ay,dstX,dstY,x0,y0,x1,y1;
 
    if(OnlyShrinking()) {
       ShrinkClip();
       return;
    }
 
-   for(dstY = ClipY0(); dstY < ClipY1(); dstY+=blockLen) {
-	  for(dstX = ClipX0(); dstX < ClipX1(); dstX+=blockLen) {
-		 BlockBegin(dstX, dstY);
-         ReadSrcBlock();
-         SrcBlockReduceNoise();
-         SrcBlockSharpen();
-         EnlargeBlock();
-         WriteDstBlock();
+   BlockContext<T> *ac = NewAnalysisContext();
+   BlockContext<T> *bc = NewBlockContext();
+   for(ay = AnalysisGridPos(ClipY0()); ay < ClipY1(); ay+=analysisLen) {
+	  for(ax = AnalysisGridPos(ClipX0()); ax < ClipX1(); ax+=analysisLen) {
+		 AnalysisBegin(*ac, ax, ay);
+         AnalyseSrcBlock(*ac);
+         AnalysisBlocks(ax, ay, x0, y0, x1, y1);
+		 for(dstY = y0; dstY < y1; dstY+=sizeDstBlock) {
+			for(dstX = x0; dstX < x1; dstX+=sizeDstBlock) {
+			   BlockBegin(*bc, dstX, dstY, *ac);
+               EnlargeBlock(*bc);
+               WriteDstBlock(*bc);
+            }
+         }
       }
    }
+   delete bc;
+   delete ac;
+}
 
+template<class T>
+void BasicEnlarger<T>::SetBlockLen(int len) {
+   sizeDstBlock = len;
+   sizeSrcBlockX = int (invScaleFaktX * float(sizeDstBlock) + 0.5) + 2*srcBlockMargin;
+   sizeSrcBlockY = int (invScaleFaktY * float(sizeDstBlock) + 0.5) + 2*srcBlockMargin;
+}
+
+template<class T>
+void BasicEnlarger<T>::AutotuneBlockLen(void) {
+   int e, tunedExp, modelExp;
+
+   if(OnlyShrinking())
+      return;
+   if(TunedBlockExp(invScaleFaktX, invScaleFaktY, BytesPerSrcPixel(), tunedExp)) {
+      SetBlockLen(1 << tunedExp);
+      return;
+   }
+
+   // sample: the block at the center of the clipping (the kernels exist only there), timed unclipped.
+   // Its analysis block is analysed once (unclipped), not timed: each len reads the same analysis
+   int sampleX = (clipX0 + clipX1)/2, sampleY = (clipY0 + clipY1)/2;
+   BlockContext<T> *ac = NewAnalysisContext();
+   AnalysisBegin(*ac, AnalysisGridPos(sampleX), AnalysisGridPos(sampleY), 0, 0, sizeXDst, sizeYDst);
+   AnalyseSrcBlock(*ac);
+
+   modelExp = 1;
+   while((1 << modelExp) < sizeDstBlock)
+      modelExp++;
+   tunedExp = modelExp;
+   double bestTime = -1.0;
+   for(e = modelExp-1; e <= modelExp+1; e++) {
+	  if(e < minBlockExp || e > maxBlockExp)
+         continue;
+      SetBlockLen(1 << e);
+      BlockContext<T> *bc = NewBlockContext();
+      WallTimer timer;
+      timer.Start();
+	  BlockBegin(*bc, BlockGridPos(sampleX), BlockGridPos(sampleY), 0, 0, sizeXDst, sizeYDst, *ac);
+      EnlargeBlock(*bc);
+      timer.Stop();
+      // time per dst-pixel: parts of a block outside the image are wasted
+      long area = long(bc->dstMaxBX - bc->dstMinBX)*long(bc->dstMaxBY - bc->dstMinBY);
+      double t = timer.Get()/double(area > 0 ? area : 1);
+      delete bc;
+	  if(bestTime < 0.0 || t < bestTime) {
+         bestTime = t;
+         tunedExp = e;
+      }
+   }
+
+   delete ac;
+   SetBlockLen(1 << tunedExp);
+   SetTunedBlockExp(invScaleFaktX, invScaleFaktY, BytesPerSrcPixel(), tunedExp);
 }
 
 template<class T>
@@ -313,23 +347,21 @@ void BasicEnlarger<T>::SetParameter(const EnlargeParameter & p) {
 }
 
 template<class T>
-void BasicEnlarger<T>::EnlargeBlock(void) {
+void BasicEnlarger<T>::EnlargeBlock(BlockContext<T> & bc) {
    if(OnlyShrinking())
       return;
 
-   CalcBaseWeights();
-   BlockEnlargeSmooth();
-   MaskBlockEnlargeSmooth();
-   EnlargeBlockPart(dstMinBY, dstMaxBY);
-   AddRandom ();
-   dstBlock->Clamp01();
+   BlockEnlargeSmooth(bc);
+   MaskBlockEnlargeSmooth(bc);
+   EnlargeBlockPart(bc, bc.dstMinBY, bc.dstMaxBY);
+   AddRandom (bc);
+   bc.dstBlock->Clamp01(bc.dstMinBX, bc.dstMinBY, bc.dstMaxBX, bc.dstMaxBY);
 }
 
 template<class T>
-void BasicEnlarger<T>::EnlargeBlockPart(int dstStartBY, int dstEndBY) {
+void BasicEnlarger<T>::EnlargeBlockPart(BlockContext<T> & bc, int dstStartBY, int dstEndBY) {
    int dstBX, dstBY, srcBX, srcBY, srcBXNew;
-   float *kerX,*kerY;
-   T      modColor[25];
+   const float *kerX,*kerY;
    if(OnlyShrinking())
       return;
 
@@ -344,99 +376,106 @@ void BasicEnlarger<T>::EnlargeBlockPart(int dstStartBY, int dstEndBY) {
    //          bigPixelColor and smallColor                       (SelectWeight)
    // sum up all weighted colors and return
    //    lincomb with smoothEnlarged smallColor
+   // the weighting of the 25 neighbours is done by SelectNeighColor (SIMD),
+   // on the planes bc.neigh filled by ReadBigPixelNeighs
 
    // for each bigPixel calculate quadric from derivatives
    // for inc. of dstBX calc only increment of the Quadrics
-   T      quadric[5*5], quadDelta[5*5], quadD2[5*5];
+   NeighPlanes & nb = bc.neigh;
+   SelectPixel   sp;
+   SelectTabs    tabs;
+   float fractW[neighLen];
    int srcXm2, srcYm2;
    float fx,fy;
    float deltaX = 1.0*invScaleFaktX;
-   int a,ax,ay;
+   int a,ax,ay,c;
    bool lastPixelWasCalculated;   // used for quadric-refreshing
 
-   if(dstStartBY < dstMinBY)
-       dstStartBY = dstMinBY;
-   if(dstEndBY > dstMaxBY)
-       dstEndBY = dstMaxBY;
+   tabs.numChannels = numChannels;
+   tabs.derivDiffF  = derivDiffF;
+   tabs.selectDiffTab   = selectDiffTab;
+   tabs.centerWeightTab = centerWeightTab;
+   for(a=0; a<neighLen; a++)
+      fractW[a] = 1.0;
+   sp.fractW = (fractTab != 0 && fractNoiseF > 0.0) ? fractW : 0;
+
+   if(dstStartBY < bc.dstMinBY)
+       dstStartBY = bc.dstMinBY;
+   if(dstEndBY > bc.dstMaxBY)
+       dstEndBY = bc.dstMaxBY;
    for(dstBY = dstStartBY; dstBY < dstEndBY ; dstBY++) {
-      kerY = selectKernelY[dstBY + dstBlockEdgeY];
+      kerY = selectKernelY->Get(dstBY + bc.dstBlockEdgeY);
 
-	  srcBX = CurrentSrcBlockX(0);
-	  srcBY = CurrentSrcBlockY(dstBY);
-      srcYm2  = srcBY - 2 + srcBlockEdgeY;
-	  fy = float(dstBY + dstBlockEdgeY)*invScaleFaktY  - float(srcYm2) - 0.25;
+	  srcBX = CurrentSrcBlockX(bc, bc.dstMinBX & ~(quadRestartLen-1));
+	  srcBY = CurrentSrcBlockY(bc, dstBY);
+      srcYm2  = srcBY - 2 + bc.srcBlockEdgeY;
+	  fy = float(dstBY + bc.dstBlockEdgeY)*invScaleFaktY  - float(srcYm2) - 0.25;
 
-	  ReadBigPixelNeighs(srcBX, srcBY);
+	  ReadBigPixelNeighs(bc, srcBX, srcBY);
 
       lastPixelWasCalculated = false;   // quadric: a fresh start for a new row
-	  for(dstBX = dstMinBX; dstBX<dstMaxBX ; dstBX++) {
-         kerX = selectKernelX[dstBX + dstBlockEdgeX];
-		 srcBXNew = CurrentSrcBlockX(dstBX);
-         srcXm2 = srcBXNew - 2 + srcBlockEdgeX;
-		 fx = float(dstBX + dstBlockEdgeX)*invScaleFaktX  - float(srcXm2) - 0.25;
+      // the incremented quadrics restart every quadRestartLen pixels; begin the row at
+      // such a restart, so a pixel does not depend on the clipping (blocks lie on this grid)
+	  for(dstBX = bc.dstMinBX & ~(quadRestartLen-1); dstBX<bc.dstMaxBX ; dstBX++) {
+		 if((dstBX & (quadRestartLen-1)) == 0)
+            lastPixelWasCalculated = false;
+         kerX = selectKernelX->Get(dstBX + bc.dstBlockEdgeX);
+		 srcBXNew = CurrentSrcBlockX(bc, dstBX);
+         srcXm2 = srcBXNew - 2 + bc.srcBlockEdgeX;
+		 fx = float(dstBX + bc.dstBlockEdgeX)*invScaleFaktX  - float(srcXm2) - 0.25;
 
 		 if(srcBXNew > srcBX) { // do we step forward in the src-system?
             // in this case: refresh the src-neighbour-mat
             // the matrix of 5x5 quadric-datas has to be shifted,
             // the last column is calculated
             srcBX = srcBXNew;
-			ReadBigPixelNeighs(srcBX, srcBY);
+			ReadBigPixelNeighs(bc, srcBX, srcBY);
 
             // if the last pixel was not calculated, then all
             // quadrics are newly initialized further down, else:
             // shift the quadric-data by one to the left
 			if(derivF>0.0 && lastPixelWasCalculated) {
-               a=0;
 			   for(ay=0; ay<5; ay++) {
-				  for(ax=0; ax<4; ax++) {
-                     quadric[a]   = quadric[a+1];
-                     quadDelta[a] = quadDelta[a+1];
-                     quadD2[a]    = quadD2[a+1];
-
-                     // increment the quadric-data
-                     quadric[a]   += quadDelta[a];
-                     quadDelta[a] += quadD2[a];
-
-                     a++;
+                  a = MatPos(0, ay);
+				  for(c=0; c<numChannels; c++) {
+					 for(ax=0; ax<4; ax++) {
+						nb.quad  [c][a+ax] = nb.quad  [c][a+ax+1];
+						nb.quadD [c][a+ax] = nb.quadD [c][a+ax+1];
+						nb.quadD2[c][a+ax] = nb.quadD2[c][a+ax+1];
+
+                        // increment the quadric-data
+						nb.quad  [c][a+ax] += nb.quadD [c][a+ax];
+						nb.quadD [c][a+ax] += nb.quadD2[c][a+ax];
+                     }
                   }
                   // the last quadric in every row is new
-                  float px = fx - float(ax);
+                  float px = fx - 4.0;
                   float py = fy - float(ay);
-                  QuadricCalc(px, py, a, deltaX, quadric[a], quadDelta[a], quadD2[a]);
-                  a++;
+                  NeighQuadricCalc(bc, px, py, a+4, deltaX);
                }
             }
          }
 		 else if(derivF>0.0 && lastPixelWasCalculated) {
             // increment the quadric-data
-            a=0;
-			for(ay=0; ay<5; ay++) {
-			   for(ax=0; ax<5; ax++) {
-                  quadric[a]   += quadDelta[a];
-                  quadDelta[a] += quadD2[a];
-                  a++;
-               }
-            }
+			IncNeighQuadrics(nb, numChannels);
          }
 
          // Modify One Small Pixel at (dstBX,dstBY) with smallColor
-		 T     smallColor = dstBlock->Get(dstBX , dstBY);
+		 T     smallColor = bc.dstBlock->Get(dstBX , dstBY);
 
          // for diffCalc fract-modify smallColor
          T     smallColorFract = smallColor;
 
 		 if(fractTab != 0 && fractNoiseF > 0.0) {
-			float wf = MyFractTab()->GetT(dstBX + DstBlockEdgeX(), dstBY + DstBlockEdgeY());
+			float wf = MyFractTab()->GetT(dstBX + bc.dstBlockEdgeX, dstBY + bc.dstBlockEdgeY);
 			smallColorFract += (fractNoiseF*0.01*wf)*smallColorFract;
             smallColorFract.Clip();
          }
 
-
-         float wMat[5*5], totalWeight, w, normF;
          float wMask = 1.0;
          T     color,diff;
 
-		 wMask = workMaskDst->GetF(dstBX, dstBY) - 0.01;
+		 wMask = bc.workMaskDst->GetF(dstBX, dstBY) - 0.01;
          if(wMask>0.0) {
             wMask *= 1.5;
             if(wMask>1.0)
@@ -444,7 +483,6 @@ void BasicEnlarger<T>::EnlargeBlockPart(int dstStartBY, int dstEndBY) {
             else {
                wMask = wMask*wMask*(3.0 - 2.0*wMask);
             }
-            totalWeight=0.0;
 
             // if last pixel was not in the mask:
             // initialize the 5x5 quadrics
@@ -454,7 +492,7 @@ void BasicEnlarger<T>::EnlargeBlockPart(int dstStartBY, int dstEndBY) {
 				  for(ax=0; ax<5; ax++) {
                      float px = fx - float(ax);
                      float py = fy - float(ay);
-                     QuadricCalc(px, py, a, deltaX, quadric[a], quadDelta[a], quadD2[a]);
+                     NeighQuadricCalc(bc, px, py, a, deltaX);
                      a++;
                   }
                }
@@ -462,41 +500,20 @@ void BasicEnlarger<T>::EnlargeBlockPart(int dstStartBY, int dstEndBY) {
             lastPixelWasCalculated = true;
 
             a=0;
-            // weight the 5x5 source pixels
-			for(int ay=0; ay<5; ay++) {
-			   for(int ax=0; ax<5; ax++) {
-                  if(derivF > 0.0) {
-                     modColor[a] = quadric[a]  + bigPixelColor[a];
-                     w = derivDiffF*quadric[a].Norm1();
-                  }
-                  else {
-                     modColor[a] = bigPixelColor[a];
-                     w=0.0;
-                  }
-
-
-                  //diff = modColor[a] - smallColor;
-                  diff = modColor[a] - smallColorFract;
-				  w  = 10.0 * (w + diff.Norm1()) * bigPixelIntensity[a];
-				  w = bigPixelWeight[a] * kerX[ax] * kerY[ay] * SelectWeight(w);
-
-                  // give bigPixel add. Weigt near center
-                  float px = fx - float(ax);
-                  float py = fy - float(ay);
-                  float ww = bigPixelCenterW[a];
-				  ww = 1.0 + (CenterWeight(px*px + py*py) - 1.0)*ww;
-                  w *=  ww;
-
-
+			for(ay=0; ay<5; ay++) {
+			   for(ax=0; ax<5; ax++) {
+				  sp.kerW[a] = kerX[ax] * kerY[ay];
 
                   // deform the weight via fractTab,
                   // for each srcPixel we have deform-kernel
 				  // (FractCX,FractCY,FractCVal : center pos & center val in fractTab)
                   // kernel was selected by randomizing the coord of the srcPixel
 				  if(fractTab != 0 && fractNoiseF > 0.0) {
-                     int dx = int(px*scaleFaktX) + bigPixelFractCX[a];
-                     int dy = int(py*scaleFaktY) + bigPixelFractCY[a];
-					 ww = 1.0 + 1.5*fractNoiseF*(fractTab->GetT(dx, dy) - bigPixelFractCVal[a]) ;
+                     float px = fx - float(ax);
+                     float py = fy - float(ay);
+                     int dx = int(px*scaleFaktX) + bc.bigPixelFractCX[a];
+                     int dy = int(py*scaleFaktY) + bc.bigPixelFractCY[a];
+					 float ww = 1.0 + 1.5*fractNoiseF*(fractTab->GetT(dx, dy) - bc.bigPixelFractCVal[a]) ;
 
 					 if(ww<0.01)
 						ww = 0.01 + (0.01 - ww);
@@ -504,259 +521,391 @@ void BasicEnlarger<T>::EnlargeBlockPart(int dstStartBY, int dstEndBY) {
 						ww = 3.0 - (ww - 3.0);
 					 if(ww<0.01)
 						ww = 0.01 + (0.01 - ww);
-                     w *= ww;
+                     fractW[a] = ww;
                   }
-                  /*
-                  // wavy special effect
-                  float sdx = bigPixelDX[a].x;
-                  float sdy = bigPixelDY[a].x;
-				  float sd = sqrt(sdx*sdx + sdy*sdy);
-                  if(sd>0) {
-                     float sdd = 1.0/sd;
-                     sdx*=sdd;
-                     sdy*=sdd;
-                     sd *= 10.0;
-					 if(sd>0.5)
-                        sd=0.5;
-                  }
-				  ww = 1.0 + sd*cos(10.0*(sdx*px + sdy*py));
-                  modColor[a] *= ww;
-                  */
-
-                  w += 0.000000001;
-                  wMat[a] = w;
-                  totalWeight += w;
                   a++;
                }
             }
-            normF = 1.0/totalWeight;
-            T    colorR;
-            color.SetZero();
-            colorR.SetZero();
 
-			for(a=0; a<25; a++)
-                wMat[a] *= normF;
-
-			for(a=0; a<25; a++) {
-                color.AddMul(wMat[a],modColor[a]); //color += modColor[a]*wMat[a];
-            }
+            // weight the 5x5 source pixels
+            sp.smallColor = PointData(smallColorFract);
+            sp.fx = fx;
+            sp.fy = fy;
+			SelectNeighColor(nb, sp, tabs, PointData(color));
 
             diff = color - smallColor;
             smallColor += diff*wMask;
 
          }
-		 dstBlock->Set(dstBX , dstBY, smallColor);
+		 bc.dstBlock->Set(dstBX , dstBY, smallColor);
       }
    }
 }
 
-// calculate positions, clipping
+// the analysis block at (dstXEdge,dstYEdge) (on the analysis grid), for its blocks clipped to
+// [cx0,cx1)x[cy0,cy1): they need only the 5x5 BigPixels of their clipped positions.
+// Analyse only the windows of the blocks plus analysisHalo (> range of the analysis-filters),
+// clipped to the analysis block, so the result is the same as with its whole srcBlock
+template<class T>
+void BasicEnlarger<T>::AnalysisBegin(BlockContext<T> & ac, int dstXEdge,int dstYEdge,
+                                     int cx0, int cy0, int cx1, int cy1) {
+   int x, y, bx0, by0, bx1, by1, wx0, wy0, wx1, wy1;
+   int x0 = sizeAnalysisBlockX, y0 = sizeAnalysisBlockY, x1 = 0, y1 = 0;
+
+   // the blocks touching the clipping: ac holds the positions of each
+   bx0 = BlockGridPos(cx0) > dstXEdge ? BlockGridPos(cx0) : dstXEdge;
+   by0 = BlockGridPos(cy0) > dstYEdge ? BlockGridPos(cy0) : dstYEdge;
+   bx1 = cx1 < dstXEdge + analysisLen ? cx1 : dstXEdge + analysisLen;
+   by1 = cy1 < dstYEdge + analysisLen ? cy1 : dstYEdge + analysisLen;
+   for(y = by0; y < by1; y += sizeDstBlock) {
+	  for(x = bx0; x < bx1; x += sizeDstBlock) {
+         BlockClip(ac, x, y, cx0, cy0, cx1, cy1);
+		 if(!BlockWindow(ac, wx0, wy0, wx1, wy1))
+            continue;
+         if(wx0 < x0) x0 = wx0;
+         if(wy0 < y0) y0 = wy0;
+         if(wx1 > x1) x1 = wx1;
+         if(wy1 > y1) y1 = wy1;
+      }
+   }
+   if(x1 > x0 && y1 > y0)
+      AnalysisWindow(x0, y0, x1, y1);
+   else {   // nothing clipped
+      x0 = y0 = 0;
+      x1 = sizeAnalysisBlockX;
+      y1 = sizeAnalysisBlockY;
+   }
+
+   ac.dstBlockEdgeX = dstXEdge;
+   ac.dstBlockEdgeY = dstYEdge;
+   ac.dstMinBX = ac.dstMinBY = ac.dstMaxBX = ac.dstMaxBY = 0;   // no dstBlock
+   ac.srcWinX = x0;
+   ac.srcWinY = y0;
+   ac.srcBlockEdgeX = AnalysisSrcEdgeX(dstXEdge) + x0;
+   ac.srcBlockEdgeY = AnalysisSrcEdgeY(dstYEdge) + y0;
+   ReshapeSrcArrays(ac, x1 - x0, y1 - y0);
+   // the derivatives & weights are calculated only inside their margins:
+   // clear them, so an analysis does not depend on the one calculated before
+   ClearAnalysis(ac);
+}
+
 template<class T>
-void BasicEnlarger<T>::BlockBegin(int dstXEdge,int dstYEdge) {
+void BasicEnlarger<T>::BlockBegin(BlockContext<T> & bc, int dstXEdge,int dstYEdge,
+                                  int cx0, int cy0, int cx1, int cy1, BlockContext<T> & ac) {
+   BlockClip(bc, dstXEdge, dstYEdge, cx0, cy0, cx1, cy1);
+   // the srcBlock is that of the analysis
+   bc.srcWinX = ac.srcWinX;
+   bc.srcWinY = ac.srcWinY;
+   bc.srcBlockEdgeX = ac.srcBlockEdgeX;
+   bc.srcBlockEdgeY = ac.srcBlockEdgeY;
+   ViewSrcArrays(bc, ac);
+}
+
+// calculate positions, clipping to [cx0,cx1)x[cy0,cy1)
+template<class T>
+void BasicEnlarger<T>::BlockClip(BlockContext<T> & bc, int dstXEdge,int dstYEdge,
+                                 int cx0, int cy0, int cx1, int cy1) {
    // smallPos of upper left edge of DstBlock
-   dstBlockEdgeX = dstXEdge;
-   dstBlockEdgeY = dstYEdge;
+   bc.dstBlockEdgeX = dstXEdge;
+   bc.dstBlockEdgeY = dstYEdge;
    // bigPos of upper left edge of   SrcBlock: add margin
-   srcBlockEdgeX = BigSrcPosX(dstXEdge) - srcBlockMargin;
-   srcBlockEdgeY = BigSrcPosY(dstYEdge) - srcBlockMargin;
+   bc.srcBlockEdgeX = BigSrcPosX(dstXEdge) - srcBlockMargin;
+   bc.srcBlockEdgeY = BigSrcPosY(dstYEdge) - srcBlockMargin;
+   bc.srcWinX = bc.srcWinY = 0;
 
    // calculate clipping
-   dstMinBX=0; dstMaxBX=sizeDstBlock;
-   dstMinBY=0; dstMaxBY=sizeDstBlock;
-   if(dstBlockEdgeX < clipX0)
-      dstMinBX = clipX0 - dstBlockEdgeX;
-   if(dstBlockEdgeY < clipY0)
-      dstMinBY = clipY0 - dstBlockEdgeY;
-   if(dstBlockEdgeX + sizeDstBlock >= clipX1)
-      dstMaxBX = clipX1 - dstBlockEdgeX;
-   if(dstBlockEdgeY + sizeDstBlock >= clipY1)
-      dstMaxBY = clipY1 - dstBlockEdgeY;
+   bc.dstMinBX=0; bc.dstMaxBX=sizeDstBlock;
+   bc.dstMinBY=0; bc.dstMaxBY=sizeDstBlock;
+   if(bc.dstBlockEdgeX < cx0)
+      bc.dstMinBX = cx0 - bc.dstBlockEdgeX;
+   if(bc.dstBlockEdgeY < cy0)
+      bc.dstMinBY = cy0 - bc.dstBlockEdgeY;
+   if(bc.dstBlockEdgeX + sizeDstBlock >= cx1)
+      bc.dstMaxBX = cx1 - bc.dstBlockEdgeX;
+   if(bc.dstBlockEdgeY + sizeDstBlock >= cy1)
+      bc.dstMaxBY = cy1 - bc.dstBlockEdgeY;
 }
 
 template<class T>
-void BasicEnlarger<T>::ReadSrcBlock(void) {
+bool BasicEnlarger<T>::BlockWindow(BlockContext<T> & bc, int & x0, int & y0, int & x1, int & y1) {
+   if(bc.dstMaxBX <= bc.dstMinBX || bc.dstMaxBY <= bc.dstMinBY)
+      return false;
+   int lineY[5];
+   x0 = CurrentSrcBlockX(bc, SmoothX0(bc)) - 2;
+   y0 = CurrentSrcBlockY(bc, bc.dstMinBY) - 2;
+   SmoothStartLines(bc, lineY);   // scale < 1: may start with lines further up
+   if(lineY[0] < y0)
+      y0 = lineY[0];
+   x1 = CurrentSrcBlockX(bc, bc.dstMaxBX - 1) + 3;
+   y1 = CurrentSrcBlockY(bc, bc.dstMaxBY - 1) + 3;
+   // into the srcBlock of the analysis block
+   int dx = bc.srcBlockEdgeX - AnalysisSrcEdgeX(bc.dstBlockEdgeX);
+   int dy = bc.srcBlockEdgeY - AnalysisSrcEdgeY(bc.dstBlockEdgeY);
+   x0 += dx;  x1 += dx;
+   y0 += dy;  y1 += dy;
+   return true;
+}
+
+template<class T>
+void BasicEnlarger<T>::AnalysisWindow(int & x0, int & y0, int & x1, int & y1) {
+   x0 -= analysisHalo;  y0 -= analysisHalo;
+   x1 += analysisHalo;  y1 += analysisHalo;
+   x0 = x0 < 0 ? 0 : x0 & ~1;
+   y0 = y0 < 0 ? 0 : y0 & ~1;
+   if(x1 > sizeAnalysisBlockX) x1 = sizeAnalysisBlockX;
+   if(y1 > sizeAnalysisBlockY) y1 = sizeAnalysisBlockY;
+}
+
+template<class T>
+void BasicEnlarger<T>::ReshapeSrcArrays(BlockContext<T> & bc, int sx, int sy) {
+   bc.srcBlock->Reshape(sx, sy);
+   bc.dX ->Reshape(sx, sy);  bc.dY ->Reshape(sx, sy);
+   bc.d2X->Reshape(sx, sy);  bc.d2Y->Reshape(sx, sy);
+   bc.dXY->Reshape(sx, sy);  bc.d2L->Reshape(sx, sy);
+   bc.baseWeights  ->Reshape(sx, sy);
+   bc.workMask     ->Reshape(sx, sy);
+   bc.baseIntensity->Reshape(sx, sy);
+}
+
+template<class T>
+void BasicEnlarger<T>::ViewSrcArrays(BlockContext<T> & bc, BlockContext<T> & ac) {
+   int sx = ac.srcBlock->SizeX(), sy = ac.srcBlock->SizeY();
+   bc.srcBlock->SetView(ac.srcBlock->Buffer(), sx, sy);
+   bc.dX ->SetView(ac.dX ->Buffer(), sx, sy);  bc.dY ->SetView(ac.dY ->Buffer(), sx, sy);
+   bc.d2X->SetView(ac.d2X->Buffer(), sx, sy);  bc.d2Y->SetView(ac.d2Y->Buffer(), sx, sy);
+   bc.dXY->SetView(ac.dXY->Buffer(), sx, sy);  bc.d2L->SetView(ac.d2L->Buffer(), sx, sy);
+   bc.baseWeights  ->SetView(ac.baseWeights  ->Buffer(), sx, sy);
+   bc.workMask     ->SetView(ac.workMask     ->Buffer(), sx, sy);
+   bc.baseIntensity->SetView(ac.baseIntensity->Buffer(), sx, sy);
+}
+
+template<class T>
+void BasicEnlarger<T>::AnalysisBlocks(int ax, int ay, int & x0, int & y0, int & x1, int & y1) const {
+   x0 = BlockGridPos(clipX0) > ax ? BlockGridPos(clipX0) : ax;
+   y0 = BlockGridPos(clipY0) > ay ? BlockGridPos(clipY0) : ay;
+   x1 = clipX1 < ax + analysisLen ? clipX1 : ax + analysisLen;
+   y1 = clipY1 < ay + analysisLen ? clipY1 : ay + analysisLen;
+}
+
+template<class T>
+void BasicEnlarger<T>::ClearAnalysis(BlockContext<T> & bc) {
+   bc.dX->Clear();  bc.dY->Clear();
+   bc.d2X->Clear(); bc.d2Y->Clear();
+   bc.dXY->Clear(); bc.d2L->Clear();
+   bc.baseWeights->Clear();
+   bc.workMask->Clear();
+   bc.baseIntensity->Clear();
+}
+
+template<class T>
+void BasicEnlarger<T>::AnalyseSrcBlock(BlockContext<T> & ac) {
+   ReadSrcBlock(ac);
+   SrcBlockReduceNoise(ac);
+   SrcBlockSharpen(ac);
+   CalcBaseWeights(ac);
+   analysedPixels += ac.srcBlock->Count();
+}
+
+template<class T>
+void BasicEnlarger<T>::ReadSrcBlock(BlockContext<T> & bc) {
    // copy data, pos outside src is ok, filled with margin-data
    //srcBlock->CopyFromArray(src, SrcBlockEdgeX(), SrcBlockEdgeY());
-   int x,y,sx,sy;
+   int x,y,sy;
    if(OnlyShrinking())
       return;
 
-   T  *dst;
+   T  *dst, *dstLast=0;
    int srcSizeX = SizeSrcX();
-   int srcSizeY = SizeSrcY();;
-   int blockSizeX = SizeSrcBlockX();
-   int blockSizeY = SizeSrcBlockY();
-   int srcEdgeX = SrcBlockEdgeX();
-   int srcEdgeY = SrcBlockEdgeY();
-   dst = CurrentSrcBlock()->Buffer();
-
-   y=0;sy=srcEdgeY;
-   // while dst outside: copy pixels of src-line 0
-   while(sy<=0 && y < blockSizeY) {
-      x=0;sx=srcEdgeX;
-      // while dst outside: write src-edge-pixel
-	  while(sx<0 && x < blockSizeX) {
-		 ReadSrcPixel(0         , 0   , *dst);  dst++; x++; sx++;
-      }
-      // copy pixels of src-line 0
-	  while(sx < srcSizeX - 1 && x < blockSizeX) {
-		 ReadSrcPixel(sx        , 0   , *dst);  dst++; x++; sx++;
-      }
-      // while dst outside: write src-edge-pixel
-	  while(x < blockSizeX) {
-		 ReadSrcPixel(srcSizeX-1, 0   , *dst);  dst++; x++; sx++;
+   int srcSizeY = SizeSrcY();
+   int blockSizeX = bc.srcBlock->SizeX();   // window of the srcBlock (see AnalysisBegin)
+   int blockSizeY = bc.srcBlock->SizeY();
+   int srcEdgeX = bc.srcBlockEdgeX;
+   int srcEdgeY = bc.srcBlockEdgeY;
+   dst = bc.srcBlock->Buffer();
+
+   // the part of each block-line inside src: [xIn0, xIn1)
+   int xIn0 = -srcEdgeX, xIn1 = srcSizeX - srcEdgeX;
+   if(xIn0 < 0)          xIn0 = 0;
+   if(xIn0 > blockSizeX) xIn0 = blockSizeX;
+   if(xIn1 > blockSizeX) xIn1 = blockSizeX;
+   if(xIn1 < xIn0)       xIn1 = xIn0;
+
+   int syLast = -1;
+   for(y=0; y<blockSizeY; y++, dst += blockSizeX) {
+      // outside src: use the border-line
+      sy = srcEdgeY + y;
+      if(sy < 0)         sy = 0;
+      if(sy >= srcSizeY) sy = srcSizeY - 1;
+
+      // same src-line as the line before (above/below src): copy
+      if(sy == syLast) {
+         for(x=0; x<blockSizeX; x++)
+            dst[x] = dstLast[x];
+         continue;
       }
-      y++;sy++;
-   }
 
-   while(sy < srcSizeY - 1 && y < blockSizeY) {
-      x=0; sx=srcEdgeX;
-      // while dst outside: write src-border-pixel
-	  while(sx<0 && x < blockSizeX) {
-		 ReadSrcPixel(0         , sy  , *dst);  dst++; x++; sx++;
-      }
-      // copy pixels normally
-	  while(sx < srcSizeX - 1 && x < blockSizeX) {
-		 ReadSrcPixel(sx        , sy  , *dst);  dst++; x++; sx++;
+      // read the inner part in one go, fill the outside parts with the border-pixels
+      if(xIn1 > xIn0) {
+         ReadSrcSpan(srcEdgeX + xIn0, sy, xIn1 - xIn0, dst + xIn0);
+         for(x=0; x<xIn0; x++)
+            dst[x] = dst[xIn0];
+         for(x=xIn1; x<blockSizeX; x++)
+            dst[x] = dst[xIn1 - 1];
       }
-      // while dst outside: write src-border-pixel
-	  while(x < blockSizeX) {
-		 ReadSrcPixel(srcSizeX-1, sy  , *dst);  dst++; x++; sx++;
+      else {   // block completely left/right of src
+         ReadSrcSpan(xIn0 > 0 ? 0 : srcSizeX - 1, sy, 1, dst);
+         for(x=1; x<blockSizeX; x++)
+            dst[x] = dst[0];
       }
-      y++;sy++;
-   }
-
-   // for outside-parts: copy pixels of last src-line
-   while(y < blockSizeY) {
-      x=0;sx=srcEdgeX;
-      // while dst outside: write src-edge-pixel
-	  while(sx<0 && x < blockSizeX) {
-		 ReadSrcPixel(0         , srcSizeY-1 , *dst);  dst++; x++; sx++;
-      }
-      // copy pixels of last src-line
-	  while(sx < srcSizeX - 1 && x < blockSizeX) {
-		 ReadSrcPixel(sx        , srcSizeY-1 , *dst);  dst++; x++; sx++;
-      }
-      // while dst outside: write src-edge-pixel
-	  while(x < blockSizeX) {
-		 ReadSrcPixel(srcSizeX-1, srcSizeY-1 , *dst);  dst++; x++; sx++;
-      }
-      y++;sy++;
+      dstLast = dst;
+      syLast  = sy;
    }
 }
 
 template<class T>
-void BasicEnlarger<T>::WriteDstBlock(void) {
+void BasicEnlarger<T>::WriteDstBlock(BlockContext<T> & bc) {
    // offsetX, offsetY: new addition to allow black margins in output
-   int dstBX, dstBY;
+   int dstBY;
    if(OnlyShrinking())
       return;
+   if(bc.dstMaxBX <= bc.dstMinBX)
+      return;
 
-   for(dstBY = DstMinBY(); dstBY < DstMaxBY(); dstBY++) {
-	  for(dstBX = DstMinBX(); dstBX < DstMaxBX(); dstBX++) {
-         int dstCX =  dstBX + DstBlockEdgeX() - ClipX0() + offsetX;
-         int dstCY =  dstBY + DstBlockEdgeY() - ClipY0() + offsetY;
-		 WriteDstPixel(dstBlock->Get(dstBX, dstBY), dstCX, dstCY);
-      }
+   // interleave each row of the planar dstBlock for writing
+   int len = bc.dstMaxBX - bc.dstMinBX;
+   ScratchArena & scratch = *bc.scratch;
+   size_t mark = scratch.Mark();
+   T *line = scratch.Get<T>(len);
+   for(dstBY = bc.dstMinBY; dstBY < bc.dstMaxBY; dstBY++) {
+      int dstCX =  bc.dstMinBX + bc.dstBlockEdgeX - ClipX0() + offsetX;
+      int dstCY =  dstBY + bc.dstBlockEdgeY - ClipY0() + offsetY;
+	  bc.dstBlock->GetRow(bc.dstMinBX, dstBY, len, line);
+	  WriteDstSpan(line, len, dstCX, dstCY);
    }
+   scratch.Release(mark);
 }
+
 template<class T>
-void BasicEnlarger<T>::ReadSrcLine (int srcY, T  *srcLine) {
-   for(int srcX=0; srcX<SizeSrcX(); srcX++) {
-	  ReadSrcPixel(srcX , srcY, srcLine[ srcX ]);
-   }
+void BasicEnlarger<T>::ReadSrcSpan(int srcX, int srcY, int len, T *dstSpan) {
+   for(int a=0; a<len; a++)
+	  ReadSrcPixel(srcX + a, srcY, dstSpan[a]);
+}
+
+template<class T>
+void BasicEnlarger<T>::WriteDstSpan(const T *srcSpan, int len, int dstCX, int dstCY) {
+   for(int a=0; a<len; a++)
+	  WriteDstPixel(srcSpan[a], dstCX + a, dstCY);
 }
 
 template<class T>
 void BasicEnlarger<T>::WriteDstLine(int dstY, T  *dstLine) {
    // offsetX, offsetY: new addition to allow black margins in output
-   for(int dstX=ClipX0(); dstX<ClipX1(); dstX++) {
-	  WriteDstPixel(dstLine[ dstX ], dstX-ClipX0()+offsetX, dstY-ClipY0()+offsetY);
+   if(ClipX1() > ClipX0())
+	  WriteDstSpan(dstLine + ClipX0(), ClipX1() - ClipX0(), offsetX, dstY-ClipY0()+offsetY);
+}
+
+// The smooth-enlarging scrolls its 5 src-lines by one line, when the bigPos of the row
+// grows (by more than one for scale < 1): the lines at the first clipped row, scrolled from row 0
+template<class T>
+int BasicEnlarger<T>::SmoothStartLines(BlockContext<T> & bc, int *lineY) {
+   int a, srcBY, srcBYNew;
+   srcBY = CurrentSrcBlockY(bc, 0);
+   for(a=0;a<5;a++)
+      lineY[a] = srcBY+a-2;
+   for(int dstBY=1; dstBY<=bc.dstMinBY; dstBY++) {
+      srcBYNew = CurrentSrcBlockY(bc, dstBY);
+      if(srcBYNew > srcBY) {
+         srcBY = srcBYNew;
+         for(a=0;a<4;a++)
+            lineY[a] = lineY[a+1];
+         lineY[4] = srcBY+2;
+      }
    }
+   return srcBY;
 }
 
 template<class T>
-void BasicEnlarger<T>::BlockEnlargeSmooth(void) {
-   int a, srcBY, srcBYNew, dstBX, dstBY;
-   T  *line[5], *ll[5], *hl;
+void BasicEnlarger<T>::BlockEnlargeSmooth(BlockContext<T> & bc) {
+   int a, c, srcBY, srcBYNew, dstBX, dstBY;
+   float *line[5], *lineMem, *hl;
    if(OnlyShrinking())
       return;
 
+   // the 5 x-smoothed src-lines, planar: channel c of line a at line[a] + c*sizeDstBlock
+   ScratchArena & scratch = *bc.scratch;
+   size_t mark = scratch.Mark();
+   lineMem = scratch.Get<float>(5*numChannels*sizeDstBlock);
    for(a=0;a<5;a++)
-      line[a] = ll[a] = new T [sizeDstBlock];
-   srcBY = CurrentSrcBlockY(0);
+      line[a] = lineMem + a*numChannels*sizeDstBlock;
+   int dstX0 = SmoothX0(bc), dstX1 = bc.dstMaxBX;
+   int lineY[5];
+   srcBY = SmoothStartLines(bc, lineY);
    for(a=0;a<5;a++)
-	  BlockReadLineSmooth(srcBY+a-2, line[a]);
-   for(dstBY=0;dstBY<sizeDstBlock;dstBY++) {
+	  BlockReadLineSmooth(bc, lineY[a], line[a]);
+   for(dstBY=bc.dstMinBY;dstBY<bc.dstMaxBY;dstBY++) {
       int dstY;
-      float *kTabY;
-      dstY = dstBY + dstBlockEdgeY;
-	  if(dstY >= 0 && dstY < sizeYDst)
-         kTabY = enlargeKernelY[ dstY ];
-      else
-         kTabY = enlargeKernelY[0];
-	  srcBYNew = CurrentSrcBlockY(dstBY);
+      const float *kTabY;
+      dstY = dstBY + bc.dstBlockEdgeY;
+      kTabY = enlargeKernelY->Get(dstY);
+	  srcBYNew = CurrentSrcBlockY(bc, dstBY);
 
       // bigPos changed? -> scroll
 	  if(srcBYNew > srcBY) {
          srcBY = srcBYNew;
          hl=line[0]; line[0]=line[1]; line[1]=line[2];
          line[2]=line[3]; line[3]=line[4]; line[4]=hl;
-		 BlockReadLineSmooth(srcBY+2 , line[4]);
+		 BlockReadLineSmooth(bc, srcBY+2 , line[4]);
       }
-	  for(dstBX=0; dstBX < sizeDstBlock; dstBX++) {
-         T      p;
-         p  = line[0][dstBX]*kTabY[0];
-         p += line[1][dstBX]*kTabY[1];
-         p += line[2][dstBX]*kTabY[2];
-         p += line[3][dstBX]*kTabY[3];
-         p += line[4][dstBX]*kTabY[4];
-         dstBlock->Set(dstBX,dstBY,p);
+	  const float k0 = kTabY[0], k1 = kTabY[1], k2 = kTabY[2], k3 = kTabY[3], k4 = kTabY[4];
+	  for(c=0; c<numChannels; c++) {
+		 const float *l0 = line[0] + c*sizeDstBlock, *l1 = line[1] + c*sizeDstBlock;
+		 const float *l2 = line[2] + c*sizeDstBlock, *l3 = line[3] + c*sizeDstBlock;
+		 const float *l4 = line[4] + c*sizeDstBlock;
+		 float *dst = bc.dstBlock->Row(c, dstBY);
+		 for(dstBX=dstX0; dstBX < dstX1; dstBX++)
+			dst[dstBX] = l0[dstBX]*k0 + l1[dstBX]*k1 + l2[dstBX]*k2 + l3[dstBX]*k3 + l4[dstBX]*k4;
       }
    }
 
-   for(a=0;a<5;a++)
-      delete[] ll[a];
-
+   scratch.Release(mark);
 }
 
 template<class T>
-void BasicEnlarger<T>::BlockReadLineSmooth(int srcBY, T *line) {
+void BasicEnlarger<T>::BlockReadLineSmooth(BlockContext<T> & bc, int srcBY, float *line) {
    int srcBX, dstBX, dstX;
-   for(dstBX = 0;dstBX<sizeDstBlock;dstBX++) {
-      float *kTabX;
+   for(dstBX = SmoothX0(bc);dstBX<bc.dstMaxBX;dstBX++) {
+      const float *kTabX;
       T  p;
 
-      dstX = dstBX + dstBlockEdgeX;
-	  if(dstX >= 0 && dstX < sizeXDst)
-         kTabX = enlargeKernelX[ dstX ];
-      else
-         kTabX = enlargeKernelX[0];
-
-	  srcBX = CurrentSrcBlockX(dstBX);
-	  p  = srcBlock->Get(srcBX - 2 , srcBY) * kTabX[0];
-	  p += srcBlock->Get(srcBX - 1 , srcBY) * kTabX[1];
-	  p += srcBlock->Get(srcBX     , srcBY) * kTabX[2];
-	  p += srcBlock->Get(srcBX + 1 , srcBY) * kTabX[3];
-	  p += srcBlock->Get(srcBX + 2 , srcBY) * kTabX[4];
-      line[dstBX] = p;
+      dstX = dstBX + bc.dstBlockEdgeX;
+      kTabX = enlargeKernelX->Get(dstX);
+
+	  srcBX = CurrentSrcBlockX(bc, dstBX);
+	  p  = bc.srcBlock->Get(srcBX - 2 , srcBY) * kTabX[0];
+	  p += bc.srcBlock->Get(srcBX - 1 , srcBY) * kTabX[1];
+	  p += bc.srcBlock->Get(srcBX     , srcBY) * kTabX[2];
+	  p += bc.srcBlock->Get(srcBX + 1 , srcBY) * kTabX[3];
+	  p += bc.srcBlock->Get(srcBX + 2 , srcBY) * kTabX[4];
+	  for(int c=0; c<numChannels; c++)
+		 line[c*sizeDstBlock + dstBX] = PointData(p)[c];
    }
 }
 
 template<class T>
-void BasicEnlarger<T>::AddRandom(void) {
+void BasicEnlarger<T>::AddRandom(BlockContext<T> & bc) {
    int dstBX,dstBY;
    if(OnlyShrinking())
       return;
 
-   for(dstBY = dstMinBY; dstBY<dstMaxBY ; dstBY++) {
-	  for(dstBX = dstMinBX; dstBX<dstMaxBX ; dstBX++) {
-         float w = (2.0 * randGen->RandF() - 1.0);
-         w *= randGen->RandF();
+   for(dstBY = bc.dstMinBY; dstBY<bc.dstMaxBY ; dstBY++) {
+	  for(dstBX = bc.dstMinBX; dstBX<bc.dstMaxBX ; dstBX++) {
+         bc.RandPos(dstBX, dstBY);
+         float w = (2.0 * bc.RandF() - 1.0);
+         w *= bc.RandF();
          w *= 0.5*ditherF;
          w = 1.0 + w;
 
-		 dstBlock->Mul(dstBX, dstBY, w);
+		 bc.dstBlock->Mul(dstBX, dstBY, w);
       }
    }
 }
@@ -764,67 +913,63 @@ void BasicEnlarger<T>::AddRandom(void) {
 //----------------
 
 template<class T>
-void BasicEnlarger<T>::MaskBlockEnlargeSmooth(void) {
+void BasicEnlarger<T>::MaskBlockEnlargeSmooth(BlockContext<T> & bc) {
    int a, srcBY, srcBYNew, dstBX, dstBY;
-   float *line[5],*ll[5],*hl;
+   float *line[5],*hl;
 
+   ScratchArena & scratch = *bc.scratch;
+   size_t mark = scratch.Mark();
    for(a=0;a<5;a++)
-      line[a] = ll[a] = new float[sizeDstBlock];
-   srcBY = CurrentSrcBlockY(0);
+      line[a] = scratch.Get<float>(sizeDstBlock);
+   int dstX0 = SmoothX0(bc), dstX1 = bc.dstMaxBX;
+   int lineY[5];
+   srcBY = SmoothStartLines(bc, lineY);
    for(a=0;a<5;a++)
-	  MaskBlockReadLineSmooth(srcBY+a-2, line[a]);
-   for(dstBY=0;dstBY<sizeDstBlock;dstBY++) {
+	  MaskBlockReadLineSmooth(bc, lineY[a], line[a]);
+   for(dstBY=bc.dstMinBY;dstBY<bc.dstMaxBY;dstBY++) {
       int dstY;
-      float *kTabY;
-      dstY = dstBY + dstBlockEdgeY;
-	  if(dstY >= 0 && dstY < sizeYDst)
-         kTabY = enlargeKernelY[ dstY ];
-      else {
-         kTabY = enlargeKernelY[0];
-      }
-      srcBYNew = CurrentSrcBlockY(dstBY);
+      const float *kTabY;
+      dstY = dstBY + bc.dstBlockEdgeY;
+      kTabY = enlargeKernelY->Get(dstY);
+	  srcBYNew = CurrentSrcBlockY(bc, dstBY);
 
       // bigPos changed? -> scroll
 	  if(srcBYNew > srcBY) {
          srcBY = srcBYNew;
          hl=line[0]; line[0]=line[1]; line[1]=line[2];
          line[2]=line[3]; line[3]=line[4]; line[4]=hl;
-		 MaskBlockReadLineSmooth(srcBY+2 , line[4]);
+		 MaskBlockReadLineSmooth(bc, srcBY+2 , line[4]);
       }
-	  for(dstBX=0; dstBX < sizeDstBlock; dstBX++) {
+	  for(dstBX=dstX0; dstBX < dstX1; dstBX++) {
          float p;
          p  = line[0][dstBX]*kTabY[0];
          p += line[1][dstBX]*kTabY[1];
          p += line[2][dstBX]*kTabY[2];
          p += line[3][dstBX]*kTabY[3];
          p += line[4][dstBX]*kTabY[4];
-		 workMaskDst->Set(dstBX, dstBY, p);
+		 bc.workMaskDst->Set(dstBX, dstBY, p);
       }
    }
 
-   for(a=0;a<5;a++)
-      delete[] ll[a];
+   scratch.Release(mark);
 }
 
 template<class T>
-void BasicEnlarger<T>::MaskBlockReadLineSmooth(int srcBY, float *line) {
+void BasicEnlarger<T>::MaskBlockReadLineSmooth(BlockContext<T> & bc, int srcBY, float *line) {
    int srcBX, dstBX, dstX;
-   for(dstBX = 0;dstBX<sizeDstBlock;dstBX++) {
-      float *kTabX;
+   for(dstBX = SmoothX0(bc);dstBX<bc.dstMaxBX;dstBX++) {
+      const float *kTabX;
       float p;
 
-      dstX = dstBX + dstBlockEdgeX;
-	  if(dstX >= 0 && dstX < sizeXDst)
-         kTabX = enlargeKernelX[ dstX ];
-      else
-         kTabX = enlargeKernelX[0];
-
-	  srcBX = CurrentSrcBlockX(dstBX);
-	  p  = workMask->GetF(srcBX - 2 , srcBY) * kTabX[0];
-	  p += workMask->GetF(srcBX - 1 , srcBY) * kTabX[1];
-	  p += workMask->GetF(srcBX     , srcBY) * kTabX[2];
-	  p += workMask->GetF(srcBX + 1 , srcBY) * kTabX[3];
-	  p += workMask->GetF(srcBX + 2 , srcBY) * kTabX[4];
+      dstX = dstBX + bc.dstBlockEdgeX;
+      kTabX = enlargeKernelX->Get(dstX);
+
+	  srcBX = CurrentSrcBlockX(bc, dstBX);
+	  p  = bc.workMask->GetF(srcBX - 2 , srcBY) * kTabX[0];
+	  p += bc.workMask->GetF(srcBX - 1 , srcBY) * kTabX[1];
+	  p += bc.workMask->GetF(srcBX     , srcBY) * kTabX[2];
+	  p += bc.workMask->GetF(srcBX + 1 , srcBY) * kTabX[3];
+	  p += bc.workMask->GetF(srcBX + 2 , srcBY) * kTabX[4];
       line[dstBX] = p;
    }
 }
@@ -832,101 +977,226 @@ void BasicEnlarger<T>::MaskBlockReadLineSmooth(int srcBY, float *line) {
 
 template<class T>
 void BasicEnlarger<T>::ShrinkClip(void) {
+   BeginShrink();
+   ScratchArena scratch(ShrinkScratchBytes());
+   for(int band=0; band<NumShrinkBands(); band++)
+      ShrinkBand(band, scratch);
+   EndShrink();
+}
 
-   T  *srcLine, *addLine, *dstLine;
-   int srcY, dstX, dstY;
-   int srcY0, srcY1;
-   float floorY,ff;
-
-   srcLine = new T[ sizeX    + 2 ];
-   addLine = new T[ sizeXDst + 2 ];
-   dstLine = new T[ sizeXDst + 2 ];
-   for(dstX=0; dstX < sizeXDst; dstX++)
-       dstLine[ dstX ].SetZero();
+// the reduced src & the tables of the box-filter:
+// the state of the x- and y-recursion of the filter at each src column & row
+template<class T>
+void BasicEnlarger<T>::BeginShrink(void) {
+   int srcX, srcY, dstX, dstY;
+   float floorX, floorY, ff;
+
+   EndShrink();
+   shrinkFX = shrinkFY = 1;
+   shrinkScaleX = scaleFaktX;
+   shrinkScaleY = scaleFaktY;
+   while(2.0*shrinkScaleX <= shrinkPrefilterMax) { shrinkFX *= 2; shrinkScaleX *= 2.0; }
+   while(2.0*shrinkScaleY <= shrinkPrefilterMax) { shrinkFY *= 2; shrinkScaleY *= 2.0; }
+   shrinkSizeX = (sizeX + shrinkFX - 1) / shrinkFX;
+   shrinkSizeY = (sizeY + shrinkFY - 1) / shrinkFY;
+
+   // columns: dstPixel & the weights, stepping into the next dstPixel shares the srcPixel
+   if(clipX0>0) {
+	   shrinkSrcX0 = int(float(clipX0-1)/shrinkScaleX + 0.5);
+	   floorX = float(shrinkSrcX0)*shrinkScaleX;
+       dstX = int(floorX);
+	   floorX -= float(dstX);
+   }
+   else {
+       shrinkSrcX0 = 0;
+       dstX = 0;
+       floorX = 0.0;
+   }
+   shrinkSrcX1 = int(float(clipX1+1)/shrinkScaleX + 0.5);
+   if(shrinkSrcX1 > shrinkSizeX)
+       shrinkSrcX1 = shrinkSizeX;
+   if(shrinkSrcX1 < shrinkSrcX0)
+       shrinkSrcX1 = shrinkSrcX0;
+   shrinkColDst = new int  [shrinkSrcX1 - shrinkSrcX0 + 1];
+   shrinkColW0  = new float[shrinkSrcX1 - shrinkSrcX0 + 1];
+   shrinkColW1  = new float[shrinkSrcX1 - shrinkSrcX0 + 1];
+   for(srcX=shrinkSrcX0; srcX<shrinkSrcX1; srcX++) {
+      int i = srcX - shrinkSrcX0;
+      shrinkColDst[i] = dstX;
+      ff = floorX + shrinkScaleX - 1.0;
+      if(ff>0) {
+         shrinkColW0[i] = shrinkScaleX - ff;
+         shrinkColW1[i] = ff;
+         dstX++;
+         floorX-=1.0;
+      }
+      else {
+         shrinkColW0[i] = shrinkScaleX;
+         shrinkColW1[i] = 0.0;
+      }
+      floorX += shrinkScaleX;
+   }
 
+   // rows: dstLine & its floor before the row
    if(clipY0 > 0) {
-	   srcY0  = int(float(clipY0-1)/scaleFaktY + 0.5);
-	   floorY = float(srcY0)*scaleFaktY;
+	   shrinkSrcY0 = int(float(clipY0-1)/shrinkScaleY + 0.5);
+	   floorY = float(shrinkSrcY0)*shrinkScaleY;
 	   dstY   = int(floorY);
 	   floorY-= float(dstY);
    }
    else {
-       srcY0  = 0;
+       shrinkSrcY0 = 0;
        dstY   = 0;
        floorY = 0.0;
    }
-   srcY1  = int(float(clipY1+1)/scaleFaktY + 0.5)+1;
-   if(srcY1 > sizeY)
-       srcY1 = sizeY;
+   shrinkSrcY1  = int(float(clipY1+1)/shrinkScaleY + 0.5)+1;
+   if(shrinkSrcY1 > shrinkSizeY)
+       shrinkSrcY1 = shrinkSizeY;
+   if(shrinkSrcY1 < shrinkSrcY0)
+       shrinkSrcY1 = shrinkSrcY0;
+   shrinkRowDst   = new int  [shrinkSrcY1 - shrinkSrcY0 + 1];
+   shrinkRowFloor = new float[shrinkSrcY1 - shrinkSrcY0 + 1];
+   for(srcY = shrinkSrcY0; srcY < shrinkSrcY1; srcY++) {
+      shrinkRowDst  [srcY - shrinkSrcY0] = dstY;
+      shrinkRowFloor[srcY - shrinkSrcY0] = floorY;
+      ff = floorY + shrinkScaleY - 1.0;
+      if(ff>0) {
+         floorY-=1.0;
+         dstY++;
+      }
+      floorY += shrinkScaleY;
+   }
+}
+
+template<class T>
+void BasicEnlarger<T>::EndShrink(void) {
+   delete[] shrinkColDst;   delete[] shrinkColW0;  delete[] shrinkColW1;
+   delete[] shrinkRowDst;   delete[] shrinkRowFloor;
+   shrinkColDst = shrinkRowDst = 0;
+   shrinkColW0 = shrinkColW1 = shrinkRowFloor = 0;
+}
+
+template<class T>
+void BasicEnlarger<T>::ShrinkBand(int band, ScratchArena & scratch) {
+   int dstY0 = clipY0 + band*shrinkBandRows;
+   int dstY1 = dstY0 + shrinkBandRows;
+   if(dstY1 > clipY1)
+      dstY1 = clipY1;
+   ShrinkRows(dstY0, dstY1, scratch);
+}
+
+// srcLine, readLine, addLine & dstLine of ShrinkRows
+template<class T>
+size_t BasicEnlarger<T>::ShrinkScratchBytes(void) const {
+   size_t len = shrinkSrcX1 - shrinkSrcX0;
+   return (len + 1 + len*shrinkFX + 1 + 2*(sizeXDst + 2))*sizeof(T) + 4*scratchAlign;
+}
+
+// Box-filter: each srcLine is shrunk in x-direction (addLine) and added to the current
+// dstLine with its weight, stepping into the next dstLine shares addLine between both.
+// The band starts at the first row adding to dstY0-1 (not written), so dstY0 gets all its rows;
+// with the stored state of the filter, the rows are exactly the same as in one pass
+template<class T>
+void BasicEnlarger<T>::ShrinkRows(int dstY0, int dstY1, ScratchArena & scratch) {
+   T  *srcLine, *readLine, *addLine, *dstLine;
+   int srcY, dstX, dstY;
+   float floorY,ff;
+
+   int *rowDst = shrinkRowDst, *rowEnd = shrinkRowDst + (shrinkSrcY1 - shrinkSrcY0);
+   srcY = shrinkSrcY0 + int(std::lower_bound(rowDst, rowEnd, dstY0 - 1) - rowDst);
+   if(srcY >= shrinkSrcY1 || dstY1 <= dstY0)
+      return;
 
-   for(srcY = srcY0; srcY < srcY1; srcY++) {
-	  ReadSrcLine(srcY, srcLine);   // read srcLine,  shrink it in x-direction, resulting in addLine
+   int len = shrinkSrcX1 - shrinkSrcX0;
+   size_t mark = scratch.Mark();
+   srcLine  = scratch.Get<T>( len + 1 );
+   readLine = scratch.Get<T>( len*shrinkFX + 1 );
+   addLine  = scratch.Get<T>( sizeXDst + 2 );
+   dstLine  = scratch.Get<T>( sizeXDst + 2 );
+   for(dstX=0; dstX < sizeXDst + 2; dstX++) {
+       addLine[ dstX ].SetZero();
+       dstLine[ dstX ].SetZero();
+   }
+
+   // the colors as a plain vector of floats, only the clip-columns
+   const int n = (clipX1 - clipX0)*int(sizeof(T)/sizeof(float));
+   float *dstF = reinterpret_cast<float *>(dstLine + clipX0);
+   const float *addF = reinterpret_cast<const float *>(addLine + clipX0);
+   int i;
+
+   dstY   = shrinkRowDst  [srcY - shrinkSrcY0];
+   floorY = shrinkRowFloor[srcY - shrinkSrcY0];
+   for(; srcY < shrinkSrcY1 && dstY < dstY1; srcY++) {
+	  ReadShrinkLine(srcY, srcLine, readLine);   // read srcLine,  shrink it in x-direction, resulting in addLine
 	  ShrinkLineClip(srcLine, addLine);
-      ff = floorY + scaleFaktY - 1.0;
+      ff = floorY + shrinkScaleY - 1.0;
       if(ff>0) {  // stepping into new dstLine reached, share addLine between old and new dstLine
-		 for(dstX=clipX0; dstX<clipX1; dstX++) {
-			dstLine[ dstX ] += (scaleFaktY - ff)*addLine[ dstX ];
-         }
-		 if(dstY >= clipY0 && dstY < clipY1) {
+         const float w = shrinkScaleY - ff;
+		 for(i=0; i<n; i++)
+			dstF[i] += w*addF[i];
+		 if(dstY >= dstY0 && dstY < dstY1) {
 			WriteDstLine(dstY, dstLine);
          }
          floorY-=1.0;
          dstY++;
-		 for(dstX=clipX0; dstX<clipX1; dstX++) { // clear dstLine, fill with rest of addLine
-            dstLine[ dstX ] = ff*addLine[ dstX ];
-         }
+		 for(i=0; i<n; i++)   // clear dstLine, fill with rest of addLine
+            dstF[i] = ff*addF[i];
+      }
+	  else { // addLine fully added to current dstLine (with appropriate weight)
+         const float w = shrinkScaleY;
+		 for(i=0; i<n; i++)
+             dstF[i] += w*addF[i];
       }
-	  else  // addLine fully added to current dstLine (with appropriate weight)
-		 for(dstX=clipX0; dstX<clipX1; dstX++)
-             dstLine[ dstX ] += scaleFaktY*addLine[ dstX ];
-      floorY += scaleFaktY;
+      floorY += shrinkScaleY;
    }
-   if(dstY >= clipY0 && dstY < clipY1) {
+   if(dstY >= dstY0 && dstY < dstY1) {
 	  WriteDstLine(dstY, dstLine);
    }
+   scratch.Release(mark);
+}
+
+// line y of the reduced src: the mean of shrinkFX x shrinkFY src pixels (fewer at the edges)
+template<class T>
+void BasicEnlarger<T>::ReadShrinkLine(int y, T *srcLine, T *readLine) {
+   int len = shrinkSrcX1 - shrinkSrcX0;
+   if(shrinkFX == 1 && shrinkFY == 1) {
+      ReadSrcSpan(shrinkSrcX0, y, len, srcLine);
+      return;
+   }
 
-   delete[] srcLine;
-   delete[] addLine;
-   delete[] dstLine;
+   int x, a, r;
+   int sx0 = shrinkSrcX0*shrinkFX, sx1 = shrinkSrcX1*shrinkFX;
+   int sy0 = y*shrinkFY, sy1 = sy0 + shrinkFY;
+   if(sx1 > sizeX) sx1 = sizeX;
+   if(sy1 > sizeY) sy1 = sizeY;
+   for(x=0; x<len; x++)
+      srcLine[x].SetZero();
+   for(r=sy0; r<sy1; r++) {
+      ReadSrcSpan(sx0, r, sx1 - sx0, readLine);
+      for(x=0, a=0; a<sx1 - sx0; x++)
+         for(int e=a+shrinkFX; a<e && a<sx1 - sx0; a++)
+            srcLine[x] += readLine[a];
+   }
+   for(x=0; x<len; x++) {
+      int w = sx1 - sx0 - x*shrinkFX;
+      if(w > shrinkFX) w = shrinkFX;
+      srcLine[x] *= 1.0/float(w*(sy1 - sy0));
+   }
 }
 
+// shrink the srcLine in x-direction with the column-weights
 template<class T>
 void BasicEnlarger<T>::ShrinkLineClip(T *srcLine,  T *dstLine) {
    int srcX, dstX;
-   int srcX0, srcX1;
-   float floorX,ff;
-
-   floorX = 0.0;  // left border of current smallPixel
 
    for(dstX = clipX0; dstX<clipX1; dstX++)
-      dstLine[ dstX ].SetZero();;
+      dstLine[ dstX ].SetZero();
 
-   if(clipX0>0) {
-	   srcX0  = int(float(clipX0-1)/scaleFaktX + 0.5);
-	   floorX = float(srcX0)*scaleFaktX;
-       dstX = int(floorX);
-	   floorX -= float(dstX);
-   }
-   else {
-       srcX0 = 0;
-       dstX = 0;
-       floorX = 0.0;
-   }
-   srcX1 = int(float(clipX1+1)/scaleFaktX + 0.5);
-   if(srcX1 > sizeX)
-       srcX1 = sizeX;
-
-   for(srcX=srcX0; srcX<srcX1; srcX++) {
-      ff = floorX + scaleFaktX - 1.0;
-      if(ff>0) {  // stepping into new dstPixel reached: share srcPixel between old and new dstPixel
-		 dstLine[ dstX ] += (scaleFaktX - ff)*srcLine[ srcX ];
-         dstX++;
-         floorX-=1.0;
-         dstLine[ dstX ] = ff*srcLine[ srcX ];
-      }
-	  else // fully add srcPixel to dstPixel (weighted)
-         dstLine[ dstX ] += scaleFaktX * srcLine[ srcX ];
-      floorX += scaleFaktX;
+   for(srcX=0; srcX<shrinkSrcX1 - shrinkSrcX0; srcX++) {
+      T *d = dstLine + shrinkColDst[ srcX ];
+      d[0] += shrinkColW0[ srcX ]*srcLine[ srcX ];
+      if(shrinkColW1[ srcX ] > 0.0)   // stepping into new dstPixel: shares srcPixel
+         d[1] = shrinkColW1[ srcX ]*srcLine[ srcX ];
    }
 }
 
@@ -934,102 +1204,50 @@ void BasicEnlarger<T>::ShrinkLineClip(T *srcLine,  T *dstLine) {
 
 
 template<class T>
-void BasicEnlarger<T>::CreateKernelsFromTab(float **kerList, int kerListLen,
-                                         float *kerTab, int kerTabLen, float scaleF)
-{
-   float invScaleF = 1.0/scaleF;
-   float invFineScaleF = (1.0/scaleF) * (1.0/float(1<<kerFineExp)) ;
-   int smallPos,bigPos,k,a,tabPos;
-   // smallPos:    pos of small pixel in dst
-   // bigPos:      pos of corresp. bigPixel in src
-   // finePosKer:  fine Pos of fine-kernel-entry
-   // bigPosKer:   pos of corresp. bigPixel in src
-   for(smallPos=0;smallPos<kerListLen;smallPos++) {
-      float *ker = kerList[smallPos];
-	  for(a=0; a<5; a++) {
-         ker[a] = 0.0;
-      }
-      bigPos = int(float(smallPos)*invScaleF);
-	  for(k=0; k < kerTabLen; k++) {
-         int finePosKer,bigPosKer;
-         // get bigPixelPos of fine-kernel pixel
-         // get tabIndex by comp. to bigPos of center of kernel
-         finePosKer = float((smallPos<<kerFineExp) + k - (kerTabLen>>1));
-         finePosKer += (1<<kerFineExp)>>1; // add half smallPixel
-		 bigPosKer = int(float(finePosKer)*invFineScaleF);
-         tabPos = 2 + bigPosKer - bigPos;
-         ker[tabPos] += kerTab[k];
-      }
-
+void BasicEnlarger<T>::CreateKernels(void) {
+   // only the dst-positions of the blocks touching the clipping are needed
+   int x0 = clipX0 - maxBlockLen, x1 = clipX1 + maxBlockLen;
+   int y0 = clipY0 - maxBlockLen, y1 = clipY1 + maxBlockLen;
+
+   kernelsX = FindDirKernels(sizeXDst, sizeX, x0, x1);
+   if(!kernelsX) {
+      DirKernels *k = new DirKernels;
+      CreateDirKernels(*k, sizeXDst, sizeX, scaleFaktX, x0, x1);
+      kernelsX.reset(k);
+      AddDirKernels(kernelsX);
    }
+   kernelsY = FindDirKernels(sizeYDst, sizeY, y0, y1);
+   if(!kernelsY) {
+      DirKernels *k = new DirKernels;
+      CreateDirKernels(*k, sizeYDst, sizeY, scaleFaktY, y0, y1);
+      kernelsY.reset(k);
+      AddDirKernels(kernelsY);
+   }
+   enlargeKernelX = &kernelsX->enlarge;
+   selectKernelX  = &kernelsX->select;
+   enlargeKernelY = &kernelsY->enlarge;
+   selectKernelY  = &kernelsY->select;
 }
 
+// the kernels of one direction for the dst-positions [pos0,pos1)
 template<class T>
-void BasicEnlarger<T>::CreateKernelsFromIntegralTab(float **kerList, int kerListLen,
-                                         float *kerITab, int kerTabLen, float scaleF, int *smallToBigTab)
-{
-   float invScaleF = 1.0/scaleF;
-   float invFineScaleF = (1.0/scaleF) * (1.0/float(1<<kerFineExp)) ;
-   int smallPos,kernelStartPosFine,bigPos,k,a,tabPos;
-   // smallPos:    pos of small pixel in dst
-   // bigPos:      pos of corresp. bigPixel in src
-   // finePosKer:  fine Pos of fine-kernel-entry
-   // bigPosKer:   pos of corresp. bigPixel in src
-
-   for(smallPos=0;smallPos<kerListLen;smallPos++) {
-      float *ker = kerList[smallPos];
-	  for(a=0; a<5; a++) {
-         ker[a] = 0.0;
-      }
-      bigPos = smallToBigTab[ smallPos + smallToBigMargin ];
-      kernelStartPosFine = (smallPos<<kerFineExp) + ((1<<kerFineExp)>>1) - (kerTabLen>>1);
-	  for(a=0;a<5;a++) {
-         int bigPosKer,finePosKerLeft,finePosKerRight;
-         bigPosKer = bigPos-2+a;
-		 finePosKerLeft  = int(float( bigPosKer    <<kerFineExp)*scaleF) - kernelStartPosFine;
-		 finePosKerRight = int(float((bigPosKer+1)<<kerFineExp)*scaleF) - kernelStartPosFine;
-		 if(     finePosKerLeft  <  0        ) finePosKerLeft  = 0;
-		 else if(finePosKerLeft  >= kerTabLen) finePosKerLeft  = kerTabLen-1;
-		 if(     finePosKerRight <  0        ) finePosKerRight = 0;
-		 else if(finePosKerRight >= kerTabLen) finePosKerRight = kerTabLen-1;
-         ker[a] = kerITab[ finePosKerRight ] - kerITab[ finePosKerLeft ];
-      }
-  }
-}
-
-template<class T>
-void BasicEnlarger<T>::CreateKernels(void) {
+void BasicEnlarger<T>::CreateDirKernels(DirKernels & k, int dstLen, int srcLen, float scaleF,
+                                        int pos0, int pos1) {
    const float enlargeKernelRad = 1.8;
    const float selectKernelRad  = 1.9;
    int kernelLen;
    float *fineKernelIntegralTab;
 
-   // kernels for enlarge in x-dir
-   kernelLen = 2*int(float(1<<kerFineExp) * enlargeKernelRad * scaleFaktX) + 1;
+   // kernels for enlarge
+   kernelLen = 2*int(float(1<<kerFineExp) * enlargeKernelRad * scaleF) + 1;
    fineKernelIntegralTab = CreateSmoothEnlargeKernelIntegralTab(kernelLen);
-   CreateKernelsFromIntegralTab(enlargeKernelX , sizeXDst, fineKernelIntegralTab,
-								 kernelLen, scaleFaktX, smallToBigTabX);
+   k.enlarge.Create(fineKernelIntegralTab, kernelLen, dstLen, srcLen, scaleF, pos0, pos1);
    delete fineKernelIntegralTab;
 
-   // kernels for enlarge in y-dir
-   kernelLen = 2*int(float(1<<kerFineExp) * enlargeKernelRad * scaleFaktY) + 1;
-   fineKernelIntegralTab = CreateSmoothEnlargeKernelIntegralTab(kernelLen);
-   CreateKernelsFromIntegralTab(enlargeKernelY , sizeYDst, fineKernelIntegralTab,
-								 kernelLen, scaleFaktY, smallToBigTabY);
-   delete fineKernelIntegralTab;
-
-   // kernels for selection in x-dir
-   kernelLen = 2*int(float(1<<kerFineExp) * selectKernelRad * scaleFaktX) + 1;
+   // kernels for selection
+   kernelLen = 2*int(float(1<<kerFineExp) * selectKernelRad * scaleF) + 1;
    fineKernelIntegralTab = CreateSelectKernelIntegralTab(kernelLen);
-   CreateKernelsFromIntegralTab(selectKernelX ,  sizeXDst, fineKernelIntegralTab,
-								 kernelLen, scaleFaktX, smallToBigTabX );
-   delete fineKernelIntegralTab;
-
-   // kernels for selection in y-dir
-   kernelLen = 2*int(float(1<<kerFineExp) * selectKernelRad * scaleFaktY) + 1;
-   fineKernelIntegralTab = CreateSelectKernelIntegralTab(kernelLen);
-   CreateKernelsFromIntegralTab(selectKernelY ,  sizeYDst, fineKernelIntegralTab,
-								 kernelLen, scaleFaktY, smallToBigTabY );
+   k.select.Create(fineKernelIntegralTab, kernelLen, dstLen, srcLen, scaleF, pos0, pos1);
    delete fineKernelIntegralTab;
 }
 
@@ -1129,11 +1347,24 @@ float *BasicEnlarger<T>::CreateSelectKernelIntegralTab(int len) {
 
 template<class T>
 void BasicEnlarger<T>::CreateDiffTabs(void) {
-   int a;
-
    if(OnlyShrinking())
       return;
 
+   diffTabs = FindDiffTabs(selectPeakExp, centerWExp, centerWeightF);
+   if(!diffTabs) {
+      DiffTabs *d = new DiffTabs;
+      CreateDiffTabs(d->selectDiffTab, d->centerWeightTab);
+      diffTabs.reset(d);
+      AddDiffTabs(selectPeakExp, centerWExp, centerWeightF, diffTabs);
+   }
+   selectDiffTab   = diffTabs->selectDiffTab;
+   centerWeightTab = diffTabs->centerWeightTab;
+}
+
+template<class T>
+void BasicEnlarger<T>::CreateDiffTabs(float *selectTab, float *centerTab) {
+   int a;
+
    for(a=0; a<diffTabLen; a++) {
       float w,w0 = float(a)/float(diffTabLen);
       //
@@ -1143,7 +1374,7 @@ void BasicEnlarger<T>::CreateDiffTabs(void) {
       if(w<0.0) w=0.0;
       w = w*w*(3.0 - 2.0*w);
       w = pow_f(w,selectPeakExp);
-      selectDiffTab[a] = w;
+      selectTab[a] = w;
 
       //
       // 2. CenterWeights
@@ -1152,7 +1383,7 @@ void BasicEnlarger<T>::CreateDiffTabs(void) {
       w = pow_f(w,centerWExp);
       w = 1.0 + centerWeightF*w;
 
-      centerWeightTab[a] = w;
+      centerTab[a] = w;
    }
 
 }
@@ -1160,190 +1391,352 @@ void BasicEnlarger<T>::CreateDiffTabs(void) {
 
  // for a BigPixel (srcBX, srcBY) read surrounding 5x5
 template<class T>
-void BasicEnlarger<T>::ReadBigPixelNeighs(int srcBX, int srcBY) {
+void BasicEnlarger<T>::ReadBigPixelNeighs(BlockContext<T> & bc, int srcBX, int srcBY) {
    int x,y,xx,yy,pos;
    for(y=0;y<5;y++) {
       for(x=0;x<5;x++) {
          pos = MatPos(x,y);
          xx = srcBX - 2 + x;
          yy = srcBY - 2 + y;
-         bigPixelColor [pos] =  srcBlock->Get(xx,yy);
-         bigPixelWeight[pos] =  baseWeights->GetF(xx,yy);
-         bigPixelDX    [pos] =  dX->Get(xx,yy);
-         bigPixelDY    [pos] =  dY->Get(xx,yy);
-         bigPixelD2X   [pos] =  d2X->Get(xx,yy);
-         bigPixelD2Y   [pos] =  d2Y->Get(xx,yy);
-         bigPixelDXY   [pos] =  dXY->Get(xx,yy);
-         bigPixelD2L   [pos] =  d2L->Get(xx,yy);
-         bigPixelIntensity [pos] =  baseIntensity->GetF(xx,yy);
-
-         float ff = bigPixelD2L[pos].Norm1()*bigPixelIntensity[pos]*30.0;
+         bc.bigPixelColor [pos] =  bc.srcBlock->Get(xx,yy);
+         bc.bigPixelWeight[pos] =  bc.baseWeights->GetF(xx,yy);
+         bc.bigPixelDX    [pos] =  bc.dX->Get(xx,yy);
+         bc.bigPixelDY    [pos] =  bc.dY->Get(xx,yy);
+         bc.bigPixelD2X   [pos] =  bc.d2X->Get(xx,yy);
+         bc.bigPixelD2Y   [pos] =  bc.d2Y->Get(xx,yy);
+         bc.bigPixelDXY   [pos] =  bc.dXY->Get(xx,yy);
+         bc.bigPixelD2L   [pos] =  bc.d2L->Get(xx,yy);
+         bc.bigPixelIntensity [pos] =  bc.baseIntensity->GetF(xx,yy);
+
+         float ff = bc.bigPixelD2L[pos].Norm1()*bc.bigPixelIntensity[pos]*30.0;
          if(ff>1.0)ff=1.0;
          ff*=ff;
          ff*=ff;
          ff*=ff;
-         bigPixelCenterW[pos] = ff;  // increased weight near pixel-center
+         bc.bigPixelCenterW[pos] = ff;  // increased weight near pixel-center
+
+		 for(int c=0; c<numChannels; c++)
+			bc.neigh.color[c][pos] = PointData(bc.bigPixelColor[pos])[c];
+		 bc.neigh.intensity[pos] = bc.bigPixelIntensity[pos];
+		 bc.neigh.weight   [pos] = bc.bigPixelWeight[pos];
+		 bc.neigh.centerW  [pos] = ff;
 
          // for FractNoise: select random center of deform kernel within fractTab
 		 if(fractTab!=0 && fractNoiseF!=0.0) {
-            bigPixelFractCX [ pos ] = xx ;
-            bigPixelFractCY [ pos ] = yy;
-			fractTab->GetKerCenter(bigPixelFractCX [ pos ], bigPixelFractCY [ pos ], bigPixelFractCVal [ pos ]);
+            bc.bigPixelFractCX [ pos ] = xx + bc.srcWinX;   // pos in the full srcBlock
+            bc.bigPixelFractCY [ pos ] = yy + bc.srcWinY;
+			fractTab->GetKerCenter(bc.bigPixelFractCX [ pos ], bc.bigPixelFractCY [ pos ], bc.bigPixelFractCVal [ pos ]);
          }
       }
    }
 }
 
+// derivatives of row y (1..sizeBY-2) of the srcBlock
 template<class T>
-void BasicEnlarger<T>::ReadDerivatives(void)   {
-   int x,y;
+void BasicEnlarger<T>::ReadDerivativesRow(BlockContext<T> & bc, int y)   {
+   int x;
+   int sizeBX = bc.srcBlock->SizeX();
 
-   for(y=1;y<sizeSrcBlockY-1;y++) {
-      for(x=1;x<sizeSrcBlockX-1;x++) {
-		 T      s00 = srcBlock->Get(x-1, y-1);
-		 T      s10 = srcBlock->Get(x  , y-1);
-		 T      s20 = srcBlock->Get(x+1, y-1);
-		 T      s01 = srcBlock->Get(x-1, y  );
-		 T      s11 = srcBlock->Get(x  , y  );
-		 T      s21 = srcBlock->Get(x+1, y  );
-		 T      s02 = srcBlock->Get(x-1, y+1);
-		 T      s12 = srcBlock->Get(x  , y+1);
-		 T      s22 = srcBlock->Get(x+1, y+1);
+   for(x=1;x<sizeBX-1;x++) {
+	  T      s00 = bc.srcBlock->Get(x-1, y-1);
+	  T      s10 = bc.srcBlock->Get(x  , y-1);
+	  T      s20 = bc.srcBlock->Get(x+1, y-1);
+	  T      s01 = bc.srcBlock->Get(x-1, y  );
+	  T      s11 = bc.srcBlock->Get(x  , y  );
+	  T      s21 = bc.srcBlock->Get(x+1, y  );
+	  T      s02 = bc.srcBlock->Get(x-1, y+1);
+	  T      s12 = bc.srcBlock->Get(x  , y+1);
+	  T      s22 = bc.srcBlock->Get(x+1, y+1);
 
-         T      dx,dy,d2x,d2y,dxy, d2;
+      T      dx,dy,d2x,d2y,dxy, d2;
 
-		 dx  = 0.5*(s21 - s01);//0.25.. + 0.125*(s22 - s02 + s20 - s00);
-		 dy  = 0.5*(s12 - s10);//0.25.. + 0.125*(s22 - s20 + s02 - s00);
+	  dx  = 0.5*(s21 - s01);//0.25.. + 0.125*(s22 - s02 + s20 - s00);
+	  dy  = 0.5*(s12 - s10);//0.25.. + 0.125*(s22 - s20 + s02 - s00);
 
-         d2x =  s21 + s01 - 2.0*s11 ;
+      d2x =  s21 + s01 - 2.0*s11 ;
 
-         d2y =  s12 + s10 - 2.0*s11 ;
+      d2y =  s12 + s10 - 2.0*s11 ;
 
-         dxy = 0.25*(s22 - s20 - s02 + s00);
+      dxy = 0.25*(s22 - s20 - s02 + s00);
 
-         dX->Set(x,y,dx);   dY->Set(x,y,dy);
-         d2X->Set(x,y,d2x);  d2Y->Set(x,y,d2y);
-         dXY->Set(x,y,dxy);
+      bc.dX->Set(x,y,dx);   bc.dY->Set(x,y,dy);
+      bc.d2X->Set(x,y,d2x);  bc.d2Y->Set(x,y,d2y);
+      bc.dXY->Set(x,y,dxy);
 
-         d2  =   s00 + s02 + s20 + s22;
-		 d2 += (s10 + s12 + s01 + s21)*2.0  ;
-         d2 = s11 - (1.0/12.0)*d2;
-         d2L->Set(x,y,d2);
-      }
+      d2  =   s00 + s02 + s20 + s22;
+	  d2 += (s10 + s12 + s01 + s21)*2.0  ;
+      d2 = s11 - (1.0/12.0)*d2;
+      bc.d2L->Set(x,y,d2);
    }
+}
 
-   for(y=3;y<sizeSrcBlockY-3;y++) {
-      for(x=3;x<sizeSrcBlockX-3;x++) {
-         float sum=0.0;
-         T      c = srcBlock->Get(x,y);
-         for(int ay=0;ay<7;ay++) {
-            for(int ax=0;ax<7;ax++) {
-               sum += (srcBlock->Get(x-3+ax,y-3+ay) - c).Norm1();
-            }
-         }
-         sum = 1.0/(sum*0.5 + 0.05);
-         baseIntensity->Set(x,y,sum);
-      }
-   }
+// position of the offset (dx,dy) in the list of the 24 offsets of the 7x7-window
+// with dy>0 or dy==0 && dx>0; their negatives are the other half of the window
+static inline int HalfWindowIndex(int dx, int dy) {
+   return dy==0 ? dx-1 : 3 + (dy-1)*7 + (dx+3);
+}
+const int numHalfWindow = 24;
 
-   MyArray *bI = new MyArray(*baseIntensity);
+static inline float *RingRow(float *ring, int y, int len) { return ring + (y&3)*len; }
 
-   for(y=1;y<sizeSrcBlockY-1;y++) {
-      for(x=1;x<sizeSrcBlockX-1;x++) {
-         float iMin = 1000.0;
-         T  c = srcBlock->Get(x,y);
-         for(int ay=0;ay<3;ay++) {
-            for(int ax=0;ax<3;ax++) {
-               float v = bI->GetF(x-1+ax,y-1+ay);
-               if(iMin>v) iMin = v;
-            }
-         }
-         baseIntensity->Set(x,y,iMin);
+// baseIntensity needs the local variation sum|src(q) - src(p)|, q in the 7x7-window of p.
+// The sum depends on the center p, so no running sums: but |src(p)-src(p+d)| is also
+// the term of p+d for the offset -d. The differences of the 24 offsets d of one half
+// of the window are calculated once for row y (y < sizeBY-3) ...
+template<class T>
+void BasicEnlarger<T>::IntensityDiffRow(BlockContext<T> & bc, int y, float *diffRow)   {
+   int x,dx,dy;
+   int sizeBX = bc.srcBlock->SizeX();
+   T *src = bc.srcBlock->Buffer();
+
+   for(dy=0;dy<=3;dy++) {
+      for(dx=-3;dx<=3;dx++) {
+         if(dy==0 && dx<=0)
+            continue;
+         float *d = diffRow + HalfWindowIndex(dx, dy)*sizeBX;
+         T *s0 = src + y*sizeBX;
+         T *s1 = src + (y+dy)*sizeBX + dx;
+         int xStart = dx<0 ? -dx : 0, xEnd = dx>0 ? sizeBX-dx : sizeBX;
+         for(x=xStart;x<xEnd;x++)
+            d[x] = (s1[x] - s0[x]).Norm1();
       }
    }
-
-   delete bI;
-
-   MyArray *intensityS = baseIntensity->Smooth();
-   delete baseIntensity;
-   baseIntensity = intensityS;
-   intensityS = baseIntensity->Smooth();
-   delete baseIntensity;
-   baseIntensity = intensityS;
 }
 
-
-// calc baseWeights for BigPixels
+// ... the terms of -d are read from the diff-rows y-3..y-1 (diff: ring of 4 diff-rows).
+// The terms are summed in the order of the window.
+// intensity = 1/(0.5*sum + 0.05) for x in 3..sizeBX-4, 0 elsewhere
 template<class T>
-void BasicEnlarger<T>::CalcBaseWeights(void)   {
-   int x,y;
-
-   ReadDerivatives();
-   for(y=1;y<sizeSrcBlockY-1;y++) {
-      for(x=1;x<sizeSrcBlockX-1;x++) {
-         float dd,intensityFakt;
-         float gradNorm,laplaceNorm;
-         float dWork;   // workMask-Fakt
-
-         intensityFakt = baseIntensity->GetF(x,y);
-         gradNorm = (srcBlock->DX(x,y).Norm1() + srcBlock->DY(x,y).Norm1());
-         laplaceNorm = d2L->Get(x,y).Norm1();
+void BasicEnlarger<T>::IntensitySumRow(BlockContext<T> & bc, int y, float *diff, float *intensity)   {
+   int x,dx,dy;
+   int sizeBX = bc.srcBlock->SizeX();
+   int diffRowLen = numHalfWindow*sizeBX;
+
+   for(x=0;x<sizeBX;x++)
+      intensity[x] = 0.0;
+   for(dy=-3;dy<=3;dy++) {
+      for(dx=-3;dx<=3;dx++) {
+         const float *d;
+         if(dy>0 || (dy==0 && dx>0))
+            d = diff + (y&3)*diffRowLen + HalfWindowIndex(dx, dy)*sizeBX;
+         else if(dy<0 || dx<0)
+            d = diff + ((y+dy)&3)*diffRowLen + HalfWindowIndex(-dx, -dy)*sizeBX + dx;
+         else
+            continue;   // center: 0
+         for(x=3;x<sizeBX-3;x++)
+            intensity[x] += d[x];
+      }
+   }
+   for(x=3;x<sizeBX-3;x++)
+      intensity[x] = 1.0/(intensity[x]*0.5 + 0.05);
+}
 
-         dd = 1.0 - 12.0*gradNorm*intensityFakt;
+// 1-2-1 smoothing of row y of the 3 rows r0,r1,r2 (= y-1, y, y+1), 0 at the border
+static inline void SmoothRow(const float *r0, const float *r1, const float *r2, float *dst, int len) {
+   dst[0] = dst[len-1] = 0.0;
+   for(int x=1;x<len-1;x++) {
+      float pSmooth;
+
+      pSmooth  =       r0[x-1] + 2.0f*r0[x] + r0[x+1];
+	  pSmooth += 2.0f*(r1[x-1] + 2.0f*r1[x] + r1[x+1]);
+      pSmooth +=       r2[x-1] + 2.0f*r2[x] + r2[x+1];
+      pSmooth*=0.0625f;
+      dst[x] = pSmooth;
+   }
+}
 
-         if(dd<0.0) dd=0.0; else if(dd>1.0) dd=1.0;
-         dd += 0.0001;
+// calc derivatives, baseIntensity, baseWeights & workMask for BigPixels
+// All in one pass over the rows of the srcBlock: when row i is reached, each stage
+// works on the row of its lag, its input rows are in rings of 4 rows:
+//   i-1 : derivatives              (src rows i-2..i)
+//   i-3 : intensity (7x7)          (src rows i-6..i, as diff-rows)
+//   i-4 : 3x3 min of intensity
+//   i-5 : smoothed min
+//   i-6 : smoothed again -> baseIntensity, first weights & workMask
+//   i-7 : final baseWeights (3x3 of the first weights), smoothed workMask
+template<class T>
+void BasicEnlarger<T>::CalcBaseWeights(BlockContext<T> & bc)   {
+   int i,x,r;
+   int sizeBX = bc.srcBlock->SizeX(), sizeBY = bc.srcBlock->SizeY();   // srcBlock or analysis-tile
+   if(sizeBX<3 || sizeBY<3)
+      return;
 
-		 dWork = (20.0*gradNorm)*(intensityFakt + 0.9);
-         dWork *= dWork;
-         dWork -= 0.7;
-         if(dWork < 0.0) dWork=0.0; else if(dWork>1.0) dWork=1.0;
+   ScratchArena & scratch = *bc.scratch;
+   size_t mark = scratch.Mark();
+   float *diff  = scratch.Get<float>((4*numHalfWindow + 6*4 + 1)*sizeBX);
+   float *iRaw  = diff  + 4*numHalfWindow*sizeBX;  // 7x7-intensity
+   float *iMin  = iRaw  + 4*sizeBX;                // 3x3 min of it
+   float *iSm   = iMin  + 4*sizeBX;                // smoothed min
+   float *bW    = iSm   + 4*sizeBX;                // first baseWeights
+   float *wM    = bW    + 4*sizeBX;                // unsmoothed workMask
+   float *grad  = wM    + 4*sizeBX;                // gradNorm
+   float *line  = grad  + 4*sizeBX;                // one row, temp. of the stages
+   PFloat *bIBuf = bc.baseIntensity->Buffer();
+   PFloat *bWBuf = bc.baseWeights->Buffer();
+   PFloat *wMBuf = bc.workMask->Buffer();
+
+   for(i=0;i<sizeBY+7;i++) {
+      r = i-1;
+      if(r>=1 && r<sizeBY-1)
+         ReadDerivativesRow(bc, r);
+
+      r = i-3;
+      if(r>=0 && r<sizeBY) {
+         float *raw = RingRow(iRaw, r, sizeBX);
+         if(r<sizeBY-3)
+            IntensityDiffRow(bc, r, diff + (r&3)*numHalfWindow*sizeBX);
+         if(r>=3 && r<sizeBY-3)
+            IntensitySumRow(bc, r, diff, raw);
+         else
+            for(x=0;x<sizeBX;x++) raw[x] = 0.0;
+      }
 
-         baseWeights->Set(x,y,dd);
-         workMask->Set(x,y,dWork);
+      r = i-4;
+      if(r>=0 && r<sizeBY) {
+         float *m = RingRow(iMin, r, sizeBX);
+         const float *raw = RingRow(iRaw, r, sizeBX);
+         if(r>=1 && r<sizeBY-1) {
+            const float *raw0 = RingRow(iRaw, r-1, sizeBX), *raw2 = RingRow(iRaw, r+1, sizeBX);
+            for(x=0;x<sizeBX;x++) {
+               float v = raw0[x];
+               if(v>raw[x])  v = raw[x];
+               if(v>raw2[x]) v = raw2[x];
+               line[x] = v;
+            }
+            m[0] = raw[0]; m[sizeBX-1] = raw[sizeBX-1];
+            for(x=1;x<sizeBX-1;x++) {
+               float v = 1000.0;
+               if(v>line[x-1]) v = line[x-1];
+               if(v>line[x])   v = line[x];
+               if(v>line[x+1]) v = line[x+1];
+               m[x] = v;
+            }
+         }
+         else
+            for(x=0;x<sizeBX;x++) m[x] = raw[x];
+      }
 
+      r = i-5;
+      if(r>=0 && r<sizeBY) {
+         float *sm = RingRow(iSm, r, sizeBX);
+         if(r>=1 && r<sizeBY-1)
+            SmoothRow(RingRow(iMin, r-1, sizeBX), RingRow(iMin, r, sizeBX), RingRow(iMin, r+1, sizeBX), sm, sizeBX);
+         else
+            for(x=0;x<sizeBX;x++) sm[x] = 0.0;
       }
-   }
 
-   MyArray bW(*baseWeights);
-
-   for(y=1;y<sizeSrcBlockY-1;y++) {
-      for(x=1;x<sizeSrcBlockX-1;x++) {
-         float dd,cc,intensityFakt;
-         float gradNorm,laplaceNorm;
-
-         intensityFakt = baseIntensity->GetF(x,y);
-         gradNorm = (srcBlock->DX(x,y).Norm1() + srcBlock->DY(x,y).Norm1());
-         laplaceNorm = d2L->Get(x,y).Norm1();
-         float v = bW.GetF(x,y);
-
-		 dd =  ModVal2(v - bW.GetF(x-1,y-1), v - bW.GetF(x+1,y+1));
-		 dd += ModVal2(v - bW.GetF(x-1,y+1), v - bW.GetF(x+1,y-1));
-         dd *= 0.5;
-		 dd += ModVal2(v - bW.GetF(x  ,y+1), v - bW.GetF(x  ,y-1));
-		 dd += ModVal2(v - bW.GetF(x-1,y ), v - bW.GetF(x+1,y ));
-         dd*=(1.0/3.0);
-
-         dd = v - lineNegF*dd;  //0.8
-         if(dd<0.01) {
-            dd = dd*100.0;
-            dd = 1.0/(2.0 - dd);
-            dd*= 0.01;
+      r = i-6;
+      if(r>=0 && r<sizeBY) {
+         float *intensity = line;
+         float *w  = RingRow(bW,   r, sizeBX);
+         float *wm = RingRow(wM,   r, sizeBX);
+         float *g  = RingRow(grad, r, sizeBX);
+         if(r>=1 && r<sizeBY-1)
+            SmoothRow(RingRow(iSm, r-1, sizeBX), RingRow(iSm, r, sizeBX), RingRow(iSm, r+1, sizeBX), intensity, sizeBX);
+         else
+            for(x=0;x<sizeBX;x++) intensity[x] = 0.0;
+         for(x=0;x<sizeBX;x++)
+            bIBuf[x + r*sizeBX].x = intensity[x];
+
+         for(x=0;x<sizeBX;x++)
+            w[x] = wm[x] = 0.0;
+         if(r>=1 && r<sizeBY-1) {
+            for(x=1;x<sizeBX-1;x++) {
+               float dd,intensityFakt;
+               float gradNorm;
+               float dWork;   // workMask-Fakt
+
+               intensityFakt = intensity[x];
+               gradNorm = (bc.dX->Get(x,r).Norm1() + bc.dY->Get(x,r).Norm1());
+               g[x] = gradNorm;
+
+               dd = 1.0 - 12.0*gradNorm*intensityFakt;
+
+               if(dd<0.0) dd=0.0; else if(dd>1.0) dd=1.0;
+               dd += 0.0001;
+
+			   dWork = (20.0*gradNorm)*(intensityFakt + 0.9);
+               dWork *= dWork;
+               dWork -= 0.7;
+               if(dWork < 0.0) dWork=0.0; else if(dWork>1.0) dWork=1.0;
+
+               w[x]  = dd;
+               wm[x] = dWork;
+            }
          }
-         dd = pow_f(dd,sharpExp);  // Sharpness!
+      }
 
-         cc = 1.0 - 12.0*gradNorm*intensityFakt;
-         if(cc<0.0) cc=0.0; else if(cc>1.0) dd=1.0;
-		 cc = 10.0*laplaceNorm*intensityFakt*(0.4 + cc);
-         if(cc>1.0)cc=1.0;
-         cc = pow_f(cc,2.0);
-         dd+= linePosF*cc;
-         if(dd<0.0) dd=0.0;
+      r = i-7;
+      if(r>=0 && r<sizeBY) {
+         PFloat *bWRow = bWBuf + r*sizeBX;
+         PFloat *wMRow = wMBuf + r*sizeBX;
+         const float *w0 = RingRow(bW, r-1, sizeBX), *w1 = RingRow(bW, r, sizeBX), *w2 = RingRow(bW, r+1, sizeBX);
+         const float *g = RingRow(grad, r, sizeBX);
+
+         for(x=0;x<sizeBX;x++)
+            bWRow[x].x = wMRow[x].x = 0.0;
+         if(r>=1 && r<sizeBY-1) {
+            for(x=1;x<sizeBX-1;x++) {
+               float dd,cc,intensityFakt;
+               float gradNorm,laplaceNorm;
+
+               intensityFakt = bIBuf[x + r*sizeBX].x;
+               gradNorm = g[x];
+               laplaceNorm = bc.d2L->Get(x,r).Norm1();
+               float v = w1[x];
+
+			   dd =  ModVal2(v - w0[x-1], v - w2[x+1]);
+			   dd += ModVal2(v - w2[x-1], v - w0[x+1]);
+               dd *= 0.5;
+			   dd += ModVal2(v - w2[x  ], v - w0[x  ]);
+			   dd += ModVal2(v - w1[x-1], v - w1[x+1]);
+               dd*=(1.0/3.0);
+
+               dd = v - lineNegF*dd;  //0.8
+               if(dd<0.01) {
+                  dd = dd*100.0;
+                  dd = 1.0/(2.0 - dd);
+                  dd*= 0.01;
+               }
+               dd = pow_f(dd,sharpExp);  // Sharpness!
 
-         baseWeights->Set(x,y,dd);
+               cc = 1.0 - 12.0*gradNorm*intensityFakt;
+               if(cc<0.0) cc=0.0; else if(cc>1.0) dd=1.0;
+			   cc = 10.0*laplaceNorm*intensityFakt*(0.4 + cc);
+               if(cc>1.0)cc=1.0;
+               cc = sqr_f(cc);
+               dd+= linePosF*cc;
+               if(dd<0.0) dd=0.0;
+
+               bWRow[x].x = dd;
+            }
+            SmoothRow(RingRow(wM, r-1, sizeBX), RingRow(wM, r, sizeBX), RingRow(wM, r+1, sizeBX), line, sizeBX);
+            for(x=1;x<sizeBX-1;x++)
+               wMRow[x].x = line[x];
+         }
       }
    }
-   workMask->Smoothen();
+   scratch.Release(mark);
+}
+
+template<class T>
+size_t BasicEnlarger<T>::ScratchBytes(int sx, int sy, int len) {
+   size_t al = scratchAlign, bytes = 0, b;
+   size_t loX = (sx+2)>>1, loY = (sy+2)>>1;
+
+   b = sizeof(T)*(size_t(sx)*sy + 5*loX*loY + 6*loX) + 4*al;   // ReduceNoise
+   if(b > bytes) bytes = b;
+   b = sizeof(T)*2*sx + al;                                    // Sharpen
+   if(b > bytes) bytes = b;
+   b = sizeof(float)*(4*numHalfWindow + 6*4 + 1)*sx + al;      // CalcBaseWeights
+   if(b > bytes) bytes = b;
+   b = sizeof(float)*5*numChannels*len + al;                   // BlockEnlargeSmooth
+   if(b > bytes) bytes = b;
+   b = sizeof(float)*5*len + 5*al;                             // MaskBlockEnlargeSmooth
+   if(b > bytes) bytes = b;
+   b = sizeof(T)*len + al;                                     // WriteDstBlock
+   if(b > bytes) bytes = b;
+   return bytes;
 }
 
 //
@@ -24,7 +24,6 @@ along with this program; if not, see <http://www.gnu.org/licenses/>.
 
 #include "FractTab.h"
 #include "ArraysTemplateDefs.h"
-#include <QImage>
 
 FractTab::FractTab(float sF) : scaleF(sF), invScaleF(1.0/sF) {
    randTab = new int[RandTabLen];
@@ -73,34 +72,6 @@ void FractTab::AddRand(BasicArray<PFloat> *a0, float rFakt) {
    }
 }
 
-void FractTab::SaveTab(void) {
-   int x,y;
-   int sizeX = fTab.SizeX(), sizeY = fTab.SizeY();
-   QImage image(sizeX, sizeY, QImage::Format_ARGB32);
-
-   for (y=0; y<sizeY; y++)   {
-	  for (x=0; x<sizeX; x++)   {
-         float vv,rr,gg,bb;
-         vv = 0.1*fTab.Get(x,y).toF();
-		 if(vv<0)
-            vv=-vv;
-         rr = vv * 8.0;
-         if(rr>1.0) rr=1.0;
-         rr = 255.0*rr*(2.0-rr);
-         gg = vv * 2.0;
-         if(gg>1.0) gg=1.0;
-         gg = 255.0*gg*gg*(3.0 - 2.0*gg);
-         bb = vv;
-         if(bb>1.0) bb=1.0;
-         bb *= 255.0*bb;
-
-		 QRgb c = qRgba(int(rr), int(gg),  int(bb), 255);
-		 image.setPixel(x,y,c);
-      }
-   }
-   image.save("/Users/mischa/Desktop/tsttab.png");
-}
-
 void FractTab::CreateRandTab(void) {
    for(int a=0; a<RandTabLen; a++) {
       randTab[a] = a;
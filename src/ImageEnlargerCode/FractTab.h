@@ -57,6 +57,7 @@ public:
 	  centerV = fTab.Get(centerX, centerY).toF();
    }
    void CreateTab(void);
+   float ScaleF(void) const { return scaleF; }
    float GetT  (int x, int y) {
       x &= FRACTTABMASK; y &= FRACTTABMASK;
 	  return fTab.Get(x, y).toF();
@@ -64,7 +65,6 @@ public:
 
 private:
    void AddRand(BasicArray<PFloat> *a0, float rFakt);
-   void SaveTab(void);
    void CreateRandTab(void);
    int  Rand(int r) { return randTab[ r & RandTabMask ]; }
    void RandPerm(int & r1, int & r2) { // (r1,r2) -> (rand1(r1,r1),rand2(r1,r2))
@@ -0,0 +1,80 @@
+/* ----------------------------------------------------------------
+
+SmillaEnlarger  -  resize, especially magnify bitmaps in high quality
+    KernelTab.cpp: the 5-kernels of the dst-positions of one direction
+
+Copyright (C) 2009 Mischa Lusteck
+Copyright (C) 2017 Alejandro Sirgo
+
+This program is free software;
+you can redistribute it and/or modify it under the terms of the
+GNU General Public License as published by the Free Software Foundation;
+either version 3 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+---------------------------------------------------------------------- */
+
+#include <cstddef>
+#include "ConstDefs.h"
+#include "KernelTab.h"
+
+const int kernelTabAlign = 8;   // in floats
+
+// the 5-kernel of smallPos, in the float arithmetic of the dst->src mapping
+static void KernelAt(float *ker, int smallPos, const float *kerITab, int kerTabLen,
+                     float scaleF, float invScaleF) {
+   int bigPos = SmallToBigPos(smallPos, invScaleF);
+   int kernelStartPosFine = (smallPos<<kerFineExp) + ((1<<kerFineExp)>>1) - (kerTabLen>>1);
+   for(int a=0; a<5; a++) {
+      int bigPosKer,finePosKerLeft,finePosKerRight;
+      bigPosKer = bigPos-2+a;
+      finePosKerLeft  = int(float( bigPosKer    <<kerFineExp)*scaleF) - kernelStartPosFine;
+      finePosKerRight = int(float((bigPosKer+1)<<kerFineExp)*scaleF) - kernelStartPosFine;
+      if(     finePosKerLeft  <  0        ) finePosKerLeft  = 0;
+      else if(finePosKerLeft  >= kerTabLen) finePosKerLeft  = kerTabLen-1;
+      if(     finePosKerRight <  0        ) finePosKerRight = 0;
+      else if(finePosKerRight >= kerTabLen) finePosKerRight = kerTabLen-1;
+      ker[a] = kerITab[ finePosKerRight ] - kerITab[ finePosKerLeft ];
+   }
+}
+
+// the range of positions stored for [p0,p1)
+static void ClampRange(int & p0, int & p1, int dstLen) {
+   if(p0 < 0)      p0 = 0;
+   if(p1 > dstLen) p1 = dstLen;
+   if(p1 <= p0)    p1 = p0 + 1;
+}
+
+void KernelTab::Create(const float *kerITab, int kerTabLen, int dLen, int sLen, float scaleF,
+                       int p0, int p1) {
+   float invScaleF = 1.0/scaleF;
+   dstLen = dLen;
+   srcLen = sLen;
+   ClampRange(p0, p1, dstLen);
+   pos0 = p0;
+   len  = p1 - p0;
+
+   delete[] mem;
+   mem = new float[5*len + kernelTabAlign];
+   tab = mem;
+   while((reinterpret_cast<size_t>(tab) & (kernelTabAlign*sizeof(float) - 1)) != 0)
+      tab++;
+   for(int a=0; a<len; a++)
+      KernelAt(tab + 5*a, pos0 + a, kerITab, kerTabLen, scaleF, invScaleF);
+   KernelAt(outsideKer, 0, kerITab, kerTabLen, scaleF, invScaleF);
+}
+
+bool KernelTab::Covers(int dLen, int sLen, int p0, int p1) const {
+   if(tab == 0 || dLen != dstLen || sLen != srcLen)
+      return false;
+   ClampRange(p0, p1, dstLen);
+   return p0 >= pos0 && p1 <= pos0 + len;
+}
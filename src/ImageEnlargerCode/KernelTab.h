@@ -0,0 +1,63 @@
+/* ----------------------------------------------------------------
+
+SmillaEnlarger  -  resize, especially magnify bitmaps in high quality
+    KernelTab.h: the 5-kernels of the dst-positions of one direction
+
+Copyright (C) 2009 Mischa Lusteck
+Copyright (C) 2017 Alejandro Sirgo
+
+This program is free software;
+you can redistribute it and/or modify it under the terms of the
+GNU General Public License as published by the Free Software Foundation;
+either version 3 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+---------------------------------------------------------------------- */
+
+#ifndef KERNEL_TAB_H
+#define KERNEL_TAB_H
+
+// bigPos (src) of smallPos (dst), invScaleF = srcLen/dstLen
+inline int SmallToBigPos(int smallPos, float invScaleF) {
+   return int(float(smallPos)*invScaleF);
+}
+
+// For each dst-position the weights of the 5 src-pixels bigPos-2..bigPos+2,
+// 5 floats per position, in one aligned table.
+// Only the positions [pos0,pos1) are stored (the clipping & its blocks).
+// Positions outside [0,dstLen) get the kernel of pos 0.
+class KernelTab {
+   float *mem;          // allocated
+   float *tab;          // aligned start
+   int    pos0, len;    // first position & number of positions in tab
+   int    dstLen, srcLen;
+   float  outsideKer[5];
+
+public:
+   KernelTab(void) : mem(0), tab(0), pos0(0), len(0), dstLen(0), srcLen(0) {}
+   ~KernelTab(void) { delete[] mem; }
+
+   // kerITab: integral of the fine kernel (kerFineExp finer than dst), kerTabLen entries
+   // scaleF = dstLen/srcLen as float
+   void Create(const float *kerITab, int kerTabLen, int dstLen, int srcLen, float scaleF,
+               int pos0, int pos1);
+
+   const float *Get(int pos) const {
+      if(pos < 0 || pos >= dstLen)
+         return outsideKer;
+      return tab + 5*(pos - pos0);
+   }
+   // created for dstLen/srcLen, holding all positions in [pos0,pos1)?
+   bool Covers(int dstLen, int srcLen, int pos0, int pos1) const;
+   int Len(void) const { return len; }
+};
+
+#endif // KERNEL_TAB_H
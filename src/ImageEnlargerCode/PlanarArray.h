@@ -0,0 +1,119 @@
+/* ----------------------------------------------------------------
+
+SmillaEnlarger  -  resize, especially magnify bitmaps in high quality
+    PlanarArray.h: 2-dim. array of Point/Point4, stored as one float-plane per channel
+
+Copyright (C) 2009 Mischa Lusteck
+Copyright (C) 2017 Alejandro Sirgo
+
+This program is free software;
+you can redistribute it and/or modify it under the terms of the
+GNU General Public License as published by the Free Software Foundation;
+either version 3 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+---------------------------------------------------------------------- */
+
+#ifndef PLANAR_ARRAY_H
+#define PLANAR_ARRAY_H
+
+#include <cstddef>
+
+const int planeAlign = 8;   // in floats: planes & rows start at 32 byte boundaries
+
+// Same access as BasicArray<T> (Get, Set, Mul, Clamp01), but the channels are not
+// interleaved: each channel is a plane of floats, each row of a plane starts aligned,
+// rows are padded to Stride() floats. So loops over one channel of a row are
+// contiguous streams (SIMD). T must be a plain vector of floats (Point, Point4);
+// for reading/writing interleaved data use GetRow/SetRow.
+template<class T>
+class PlanarArray {
+   int sizeX, sizeY;
+   int stride;        // floats per row, multiple of planeAlign
+   float *mem;        // allocated memory, planes[0] is the aligned start
+   float *planes[4];
+
+public:
+   static const int numChannels = sizeof(T)/sizeof(float);
+
+   PlanarArray(int sx, int sy) : sizeX(sx), sizeY(sy) {
+      stride = (sizeX + planeAlign - 1) & ~(planeAlign - 1);
+      long planeSize = long(stride)*long(sizeY);
+      mem = new float[planeSize*numChannels + planeAlign];
+      float *p = mem;
+	  while((reinterpret_cast<size_t>(p) & (planeAlign*sizeof(float) - 1)) != 0)
+         p++;
+	  for(int c=0; c<numChannels; c++)
+         planes[c] = p + c*planeSize;
+	  for(long i=0; i<planeSize*numChannels; i++)
+         p[i] = 0.0;
+   }
+   ~PlanarArray(void) { delete[] mem; }
+
+   int SizeX(void)  const { return sizeX; }
+   int SizeY(void)  const { return sizeY; }
+   int Stride(void) const { return stride; }
+   float *Plane(int c) { return planes[c]; }
+   float *Row(int c, int y) { return planes[c] + long(y)*stride; }
+
+   T Get(int x, int y) {
+      T p;
+      float *f = reinterpret_cast<float*>(&p);
+      long pos = x + long(y)*stride;
+	  for(int c=0; c<numChannels; c++)
+         f[c] = planes[c][pos];
+      return p;
+   }
+   void Set(int x, int y, T p) {
+      const float *f = reinterpret_cast<const float*>(&p);
+      long pos = x + long(y)*stride;
+	  for(int c=0; c<numChannels; c++)
+         planes[c][pos] = f[c];
+   }
+   void Mul(int x, int y, float a) {
+      long pos = x + long(y)*stride;
+	  for(int c=0; c<numChannels; c++)
+         planes[c][pos] *= a;
+   }
+
+   // interleaved copy of len pixels of row y, starting at x
+   void GetRow(int x, int y, int len, T *dst) {
+	  for(int c=0; c<numChannels; c++) {
+         const float *src = Row(c, y) + x;
+		 for(int a=0; a<len; a++)
+            reinterpret_cast<float*>(dst + a)[c] = src[a];
+      }
+   }
+   void SetRow(int x, int y, int len, const T *src) {
+	  for(int c=0; c<numChannels; c++) {
+         float *dst = Row(c, y) + x;
+		 for(int a=0; a<len; a++)
+            dst[a] = reinterpret_cast<const float*>(src + a)[c];
+      }
+   }
+
+   void Clamp01(void) { Clamp01(0, 0, sizeX, sizeY); }
+   // only the rect [x0,x1) x [y0,y1) (clipped block)
+   void Clamp01(int x0, int y0, int x1, int y1) {
+	  for(int c=0; c<numChannels; c++) {
+		 for(int y=y0; y<y1; y++) {
+            float *r = Row(c, y);
+			for(int x=x0; x<x1; x++) {
+               float v = r[x];
+               v = v < 0.0f ? 0.0f : v;
+               r[x] = v > 1.0f ? 1.0f : v;
+            }
+         }
+      }
+   }
+};
+
+#endif // PLANAR_ARRAY_H
@@ -0,0 +1,79 @@
+/* ----------------------------------------------------------------
+
+SmillaEnlarger  -  resize, especially magnify bitmaps in high quality
+    ScratchArena.cpp: reusable temp. memory of a worker
+
+Copyright (C) 2009 Mischa Lusteck
+Copyright (C) 2017 Alejandro Sirgo
+
+This program is free software;
+you can redistribute it and/or modify it under the terms of the
+GNU General Public License as published by the Free Software Foundation;
+either version 3 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+---------------------------------------------------------------------- */
+
+#include <atomic>
+#include "ScratchArena.h"
+
+static std::atomic<long> heapAllocs(0);
+
+long ScratchArena::HeapAllocs(void) { return heapAllocs.load(); }
+
+// allocate with space for the alignment
+static char *NewMem(size_t bytes) {
+   heapAllocs++;
+   return new char[bytes + scratchAlign];
+}
+
+static char *Aligned(char *p) {
+   size_t off = reinterpret_cast<size_t>(p) & (scratchAlign - 1);
+   return off == 0 ? p : p + (scratchAlign - off);
+}
+
+ScratchArena::ScratchArena(size_t bytes)
+   : size(bytes), used(0), maxUsed(0), overflow(0) {
+   memAlloc = NewMem(size);
+   mem = Aligned(memAlloc);
+}
+
+ScratchArena::~ScratchArena(void) {
+   FreeOverflow();
+   delete[] memAlloc;
+}
+
+// an extra piece: [next piece][alignment][bytes]
+char *ScratchArena::Overflow(size_t bytes) {
+   char *p = NewMem(bytes + scratchAlign);
+   *reinterpret_cast<char **>(p) = overflow;
+   overflow = p;
+   return Aligned(p + sizeof(char *));
+}
+
+void ScratchArena::FreeOverflow(void) {
+   while(overflow != 0) {
+      char *next = *reinterpret_cast<char **>(overflow);
+      delete[] overflow;
+      overflow = next;
+   }
+}
+
+// all released: free the extra pieces, in future take the max. size at once
+void ScratchArena::Rebuild(void) {
+   FreeOverflow();
+   if(maxUsed > size) {
+      delete[] memAlloc;
+      size = maxUsed;
+      memAlloc = NewMem(size);
+      mem = Aligned(memAlloc);
+   }
+}
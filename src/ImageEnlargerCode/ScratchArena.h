@@ -0,0 +1,77 @@
+/* ----------------------------------------------------------------
+
+SmillaEnlarger  -  resize, especially magnify bitmaps in high quality
+    ScratchArena.h: reusable temp. memory of a worker
+
+Copyright (C) 2009 Mischa Lusteck
+Copyright (C) 2017 Alejandro Sirgo
+
+This program is free software;
+you can redistribute it and/or modify it under the terms of the
+GNU General Public License as published by the Free Software Foundation;
+either version 3 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+---------------------------------------------------------------------- */
+
+#ifndef SCRATCH_ARENA_H
+#define SCRATCH_ARENA_H
+
+#include <cstddef>
+
+const size_t scratchAlign = 32;   // bytes: each buffer starts aligned (SIMD)
+
+// Temp. buffers of the block-passes, taken from one piece of memory, sized at construction.
+// Usage:  size_t mark = scratch.Mark();  ... p = scratch.Get<float>(n); ...  scratch.Release(mark);
+// The memory is not initialized.
+// If the size is too small, Get takes an extra piece from the heap; when the arena is released
+// completely, it's rebuilt with the max. size used, so the next blocks allocate nothing.
+// HeapAllocs counts the heap allocations of all arenas, only theirs. That warmed contexts
+// allocate nothing at all is checked by tests/EngineRegress.cpp.
+class ScratchArena {
+   char  *memAlloc;   // allocated
+   char  *mem;        // aligned start
+   size_t size;       // usable bytes at mem
+   size_t used;       // incl. the overflow pieces
+   size_t maxUsed;
+   char  *overflow;   // list of the extra pieces, linked by their first bytes
+
+   char *Overflow(size_t bytes);
+   void  FreeOverflow(void);
+   void  Rebuild(void);
+
+public:
+   ScratchArena(size_t bytes);
+   ~ScratchArena(void);
+
+   template<class U>
+   U *Get(long n) {
+      size_t bytes = (size_t(n)*sizeof(U) + scratchAlign - 1) & ~(scratchAlign - 1);
+      size_t pos = used;
+      used += bytes;
+      if(used > maxUsed)
+         maxUsed = used;
+      if(used > size)
+         return reinterpret_cast<U *>(Overflow(bytes));
+      return reinterpret_cast<U *>(mem + pos);
+   }
+   size_t Mark(void) const { return used; }
+   void Release(size_t mark) {
+      used = mark;
+      if(used == 0 && overflow != 0)
+         Rebuild();
+   }
+   size_t Size(void) const { return size; }
+
+   static long HeapAllocs(void);
+};
+
+#endif // SCRATCH_ARENA_H
@@ -0,0 +1,279 @@
+/* ----------------------------------------------------------------
+
+SmillaEnlarger  -  resize, especially magnify bitmaps in high quality
+    SelectKernel.cpp: weighting of the 5x5 neighbour BigPixels of a small pixel,
+                      scalar and SIMD versions
+
+Copyright (C) 2009 Mischa Lusteck
+Copyright (C) 2017 Alejandro Sirgo
+
+This program is free software;
+you can redistribute it and/or modify it under the terms of the
+GNU General Public License as published by the Free Software Foundation;
+either version 3 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+---------------------------------------------------------------------- */
+
+#include <math.h>
+#include "ConstDefs.h"
+#include "SelectKernel.h"
+
+// SIMD-versions only for gcc/clang on x86: compiled with target-attributes,
+// selected at runtime, so the program still runs on cpus without AVX2
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define SELECT_KERNEL_X86 1
+#include <immintrin.h>
+#endif
+
+// pos of the lanes in the 5x5 neighbourhood, padding lanes: 0
+static const float laneX[neighLen] = {
+   0,1,2,3,4, 0,1,2,3,4, 0,1,2,3,4, 0,1,2,3,4, 0,1,2,3,4, 0,0,0,0,0,0,0 };
+static const float laneY[neighLen] = {
+   0,0,0,0,0, 1,1,1,1,1, 2,2,2,2,2, 3,3,3,3,3, 4,4,4,4,4, 0,0,0,0,0,0,0 };
+static const unsigned int laneValid[neighLen] = {
+   ~0u,~0u,~0u,~0u,~0u, ~0u,~0u,~0u,~0u,~0u, ~0u,~0u,~0u,~0u,~0u, ~0u,~0u,~0u,~0u,~0u,
+   ~0u,~0u,~0u,~0u,~0u, 0,0,0,0,0,0,0 };
+
+NeighPlanes::NeighPlanes(void) {
+   for(int a=0; a<neighLen; a++) {
+	  for(int c=0; c<neighMaxChannels; c++) {
+		 color[c][a] = quad[c][a] = quadD[c][a] = quadD2[c][a] = 0.0;
+      }
+	  intensity[a] = weight[a] = centerW[a] = 0.0;
+   }
+}
+
+void IncNeighQuadrics(NeighPlanes & nb, int numChannels) {
+   for(int c=0; c<numChannels; c++) {
+      float *q = nb.quad[c], *qD = nb.quadD[c];
+      const float *qD2 = nb.quadD2[c];
+      for(int a=0; a<neighLen; a++) {
+         q [a] += qD [a];
+         qD[a] += qD2[a];
+      }
+   }
+}
+
+//----------------
+
+static void SelectNeighColorScalar(const NeighPlanes & nb, const SelectPixel & px,
+                                   const SelectTabs & tabs, float *color)
+{
+   const int   nc = tabs.numChannels;
+   const float invNc = 1.0f/float(nc);
+   float totalWeight = 0.0, acc[neighMaxChannels] = { 0.0, 0.0, 0.0, 0.0 };
+
+   for(int a=0; a<neighNum; a++) {
+      float mod[neighMaxChannels];
+      float normQ = 0.0, normD = 0.0;
+	  for(int c=0; c<nc; c++) {
+		 mod[c] = nb.quad[c][a] + nb.color[c][a];
+		 normQ += fabsf(nb.quad[c][a]);
+		 normD += fabsf(mod[c] - px.smallColor[c]);
+      }
+	  float w = 10.0f * (tabs.derivDiffF*(invNc*normQ) + invNc*normD) * nb.intensity[a];
+	  if(w > 1.0f)
+		 w = 1.0f;
+	  w = nb.weight[a] * px.kerW[a] * tabs.selectDiffTab[ int(w * float(diffTabLen-1)) ];
+
+	  // add. weight near center
+	  float dx = px.fx - laneX[a];
+	  float dy = px.fy - laneY[a];
+	  float dd = 1.0f - (dx*dx + dy*dy)*(1.0f/1.5f);
+	  if(dd < 0.0f)
+		 dd = 0.0f;
+	  w *= 1.0f + (tabs.centerWeightTab[ int(dd * float(diffTabLen-1)) ] - 1.0f)*nb.centerW[a];
+
+	  if(px.fractW != 0)
+		 w *= px.fractW[a];
+	  w += 0.000000001f;
+
+	  totalWeight += w;
+	  for(int c=0; c<nc; c++)
+		 acc[c] += w*mod[c];
+   }
+   float normF = 1.0f/totalWeight;
+   for(int c=0; c<nc; c++)
+	  color[c] = acc[c]*normF;
+}
+
+#ifdef SELECT_KERNEL_X86
+
+// 4 lanes; SSE2 has no gather, the table lookups are done lane by lane
+__attribute__((target("sse2")))
+static void SelectNeighColorSSE(const NeighPlanes & nb, const SelectPixel & px,
+                                const SelectTabs & tabs, float *color)
+{
+   const int    nc = tabs.numChannels;
+   const __m128 invNc = _mm_set1_ps(1.0f/float(nc));
+   const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+   const __m128 one  = _mm_set1_ps(1.0f);
+   const __m128 zero = _mm_setzero_ps();
+   const __m128 tabF = _mm_set1_ps(float(diffTabLen-1));
+   const __m128 derivDiffF = _mm_set1_ps(tabs.derivDiffF);
+   const __m128 fx = _mm_set1_ps(px.fx), fy = _mm_set1_ps(px.fy);
+   __m128 sc[neighMaxChannels], acc[neighMaxChannels], mod[neighMaxChannels];
+   __m128 totalWeight = zero;
+   int c;
+
+   for(c=0; c<nc; c++) {
+	  sc[c]  = _mm_set1_ps(px.smallColor[c]);
+	  acc[c] = zero;
+   }
+   for(int a=0; a<neighLen; a+=4) {
+	  if(a >= neighNum)
+		 break;
+	  __m128 normQ = zero, normD = zero;
+	  for(c=0; c<nc; c++) {
+		 __m128 q = _mm_loadu_ps(nb.quad[c] + a);
+		 mod[c] = _mm_add_ps(q, _mm_loadu_ps(nb.color[c] + a));
+		 normQ  = _mm_add_ps(normQ, _mm_and_ps(q, absMask));
+		 normD  = _mm_add_ps(normD, _mm_and_ps(_mm_sub_ps(mod[c], sc[c]), absMask));
+      }
+	  __m128 w = _mm_add_ps(_mm_mul_ps(derivDiffF, _mm_mul_ps(invNc, normQ)), _mm_mul_ps(invNc, normD));
+	  w = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(10.0f), w), _mm_loadu_ps(nb.intensity + a));
+	  w = _mm_min_ps(w, one);
+
+	  __m128 dx = _mm_sub_ps(fx, _mm_loadu_ps(laneX + a));
+	  __m128 dy = _mm_sub_ps(fy, _mm_loadu_ps(laneY + a));
+	  __m128 dd = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+	  dd = _mm_max_ps(_mm_sub_ps(one, _mm_mul_ps(dd, _mm_set1_ps(1.0f/1.5f))), zero);
+
+	  int selI[4], cenI[4];
+	  _mm_storeu_si128((__m128i*)selI, _mm_cvttps_epi32(_mm_mul_ps(w , tabF)));
+	  _mm_storeu_si128((__m128i*)cenI, _mm_cvttps_epi32(_mm_mul_ps(dd, tabF)));
+	  __m128 sel = _mm_set_ps(tabs.selectDiffTab[selI[3]], tabs.selectDiffTab[selI[2]],
+							  tabs.selectDiffTab[selI[1]], tabs.selectDiffTab[selI[0]]);
+	  __m128 cen = _mm_set_ps(tabs.centerWeightTab[cenI[3]], tabs.centerWeightTab[cenI[2]],
+							  tabs.centerWeightTab[cenI[1]], tabs.centerWeightTab[cenI[0]]);
+
+	  w = _mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(nb.weight + a), _mm_loadu_ps(px.kerW + a)), sel);
+	  w = _mm_mul_ps(w, _mm_add_ps(one, _mm_mul_ps(_mm_sub_ps(cen, one), _mm_loadu_ps(nb.centerW + a))));
+	  if(px.fractW != 0)
+		 w = _mm_mul_ps(w, _mm_loadu_ps(px.fractW + a));
+	  w = _mm_add_ps(w, _mm_set1_ps(0.000000001f));
+	  w = _mm_and_ps(w, _mm_loadu_ps((const float*)laneValid + a));
+
+	  totalWeight = _mm_add_ps(totalWeight, w);
+	  for(c=0; c<nc; c++)
+		 acc[c] = _mm_add_ps(acc[c], _mm_mul_ps(w, mod[c]));
+   }
+
+   float h[4];
+   _mm_storeu_ps(h, totalWeight);
+   float normF = 1.0f/((h[0] + h[1]) + (h[2] + h[3]));
+   for(c=0; c<nc; c++) {
+	  _mm_storeu_ps(h, acc[c]);
+	  color[c] = ((h[0] + h[1]) + (h[2] + h[3]))*normF;
+   }
+}
+
+// 8 lanes, table lookups by gather
+__attribute__((target("avx2")))
+static void SelectNeighColorAVX2(const NeighPlanes & nb, const SelectPixel & px,
+                                 const SelectTabs & tabs, float *color)
+{
+   const int    nc = tabs.numChannels;
+   const __m256 invNc = _mm256_set1_ps(1.0f/float(nc));
+   const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+   const __m256 one  = _mm256_set1_ps(1.0f);
+   const __m256 zero = _mm256_setzero_ps();
+   const __m256 tabF = _mm256_set1_ps(float(diffTabLen-1));
+   const __m256 derivDiffF = _mm256_set1_ps(tabs.derivDiffF);
+   const __m256 fx = _mm256_set1_ps(px.fx), fy = _mm256_set1_ps(px.fy);
+   __m256 sc[neighMaxChannels], acc[neighMaxChannels], mod[neighMaxChannels];
+   __m256 totalWeight = zero;
+   int c;
+
+   for(c=0; c<nc; c++) {
+	  sc[c]  = _mm256_set1_ps(px.smallColor[c]);
+	  acc[c] = zero;
+   }
+   for(int a=0; a<neighLen; a+=8) {
+	  __m256 normQ = zero, normD = zero;
+	  for(c=0; c<nc; c++) {
+		 __m256 q = _mm256_loadu_ps(nb.quad[c] + a);
+		 mod[c] = _mm256_add_ps(q, _mm256_loadu_ps(nb.color[c] + a));
+		 normQ  = _mm256_add_ps(normQ, _mm256_and_ps(q, absMask));
+		 normD  = _mm256_add_ps(normD, _mm256_and_ps(_mm256_sub_ps(mod[c], sc[c]), absMask));
+      }
+	  __m256 w = _mm256_add_ps(_mm256_mul_ps(derivDiffF, _mm256_mul_ps(invNc, normQ)), _mm256_mul_ps(invNc, normD));
+	  w = _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(10.0f), w), _mm256_loadu_ps(nb.intensity + a));
+	  w = _mm256_min_ps(w, one);
+	  __m256 sel = _mm256_i32gather_ps(tabs.selectDiffTab, _mm256_cvttps_epi32(_mm256_mul_ps(w, tabF)), 4);
+
+	  __m256 dx = _mm256_sub_ps(fx, _mm256_loadu_ps(laneX + a));
+	  __m256 dy = _mm256_sub_ps(fy, _mm256_loadu_ps(laneY + a));
+	  __m256 dd = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+	  dd = _mm256_max_ps(_mm256_sub_ps(one, _mm256_mul_ps(dd, _mm256_set1_ps(1.0f/1.5f))), zero);
+	  __m256 cen = _mm256_i32gather_ps(tabs.centerWeightTab, _mm256_cvttps_epi32(_mm256_mul_ps(dd, tabF)), 4);
+
+	  w = _mm256_mul_ps(_mm256_mul_ps(_mm256_loadu_ps(nb.weight + a), _mm256_loadu_ps(px.kerW + a)), sel);
+	  w = _mm256_mul_ps(w, _mm256_add_ps(one, _mm256_mul_ps(_mm256_sub_ps(cen, one), _mm256_loadu_ps(nb.centerW + a))));
+	  if(px.fractW != 0)
+		 w = _mm256_mul_ps(w, _mm256_loadu_ps(px.fractW + a));
+	  w = _mm256_add_ps(w, _mm256_set1_ps(0.000000001f));
+	  w = _mm256_and_ps(w, _mm256_loadu_ps((const float*)laneValid + a));
+
+	  totalWeight = _mm256_add_ps(totalWeight, w);
+	  for(c=0; c<nc; c++)
+		 acc[c] = _mm256_add_ps(acc[c], _mm256_mul_ps(w, mod[c]));
+   }
+
+   float h[8];
+   _mm256_storeu_ps(h, totalWeight);
+   float normF = 1.0f/(((h[0] + h[1]) + (h[2] + h[3])) + ((h[4] + h[5]) + (h[6] + h[7])));
+   for(c=0; c<nc; c++) {
+	  _mm256_storeu_ps(h, acc[c]);
+	  color[c] = (((h[0] + h[1]) + (h[2] + h[3])) + ((h[4] + h[5]) + (h[6] + h[7])))*normF;
+   }
+}
+
+#endif // SELECT_KERNEL_X86
+
+//----------------
+
+static SimdLevel DetectSimd(void) {
+#ifdef SELECT_KERNEL_X86
+   __builtin_cpu_init();
+   if(__builtin_cpu_supports("avx2"))
+	  return simdAVX2;
+   if(__builtin_cpu_supports("sse2"))
+	  return simdSSE;
+#endif
+   return simdNone;
+}
+
+static SimdLevel & CurrentSimd(void) {
+   static SimdLevel level = DetectSimd();
+   return level;
+}
+
+SimdLevel SelectKernelSimd(void) {
+   return CurrentSimd();
+}
+
+void ForceSimdLevel(SimdLevel level) {
+   if(level < CurrentSimd())
+	  CurrentSimd() = level;
+}
+
+void SelectNeighColor(const NeighPlanes & nb, const SelectPixel & px, const SelectTabs & tabs, float *color) {
+#ifdef SELECT_KERNEL_X86
+   switch(CurrentSimd()) {
+	  case simdAVX2: SelectNeighColorAVX2(nb, px, tabs, color); return;
+	  case simdSSE:  SelectNeighColorSSE (nb, px, tabs, color); return;
+	  default: break;
+   }
+#endif
+   SelectNeighColorScalar(nb, px, tabs, color);
+}
@@ -0,0 +1,80 @@
+/* ----------------------------------------------------------------
+
+SmillaEnlarger  -  resize, especially magnify bitmaps in high quality
+    SelectKernel.h: weighting of the 5x5 neighbour BigPixels of a small pixel,
+                    scalar and SIMD versions
+
+Copyright (C) 2009 Mischa Lusteck
+Copyright (C) 2017 Alejandro Sirgo
+
+This program is free software;
+you can redistribute it and/or modify it under the terms of the
+GNU General Public License as published by the Free Software Foundation;
+either version 3 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+---------------------------------------------------------------------- */
+
+#ifndef SELECT_KERNEL_H
+#define SELECT_KERNEL_H
+
+const int neighNum = 5*5;     // the neighbour BigPixels of a small pixel
+const int neighLen = 32;      // padded, so SIMD-vectors of 4 or 8 floats fit
+const int neighMaxChannels = 4;
+
+// The data of the 5x5 neighbour BigPixels, one plane per channel (structure of arrays).
+// Lane a = x + 5*y, the lanes neighNum..neighLen-1 are padding.
+// quad, quadD, quadD2: quadric correction of each BigPixel at the current small pixel,
+// its increment for the next small pixel in x-direction and the increment of the increment
+struct NeighPlanes {
+   float color [neighMaxChannels][neighLen];
+   float quad  [neighMaxChannels][neighLen];
+   float quadD [neighMaxChannels][neighLen];
+   float quadD2[neighMaxChannels][neighLen];
+   float intensity[neighLen];
+   float weight   [neighLen];
+   float centerW  [neighLen];
+
+   NeighPlanes(void);
+};
+
+// the per-pixel parameters of SelectNeighColor
+struct SelectPixel {
+   const float *smallColor;      // smooth-enlarged (fract-modified) color of the small pixel
+   float fx, fy;                 // pos of the small pixel relative to neighbour (0,0)
+   float kerW[neighLen];         // selection-kernel kerX*kerY for each neighbour
+   const float *fractW;          // deform factor for each neighbour, 0: none
+};
+
+// the per-enlarger constants of SelectNeighColor
+struct SelectTabs {
+   int   numChannels;
+   float derivDiffF;
+   const float *selectDiffTab;   // diffTabLen entries
+   const float *centerWeightTab; // diffTabLen entries
+};
+
+enum SimdLevel { simdNone = 0, simdSSE = 1, simdAVX2 = 2 };
+
+// weighted sum of the neighbour colors (+ quadrics) for one small pixel, written to color:
+// weight of a neighbour depends on its difference to smallColor, its intensity & weight,
+// the selection kernel, the distance to its center and the fract-deformation.
+// Uses the best SIMD-version the cpu supports.
+void SelectNeighColor(const NeighPlanes & nb, const SelectPixel & px, const SelectTabs & tabs, float *color);
+
+// step one small pixel in x-direction: quad += quadD, quadD += quadD2
+void IncNeighQuadrics(NeighPlanes & nb, int numChannels);
+
+// the SIMD-version used by SelectNeighColor; ForceSimdLevel can only lower it (for comparisons)
+SimdLevel SelectKernelSimd(void);
+void ForceSimdLevel(SimdLevel level);
+
+#endif // SELECT_KERNEL_H
@@ -0,0 +1,121 @@
+/* ----------------------------------------------------------------
+
+SmillaEnlarger  -  resize, especially magnify bitmaps in high quality
+    SetupCache.cpp: the setup-tables, shared by the enlargers
+
+Copyright (C) 2009 Mischa Lusteck
+Copyright (C) 2017 Alejandro Sirgo
+
+This program is free software;
+you can redistribute it and/or modify it under the terms of the
+GNU General Public License as published by the Free Software Foundation;
+either version 3 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+---------------------------------------------------------------------- */
+
+#include <mutex>
+#include "SetupCache.h"
+#include "FractTab.h"
+
+// a small ring of the last entries, the oldest is replaced
+const int dirKernelsListLen = 8;
+const int diffTabsListLen   = 8;
+const int fractTabListLen   = 4;
+
+static std::mutex setupMutex;
+
+static std::shared_ptr<const DirKernels> dirKernelsList[dirKernelsListLen];
+static int dirKernelsNext = 0;
+
+struct DiffTabsEntry {
+   float selectPeakExp, centerWExp, centerWeightF;
+   std::shared_ptr<const DiffTabs> tabs;
+};
+static DiffTabsEntry diffTabsList[diffTabsListLen];
+static int diffTabsNext = 0;
+
+struct FractTabEntry {
+   float scaleF;
+   std::shared_ptr<FractTab> tab;
+};
+static FractTabEntry fractTabList[fractTabListLen];
+static int fractTabNext = 0;
+
+std::shared_ptr<const DirKernels> FindDirKernels(int dstLen, int srcLen, int pos0, int pos1) {
+   std::lock_guard<std::mutex> lock(setupMutex);
+   for(int a=0; a<dirKernelsListLen; a++) {
+      const std::shared_ptr<const DirKernels> & k = dirKernelsList[a];
+	  if(k && k->enlarge.Covers(dstLen, srcLen, pos0, pos1))
+         return k;
+   }
+   return std::shared_ptr<const DirKernels>();
+}
+
+void AddDirKernels(std::shared_ptr<const DirKernels> k) {
+   std::lock_guard<std::mutex> lock(setupMutex);
+   dirKernelsList[dirKernelsNext] = k;
+   dirKernelsNext = (dirKernelsNext + 1) % dirKernelsListLen;
+}
+
+std::shared_ptr<const DiffTabs> FindDiffTabs(float selectPeakExp, float centerWExp, float centerWeightF) {
+   std::lock_guard<std::mutex> lock(setupMutex);
+   for(int a=0; a<diffTabsListLen; a++) {
+      const DiffTabsEntry & e = diffTabsList[a];
+	  if(e.tabs && e.selectPeakExp == selectPeakExp && e.centerWExp == centerWExp
+	     && e.centerWeightF == centerWeightF)
+         return e.tabs;
+   }
+   return std::shared_ptr<const DiffTabs>();
+}
+
+void AddDiffTabs(float selectPeakExp, float centerWExp, float centerWeightF,
+                 std::shared_ptr<const DiffTabs> d) {
+   std::lock_guard<std::mutex> lock(setupMutex);
+   DiffTabsEntry & e = diffTabsList[diffTabsNext];
+   e.selectPeakExp = selectPeakExp;
+   e.centerWExp    = centerWExp;
+   e.centerWeightF = centerWeightF;
+   e.tabs = d;
+   diffTabsNext = (diffTabsNext + 1) % diffTabsListLen;
+}
+
+static float *CreateInvTab(void) {
+   float *tab = new float[invTabLen];
+   tab[0] = 1000000.0;
+   for(int a=1; a<invTabLen; a++)
+      tab[a] = float(invTabLen-1)/float(a);
+   return tab;
+}
+
+const float *SharedInvTab(void) {
+   static const float *invTab = CreateInvTab();   // never freed
+   return invTab;
+}
+
+// the fractTab is created outside the lock, it takes a while
+std::shared_ptr<FractTab> SharedFractTab(float scaleF) {
+   {
+      std::lock_guard<std::mutex> lock(setupMutex);
+      for(int a=0; a<fractTabListLen; a++) {
+         const FractTabEntry & e = fractTabList[a];
+		 if(e.tab && e.scaleF == scaleF)
+            return e.tab;
+      }
+   }
+   std::shared_ptr<FractTab> tab(new FractTab(scaleF));
+   std::lock_guard<std::mutex> lock(setupMutex);
+   FractTabEntry & e = fractTabList[fractTabNext];
+   e.scaleF = scaleF;
+   e.tab = tab;
+   fractTabNext = (fractTabNext + 1) % fractTabListLen;
+   return tab;
+}
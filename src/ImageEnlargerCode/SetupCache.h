@@ -0,0 +1,62 @@
+/* ----------------------------------------------------------------
+
+SmillaEnlarger  -  resize, especially magnify bitmaps in high quality
+    SetupCache.h: the setup-tables, shared by the enlargers
+
+Copyright (C) 2009 Mischa Lusteck
+Copyright (C) 2017 Alejandro Sirgo
+
+This program is free software;
+you can redistribute it and/or modify it under the terms of the
+GNU General Public License as published by the Free Software Foundation;
+either version 3 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+---------------------------------------------------------------------- */
+
+#ifndef SETUP_CACHE_H
+#define SETUP_CACHE_H
+
+#include <memory>
+#include "ConstDefs.h"
+#include "KernelTab.h"
+
+class FractTab;
+
+// The read-only tables of the enlarger-setup, shared by all enlargers and reused by later runs
+// (preview restarts, batch-jobs of same-size images). Each kind is kept for its last few keys.
+// The entries are refcounted: an enlarger keeps its tables, even when the cache drops them.
+// Find/Add are thread-safe. Two enlargers missing the same key both create it, both are valid.
+
+// the kernels of one direction: depend on dstLen/srcLen and the range of dst-positions needed
+struct DirKernels {
+   KernelTab enlarge;
+   KernelTab select;
+};
+std::shared_ptr<const DirKernels> FindDirKernels(int dstLen, int srcLen, int pos0, int pos1);
+void AddDirKernels(std::shared_ptr<const DirKernels> k);
+
+// the weight-tabs of the selection: depend on the parameters set by sharpness & flatness
+struct DiffTabs {
+   float selectDiffTab[diffTabLen];
+   float centerWeightTab[diffTabLen];   // weight multiplied with factor increasing near center of bigPixel
+};
+std::shared_ptr<const DiffTabs> FindDiffTabs(float selectPeakExp, float centerWExp, float centerWeightF);
+void AddDiffTabs(float selectPeakExp, float centerWExp, float centerWeightF,
+                 std::shared_ptr<const DiffTabs> d);
+
+// table for x -> 1/x (for inner loop), invTabLen entries, created once
+const float *SharedInvTab(void);
+
+// the plasma fractal of a scale factor, created on a miss
+std::shared_ptr<FractTab> SharedFractTab(float scaleF);
+
+#endif // SETUP_CACHE_H
@@ -30,6 +30,7 @@ along with this program; if not, see <http://www.gnu.org/licenses/>.
 using namespace std;
 
 #include <time.h>
+#include <chrono>
 
 
 // Performance-Messung von Programmstuecken
@@ -50,6 +51,21 @@ public:
    double Get(void) {return double(timer)/(CLOCKS_PER_SEC);}
 };
 
+// same with wall-clock time: clock() sums up the time of all threads
+class WallTimer
+{
+   std::chrono::steady_clock::duration timer;
+   std::chrono::steady_clock::time_point hilf;
+public:
+   WallTimer(void) {timer=std::chrono::steady_clock::duration::zero();}
+   void Start(void)
+      {hilf=std::chrono::steady_clock::now();}
+   void Stop(void)
+      {timer+=std::chrono::steady_clock::now()-hilf;}
+   void Clear(void) {timer=std::chrono::steady_clock::duration::zero();}
+   double Get(void) {return std::chrono::duration<double>(timer).count();}
+};
+
 #endif
 
 
@@ -0,0 +1,240 @@
+/* ----------------------------------------------------------------
+
+SmillaEnlarger  -  resize, especially magnify bitmaps in high quality
+    ImageSource.cpp: the source pixels of an enlargement, mapped from file or from a QImage
+
+Copyright (C) 2009 Mischa Lusteck
+Copyright (C) 2017 Alejandro Sirgo
+
+This program is free software;
+you can redistribute it and/or modify it under the terms of the
+GNU General Public License as published by the Free Software Foundation;
+either version 3 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+---------------------------------------------------------------------- */
+#include <QFileInfo>
+#include <cctype>
+#include <cstring>
+#include <QImageReader>
+#include "ImageSource.h"
+
+using namespace std;
+
+QImageSource::QImageSource(const QImage & i)
+   : ImageSource(i.width(), i.height(), i.hasAlphaChannel(), rgb32) {
+   // 32bit-pixels, so src-lines can be read directly from the scanlines
+   img = i.convertToFormat(alpha ? QImage::Format_ARGB32 : QImage::Format_RGB32);
+}
+
+MappedSource::MappedSource(const QString & fileName, int w, int h, bool withAlpha, qint64 offset)
+   : ImageSource(w, h, withAlpha, withAlpha ? rgbaBytes : rgbBytes), file(fileName), data(0) {
+   bytesPerLine = qint64(width)*BytesPerPixel();
+   if(!file.open(QIODevice::ReadOnly))
+      return;
+   if(file.size() < offset + bytesPerLine*height)
+      return;
+   data = file.map(offset, bytesPerLine*height);
+}
+
+MappedSource::~MappedSource(void) {
+   // unmapped by closing the file
+   file.close();
+}
+
+shared_ptr<ImageSource> ImageSource::FromImage(const QImage & img) {
+   return shared_ptr<ImageSource>(new QImageSource(img));
+}
+
+// reads the tokens of a ppm/pam header
+class HeaderScanner {
+   const char *buf;
+   int len, pos;
+public:
+   HeaderScanner(const QByteArray & b) : buf(b.constData()), len(b.size()), pos(0) {}
+   int Pos(void) const { return pos; }
+   bool AtEnd(void) const { return pos >= len; }
+   void SkipSpace(void) {     // incl. comments
+      while(pos < len) {
+         if(buf[pos] == '#') {
+            while(pos < len && buf[pos] != '\n')
+               pos++;
+         }
+         else if(isspace((unsigned char)buf[pos]))
+            pos++;
+         else
+            break;
+      }
+   }
+   QByteArray Word(void) {
+      SkipSpace();
+      int p0 = pos;
+      while(pos < len && !isspace((unsigned char)buf[pos]))
+         pos++;
+      return QByteArray(buf + p0, pos - p0);
+   }
+   int Number(void) {
+      bool ok;
+      int n = Word().toInt(&ok);
+      return ok ? n : -1;
+   }
+   bool SkipNewline(void) {   // the end of a pam-header line
+      while(pos < len && buf[pos] != '\n')
+         pos++;
+      return pos++ < len;
+   }
+   bool SkipOneSpace(void) {  // after the maxval of P6
+      if(pos >= len || !isspace((unsigned char)buf[pos]))
+         return false;
+      pos++;
+      return true;
+   }
+};
+
+// P6 or P7 (pam): size, alpha & offset of the pixel data, false if not 8bit RGB(A)
+static bool ReadPnmHeader(const QByteArray & head, int & w, int & h, bool & withAlpha, qint64 & offset) {
+   HeaderScanner sc(head);
+   QByteArray magic = sc.Word();
+   withAlpha = false;
+   if(magic == "P6") {
+      w = sc.Number();
+      h = sc.Number();
+      int maxVal = sc.Number();
+      if(maxVal != 255 || !sc.SkipOneSpace())
+         return false;
+   }
+   else if(magic == "P7") {
+      int depth = 0, maxVal = 0;
+      QByteArray tuplType;
+      w = h = 0;
+      for(;;) {
+         QByteArray key = sc.Word();
+         if(key.isEmpty())
+            return false;
+         if(key == "ENDHDR") {
+            if(!sc.SkipNewline())
+               return false;
+            break;
+         }
+         if(     key == "WIDTH" ) w = sc.Number();
+         else if(key == "HEIGHT") h = sc.Number();
+         else if(key == "DEPTH" ) depth  = sc.Number();
+         else if(key == "MAXVAL") maxVal = sc.Number();
+         else if(key == "TUPLTYPE") tuplType = sc.Word();
+         else
+            return false;
+      }
+      if(maxVal != 255)
+         return false;
+      if(depth == 4 && tuplType == "RGB_ALPHA")
+         withAlpha = true;
+      else if(depth != 3 || (!tuplType.isEmpty() && tuplType != "RGB"))
+         return false;
+   }
+   else
+      return false;
+   offset = sc.Pos();
+   return w > 0 && h > 0;
+}
+
+bool ImageSource::CanMap(const QString & fileName) {
+   QString type = QFileInfo(fileName).suffix().toLower();
+   return type == "ppm" || type == "pam" || type == "raw";
+}
+
+shared_ptr<ImageSource> ImageSource::Map(const QString & fileName, int rawW, int rawH) {
+   QString type = QFileInfo(fileName).suffix().toLower();
+   int w, h;
+   bool withAlpha;
+   qint64 offset;
+
+   if(type == "raw") {
+      // the channels from the file size: r,g,b or r,g,b,a
+      qint64 pixels = qint64(rawW)*rawH;
+      qint64 size   = QFileInfo(fileName).size();
+      if(pixels <= 0 || (size != 3*pixels && size != 4*pixels))
+         return shared_ptr<ImageSource>();
+      w = rawW; h = rawH;
+      withAlpha = size == 4*pixels;
+      offset = 0;
+   }
+   else if(type == "ppm" || type == "pam") {
+      QFile f(fileName);
+      if(!f.open(QIODevice::ReadOnly))
+         return shared_ptr<ImageSource>();
+      QByteArray head = f.read(4096);
+      if(!ReadPnmHeader(head, w, h, withAlpha, offset))
+         return shared_ptr<ImageSource>();
+   }
+   else
+      return shared_ptr<ImageSource>();
+
+   MappedSource *src = new MappedSource(fileName, w, h, withAlpha, offset);
+   if(!src->IsMapped()) {
+      delete src;
+      return shared_ptr<ImageSource>();
+   }
+   return shared_ptr<ImageSource>(src);
+}
+
+shared_ptr<ImageSource> ImageSource::Open(const QString & fileName, int rawW, int rawH) {
+   shared_ptr<ImageSource> src;
+   if(CanMap(fileName))
+      src = Map(fileName, rawW, rawH);
+   if(!src) {
+      QImage img;
+      if(!img.load(fileName))
+         return shared_ptr<ImageSource>();
+      src = FromImage(img);
+   }
+   return src;
+}
+
+// alpha as QImage::hasAlphaChannel of the decoded image will tell:
+// a palette (or an unknown format) may hold alpha, only known after decoding
+static bool FormatHasAlpha(QImage::Format f) {
+   switch(f) {
+   case QImage::Format_Invalid:
+   case QImage::Format_Mono:
+   case QImage::Format_MonoLSB:
+   case QImage::Format_Indexed8:
+      return true;
+   default:
+      return QImage::toPixelFormat(f).alphaUsage() == QPixelFormat::UsesAlpha;
+   }
+}
+
+bool ImageSource::ReadSize(const QString & fileName, int & w, int & h, bool & withAlpha, int rawW, int rawH) {
+   if(CanMap(fileName)) {
+      shared_ptr<ImageSource> src = Map(fileName, rawW, rawH);   // only the header is read
+      if(src) {
+         w = src->Width();
+         h = src->Height();
+         withAlpha = src->HasAlpha();
+         return true;
+      }
+   }
+   QImageReader reader(fileName);
+   QSize size = reader.size();
+   if(size.width() > 0 && size.height() > 0) {
+      w = size.width();
+      h = size.height();
+      withAlpha = FormatHasAlpha(reader.imageFormat());
+      return true;
+   }
+   QImage img;
+   if(!img.load(fileName))
+      return false;
+   w = img.width();
+   h = img.height();
+   withAlpha = img.hasAlphaChannel();
+   return true;
+}
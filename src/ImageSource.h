@@ -0,0 +1,94 @@
+/* ----------------------------------------------------------------
+
+SmillaEnlarger  -  resize, especially magnify bitmaps in high quality
+    ImageSource.h: the source pixels of an enlargement, mapped from file or from a QImage
+
+Copyright (C) 2009 Mischa Lusteck
+Copyright (C) 2017 Alejandro Sirgo
+
+This program is free software;
+you can redistribute it and/or modify it under the terms of the
+GNU General Public License as published by the Free Software Foundation;
+either version 3 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+---------------------------------------------------------------------- */
+#ifndef IMAGESOURCE_H
+#define IMAGESOURCE_H
+
+#include <QString>
+#include <QFile>
+#include <QImage>
+#include <memory>
+
+// The source pixels of an enlargement, read by the enlargers span by span
+// (ThColorEnlarger::ReadSrcSpan). The lines are read-only & stay valid as long as
+// the source exists, so several workers can read them at the same time.
+// A mapped source (ppm, pam, raw) isn't decoded or copied: only the lines
+// read by the blocks are paged in.
+class ImageSource {
+public:
+   enum Layout {
+      rgb32,       // QRgb-words, as QImage::Format_RGB32 / Format_ARGB32
+      rgbBytes,    // bytes r,g,b
+      rgbaBytes    // bytes r,g,b,a
+   };
+
+protected:
+   int width, height;
+   bool alpha;
+   Layout layout;
+
+public:
+   ImageSource(int w, int h, bool withAlpha, Layout l) : width(w), height(h), alpha(withAlpha), layout(l) {}
+   virtual ~ImageSource(void) {}
+
+   int Width(void)  const { return width;  }
+   int Height(void) const { return height; }
+   bool HasAlpha(void) const { return alpha; }
+   Layout PixelLayout(void) const { return layout; }
+   int BytesPerPixel(void) const { return layout == rgbBytes ? 3 : 4; }
+   virtual const uchar *Line(int y) const = 0;
+
+   // the image converted to RGB32 / ARGB32, shared with the caller (no copy if already in that format)
+   static std::shared_ptr<ImageSource> FromImage(const QImage & img);
+   // the file mapped into memory, if it's 8bit ppm (P6) or pam (RGB, RGB_ALPHA);
+   // raw: headerless r,g,b(,a) bytes of the size rawW x rawH.
+   // 0 if the file can't be mapped, then it has to be loaded by QImage
+   static std::shared_ptr<ImageSource> Map(const QString & fileName, int rawW=0, int rawH=0);
+   static bool CanMap(const QString & fileName);
+   // mapped if possible, else decoded by QImage; 0 if the file can't be read.
+   // Decoding takes time: called by the enlarging thread (see EnlargerThread::EnlargeFileAndSave)
+   static std::shared_ptr<ImageSource> Open(const QString & fileName, int rawW=0, int rawH=0);
+   // the size & alpha from the header (the format of QImageReader), without decoding
+   // (only if the header can't tell); withAlpha is true if unknown (palettes)
+   static bool ReadSize(const QString & fileName, int & w, int & h, bool & withAlpha, int rawW=0, int rawH=0);
+};
+
+class QImageSource : public ImageSource {
+   QImage img;
+public:
+   QImageSource(const QImage & i);
+   const uchar *Line(int y) const { return img.constScanLine(y); }
+};
+
+class MappedSource : public ImageSource {
+   QFile file;
+   const uchar *data;     // first pixel
+   qint64 bytesPerLine;
+public:
+   MappedSource(const QString & fileName, int w, int h, bool withAlpha, qint64 offset);
+   ~MappedSource(void);
+   bool IsMapped(void) const { return data != 0; }
+   const uchar *Line(int y) const { return data + y*bytesPerLine; }
+};
+
+#endif // IMAGESOURCE_H
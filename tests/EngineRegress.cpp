@@ -0,0 +1,430 @@
+/* ----------------------------------------------------------------
+
+SmillaEnlarger  -  resize, especially magnify bitmaps in high quality
+    EngineRegress.cpp: regression driver for the enlarger engine, without Qt
+
+Copyright (C) 2009 Mischa Lusteck
+Copyright (C) 2017 Alejandro Sirgo
+
+This program is free software;
+you can redistribute it and/or modify it under the terms of the
+GNU General Public License as published by the Free Software Foundation;
+either version 3 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+---------------------------------------------------------------------- */
+
+// The ways of splitting up the work must not change the image. On synthetic sources
+// (Point and Point4) the driver renders with BasicEnlarger::Enlarge and compares with the
+// reference render (full image, the chosen block len):
+//  - every block len from 2^minBlockExp to maxBlockLen
+//  - clip-rects inside the image & exceeding it (the margins are not compared)
+//  - shrinking: the bands of ShrinkBand in reverse order against ShrinkClip
+// Enlarging, the src-pixels analysed per dst-pixel must not exceed those of analysing the
+// whole srcBlock of each blockLen-block of the clip-rect once (the first version).
+// High zoom (analysis blocks longer than blockLen) on a small source.
+// A second pass over the image with the contexts of the first must not allocate: neither the
+// scratch arenas (ScratchArena::HeapAllocs) nor anything else (the operator new of the driver).
+// Tolerance: max. abs. difference 1e-6 of the channels (range [0,1]); all are identical now.
+// Shrinking a clip-rect: 1e-5, its box-filter sums start at the clip (5.2e-6 since the first version).
+//
+// Between two trees: "-save file" writes the reference renders without dither (its noise
+// is keyed on the dst-position since the first version), "-ref file [tol]" compares with them,
+// default tol 2e-3: against the first version the vectorized 5x5 weighting moved single
+// values by up to 1.6e-3.
+//
+// The engine needs no Qt. Built & run from the top dir (exit code 1 if a check fails):
+//   g++ -O2 -std=c++11 -I. -Isrc -o engine-regress tests/EngineRegress.cpp
+//       src/TemplateInst.cpp src/ImageEnlargerCode/*.cpp -lpthread
+//   ./engine-regress
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <new>
+
+#include "ImageEnlargerCode/EnlargerTemplate.h"
+#include "ImageEnlargerCode/EnlargerTemplateDefs.h"
+#include "ImageEnlargerCode/SetupCache.h"
+
+using namespace std;
+
+template class BasicEnlarger <Point>;  // explicit instantiations
+template class BasicEnlarger <Point4>;
+
+// counts all heap-allocations of the driver & the engine (see CheckWarm)
+static std::atomic<long> numNews(0);
+
+void *operator new(size_t n) {
+   numNews++;
+   void *p = malloc(n > 0 ? n : 1);
+   if(p == 0)
+      throw bad_alloc();
+   return p;
+}
+
+void operator delete(void *p) noexcept { free(p); }
+
+const float sameTol = 1e-6;
+const float shrinkClipTol = 1e-5;
+const float refTol  = 2e-3;
+
+static int Channels(const Point & p, float *c)  { c[0] = p.x; c[1] = p.y; c[2] = p.z; return 3; }
+static int Channels(const Point4 & p, float *c) { c[0] = p.x; c[1] = p.y; c[2] = p.z; c[3] = p.w; return 4; }
+
+// source & result in memory, the result has the size of the clip-rect (with margins)
+template<class T>
+class MemEnlarger : public BasicEnlarger<T> {
+   const vector<T> & src;
+   int srcW;
+   vector<T> & dst;
+   int dstW;
+
+public:
+   MemEnlarger(const EnlargeFormat & format, const EnlargeParameter & param, const vector<T> & s, vector<T> & d)
+	  : BasicEnlarger<T>(format, param), src(s), srcW(format.srcWidth), dst(d), dstW(format.ClipW()) {}
+
+   void ReadSrcPixel(int srcX, int srcY, T & p) { p = src[srcX + size_t(srcY)*srcW]; }
+   void WriteDstPixel(T p, int dstCX, int dstCY) { dst[dstCX + size_t(dstCY)*dstW] = p; }
+
+   void SetBlockLen(int len) { BasicEnlarger<T>::SetBlockLen(len); }
+   // Enlarge twice, the second pass with the contexts of the first:
+   // its allocations by the arenas & by operator new
+   void EnlargeTwice(long & arenaAllocs, long & newAllocs) {
+      int ax, ay, dstX, dstY, x0, y0, x1, y1;
+      BlockContext<T> *ac = this->NewAnalysisContext();
+      BlockContext<T> *bc = this->NewBlockContext();
+	  for(int pass=0; pass<2; pass++) {
+         long arena0 = ScratchArena::HeapAllocs(), new0 = numNews.load();
+		 for(ay = this->AnalysisGridPos(this->ClipY0()); ay < this->ClipY1(); ay+=this->AnalysisLen()) {
+			for(ax = this->AnalysisGridPos(this->ClipX0()); ax < this->ClipX1(); ax+=this->AnalysisLen()) {
+			   this->AnalysisBegin(*ac, ax, ay);
+			   this->AnalyseSrcBlock(*ac);
+			   this->AnalysisBlocks(ax, ay, x0, y0, x1, y1);
+			   for(dstY = y0; dstY < y1; dstY+=this->SizeDstBlock()) {
+				  for(dstX = x0; dstX < x1; dstX+=this->SizeDstBlock()) {
+					 this->BlockBegin(*bc, dstX, dstY, *ac);
+					 this->EnlargeBlock(*bc);
+					 this->WriteDstBlock(*bc);
+                  }
+               }
+            }
+         }
+         arenaAllocs = ScratchArena::HeapAllocs() - arena0;
+         newAllocs = numNews.load() - new0;
+      }
+      delete bc;
+      delete ac;
+   }
+   int  SizeDstBlock(void)   { return BasicEnlarger<T>::SizeDstBlock(); }
+   void ShrinkBandsBackwards(void) {
+      this->BeginShrink();
+      ScratchArena scratch(this->ShrinkScratchBytes());
+	  for(int b=this->NumShrinkBands()-1; b>=0; b--)
+         this->ShrinkBand(b, scratch);
+      this->EndShrink();
+   }
+};
+
+// stripes, edges, a smooth wave & noise: something for each part of the analysis
+template<class T>
+static void MakeSrc(vector<T> & src, int w, int h) {
+   unsigned int r = 12345;
+   float c[4];
+
+   src.assign(size_t(w)*h, T());
+   for(int y=0; y<h; y++) {
+	  for(int x=0; x<w; x++) {
+         r = r*1103515245 + 12345;
+         float n = float((r >> 16) & 255)*(1.0/255.0);
+		 c[0] = 0.5 + 0.4*sin(x*0.3)*cos(y*0.2);
+		 c[1] = (x*7 + y*3) % 50 < 25 ? 0.9 : 0.1;
+		 c[2] = 0.3 + 0.3*n;
+		 c[3] = (x/16 + y/16) % 2 == 0 ? 1.0 : 0.25 + 0.5*n;
+		 T & p = src[x + size_t(y)*w];
+		 float *pc = (float *)&p;     // x,y,z(,w)
+		 for(int a=0; a<int(sizeof(T)/sizeof(float)); a++)
+			pc[a] = c[a];
+      }
+   }
+}
+
+struct Render {
+   int blockLen;         // 0: the chosen one
+   bool clipped;
+   int cx0, cy0, cx1, cy1;
+   int dither;
+   Render(void) : blockLen(0), clipped(false), cx0(0), cy0(0), cx1(0), cy1(0), dither(10) {}
+};
+
+static EnlargeParameter Param(int dither) {
+   EnlargeParamInt pi;
+   pi.sharp = 80; pi.flat = 20; pi.dither = dither;
+   pi.deNoise = 20; pi.preSharp = 10; pi.fractNoise = 20;
+   return pi.FloatParam();
+}
+
+// src-pixels of analysing the whole srcBlock of each blockLen-block of the clip-rect once
+static double BaselineAnalysed(const EnlargeFormat & f) {
+   int cx0 = f.clipX0 > 0 ? f.clipX0 : 0, cy0 = f.clipY0 > 0 ? f.clipY0 : 0;
+   int cx1 = f.clipX1 < f.DstWidth()  ? f.clipX1 : f.DstWidth();
+   int cy1 = f.clipY1 < f.DstHeight() ? f.clipY1 : f.DstHeight();
+   if(cx1 <= cx0 || cy1 <= cy0)
+      return 0.0;
+   int blocksX = (cx1 - cx0/blockLen*blockLen + blockLen - 1)/blockLen;
+   int blocksY = (cy1 - cy0/blockLen*blockLen + blockLen - 1)/blockLen;
+   float invX = 1.0/(float(f.DstWidth())/float(f.srcWidth));   // as BasicEnlarger
+   float invY = 1.0/(float(f.DstHeight())/float(f.srcHeight));
+   double srcBX = int(invX*float(blockLen) + 0.5) + 2*srcBlockMargin;
+   double srcBY = int(invY*float(blockLen) + 0.5) + 2*srcBlockMargin;
+   return double(blocksX)*blocksY*srcBX*srcBY;
+}
+
+static int numFailed = 0;
+
+// src-pixels analysed per dst-pixel of the clip-rect: at most the baseline
+static void CheckAnalysed(const string & name, pixIdx analysed, double baseline, int clipW, int clipH) {
+   bool pass = analysed <= baseline;
+   if(!pass)
+      numFailed++;
+   double dstPixels = double(clipW > 0 ? clipW : 1)*(clipH > 0 ? clipH : 1);
+   cout<<(pass ? "ok    " : "FAIL  ")<<name<<"  analysed/dst-pixel "<<double(analysed)/dstPixels
+       <<" baseline "<<baseline/dstPixels<<"\n"<<flush;
+}
+
+// false if the render couldn't be done as asked
+template<class T>
+static bool DoRender(const vector<T> & src, int w, int h, float scale, const Render & r, vector<T> & dst, int & dstW, int & dstH,
+                     const string & name = "") {
+   EnlargeFormat f;
+   f.SetSrcSize(w, h);
+   f.SetScaleFact(scale);
+   if(r.clipped)
+      f.SetDstClip(r.cx0, r.cy0, r.cx1, r.cy1);
+   dstW = f.ClipW();
+   dstH = f.ClipH();
+   dst.assign(size_t(dstW)*dstH, T(-1.0));
+
+   std::shared_ptr<FractTab> fractTab = SharedFractTab(scale);
+   MemEnlarger<T> e(f, Param(r.dither), src, dst);
+   e.SetFractTab(fractTab.get());
+   bool ok = true;
+   if(r.blockLen > 0 && !e.OnlyShrinking()) {
+      e.SetBlockLen(r.blockLen);
+      ok = e.SizeDstBlock() == r.blockLen;
+   }
+   e.Enlarge();
+   if(!name.empty() && !e.OnlyShrinking())
+      CheckAnalysed(name, e.AnalysedPixels(), BaselineAnalysed(f), f.ClipW(), f.ClipH());
+   return ok;
+}
+
+// max. difference of img (of clip-rect) to ref (full image) where img lies inside ref
+template<class T>
+static float MaxDiff(const vector<T> & ref, int refW, int refH, const vector<T> & img, int imgW, int imgH, int cx0, int cy0) {
+   float d = 0.0, a[4], b[4];
+   for(int y=0; y<imgH; y++) {
+	  if(y + cy0 < 0 || y + cy0 >= refH)
+         continue;
+	  for(int x=0; x<imgW; x++) {
+		 if(x + cx0 < 0 || x + cx0 >= refW)
+            continue;
+		 int n = Channels(ref[x+cx0 + size_t(y+cy0)*refW], a);
+		 Channels(img[x + size_t(y)*imgW], b);
+		 for(int c=0; c<n; c++)
+			if(fabs(a[c] - b[c]) > d)
+               d = fabs(a[c] - b[c]);
+      }
+   }
+   return d;
+}
+
+static void Check(const string & name, bool ok, float diff, float tol) {
+   bool pass = ok && diff <= tol;
+   if(!pass)
+      numFailed++;
+   cout<<(pass ? "ok    " : "FAIL  ")<<name<<"  max.diff "<<diff<<(ok ? "" : "  (not rendered as asked)")<<"\n"<<flush;
+}
+
+static string Name(const char *what, float scale, int v) {
+   return string(what) + " scale " + to_string(scale).substr(0, 4) + (v ? " len " + to_string(v) : string(""));
+}
+
+// the reference & its variants for one scale
+template<class T>
+static void CheckScale(const vector<T> & src, int w, int h, float scale, const char *type) {
+   vector<T> ref, img;
+   int refW, refH, imgW, imgH;
+   Render r;
+   string tn = string(type) + " ";
+
+   DoRender(src, w, h, scale, r, ref, refW, refH, tn + Name("reference", scale, 0));
+   if(scale < 1.0) {
+      EnlargeFormat f;
+      f.SetSrcSize(w, h);
+      f.SetScaleFact(scale);
+      img.assign(size_t(refW)*refH, T(-1.0));
+      MemEnlarger<T> e(f, Param(r.dither), src, img);
+      e.ShrinkBandsBackwards();
+      Check(tn + Name("shrink bands backwards", scale, 0), true, MaxDiff(ref, refW, refH, img, refW, refH, 0, 0), sameTol);
+   }
+   else {
+	  for(int len = 1 << minBlockExp; len <= maxBlockLen; len *= 2) {
+         r.blockLen = len;
+		 bool ok = DoRender(src, w, h, scale, r, img, imgW, imgH, tn + Name("per block", scale, len));
+         Check(tn + Name("per block", scale, len), ok, MaxDiff(ref, refW, refH, img, imgW, imgH, 0, 0), sameTol);
+      }
+   }
+
+   // inside the image, crossing blocks; then exceeding it (margins), also with short blocks
+   const int clips[2][4] = { { refW/3 + 7, refH/4 + 3, refW*3/4, refH - 5 },
+                             { -20, 30, refW/2 + 1, refH + 15 } };
+   float clipTol = scale < 1.0 ? shrinkClipTol : sameTol;
+   for(int c=0; c<2; c++) {
+      Render rc;
+      rc.clipped = true;
+      rc.cx0 = clips[c][0]; rc.cy0 = clips[c][1]; rc.cx1 = clips[c][2]; rc.cy1 = clips[c][3];
+      string cn = tn + Name(c == 0 ? "clip inside" : "clip exceeding", scale, 0);
+      bool ok = DoRender(src, w, h, scale, rc, img, imgW, imgH, cn);
+      Check(cn, ok,
+            MaxDiff(ref, refW, refH, img, imgW, imgH, rc.cx0, rc.cy0), clipTol);
+	  if(scale < 1.0)
+         continue;
+      rc.blockLen = 128;
+      cn = tn + Name(c == 0 ? "clip inside" : "clip exceeding", scale, 128);
+      ok = DoRender(src, w, h, scale, rc, img, imgW, imgH, cn);
+      Check(cn, ok,
+            MaxDiff(ref, refW, refH, img, imgW, imgH, rc.cx0, rc.cy0), sameTol);
+   }
+}
+
+// steady state: a second pass with warmed contexts allocates nothing, and renders the same
+template<class T>
+static void CheckWarm(const vector<T> & src, int w, int h, float scale, int len, const char *type) {
+   vector<T> ref, img;
+   int refW, refH;
+   Render r;
+   r.blockLen = len;
+   DoRender(src, w, h, scale, r, ref, refW, refH);
+
+   EnlargeFormat f;
+   f.SetSrcSize(w, h);
+   f.SetScaleFact(scale);
+   img.assign(size_t(refW)*refH, T(-1.0));
+   std::shared_ptr<FractTab> fractTab = SharedFractTab(scale);
+   MemEnlarger<T> e(f, Param(r.dither), src, img);
+   e.SetFractTab(fractTab.get());
+   e.SetBlockLen(len);
+   long arenaAllocs = -1, newAllocs = -1;
+   e.EnlargeTwice(arenaAllocs, newAllocs);
+
+   string name = string(type) + " " + Name("warm contexts", scale, len);
+   bool pass = arenaAllocs == 0 && newAllocs == 0;
+   if(!pass)
+      numFailed++;
+   cout<<(pass ? "ok    " : "FAIL  ")<<name<<"  second pass: arena allocs "<<arenaAllocs
+       <<", operator new "<<newAllocs<<"\n"<<flush;
+   Check(name, true, MaxDiff(ref, refW, refH, img, refW, refH, 0, 0), sameTol);
+}
+
+// the reference renders in the file, one after the other: w, h, then the channels as floats
+template<class T>
+static void FileRef(const vector<T> & src, int w, int h, float scale, const char *type,
+                    ofstream & saveFile, ifstream & refFile, float tol) {
+   vector<T> ref;
+   int refW, refH;
+   Render r;
+
+   r.dither = 0;
+   DoRender(src, w, h, scale, r, ref, refW, refH);
+   if(saveFile.is_open()) {
+      saveFile.write((const char *)&refW, sizeof(int));
+      saveFile.write((const char *)&refH, sizeof(int));
+      saveFile.write((const char *)ref.data(), ref.size()*sizeof(T));
+      return;
+   }
+
+   string name = string(type) + " " + Name("reference", scale, 0) + " against ref-file";
+   int fw = 0, fh = 0;
+   refFile.read((char *)&fw, sizeof(int));
+   refFile.read((char *)&fh, sizeof(int));
+   if(!refFile || fw != refW || fh != refH) {
+      Check(name, false, 0.0, tol);
+      return;
+   }
+   vector<T> old(size_t(fw)*fh);
+   refFile.read((char *)old.data(), old.size()*sizeof(T));
+   Check(name, bool(refFile), MaxDiff(old, fw, fh, ref, refW, refH, 0, 0), tol);
+}
+
+int main(int argc, char *argv[]) {
+   const int srcW = 420, srcH = 260;       // 1.3 and up: more than one analysis block
+   const float scales[] = { 1.3, 2.3, 0.45, 0.8 };
+   const int numScales = 4;
+   const int zoomW = 70, zoomH = 50;       // high zoom: more than one of the longer analysis blocks
+   const float zoomScales[] = { 8.0, 32.0 };
+   const int numZoomScales = 2;
+   vector<Point> src3, zoomSrc;
+   vector<Point4> src4;
+
+   ofstream saveFile;
+   ifstream refFile;
+   float tol = refTol;
+   if(argc >= 3 && strcmp(argv[1], "-save") == 0) {
+      saveFile.open(argv[2], ios::binary);
+	  if(!saveFile) {
+         cout<<"Can't create "<<argv[2]<<"\n";
+         return 2;
+      }
+   }
+   else if(argc >= 3 && strcmp(argv[1], "-ref") == 0) {
+      refFile.open(argv[2], ios::binary);
+	  if(argc >= 4)
+         tol = atof(argv[3]);
+	  if(!refFile) {
+         cout<<"Can't open "<<argv[2]<<"\n";
+         return 2;
+      }
+   }
+   else if(argc > 1) {
+      cout<<"Usage: engine-regress [-save file | -ref file [tol]]\n";
+      return 2;
+   }
+
+   MakeSrc(src3, srcW, srcH);
+   MakeSrc(src4, srcW, srcH);
+   bool useFile = saveFile.is_open() || refFile.is_open();
+   for(int s=0; s<numScales; s++) {
+      CheckScale(src3, srcW, srcH, scales[s], "rgb ");
+	  if(useFile)
+         FileRef(src3, srcW, srcH, scales[s], "rgb ", saveFile, refFile, tol);
+   }
+   MakeSrc(zoomSrc, zoomW, zoomH);
+   for(int s=0; s<numZoomScales; s++)
+      CheckScale(zoomSrc, zoomW, zoomH, zoomScales[s], "rgb ");
+   CheckScale(src4, srcW, srcH, 2.3, "rgba");
+   CheckWarm(src3, srcW, srcH, 2.3, 1 << minBlockExp, "rgb ");
+   CheckWarm(src4, srcW, srcH, 2.3, maxBlockLen, "rgba");
+   CheckWarm(zoomSrc, zoomW, zoomH, 8.0, 1 << minBlockExp, "rgb ");
+   if(useFile)
+      FileRef(src4, srcW, srcH, 2.3, "rgba", saveFile, refFile, tol);
+
+   if(numFailed == 0)
+      cout<<"all checks passed\n";
+   else
+      cout<<"checks failed: "<<numFailed<<"\n";
+   return numFailed == 0 ? 0 : 1;
+}